@@ -1,4 +1,5 @@
 #include "GlitchSphereGeometry.h"
+#include <glutils/MeshNormals.h>
 
 #include <cmath> // sin, cos, sqrt
 
@@ -84,24 +85,6 @@ void GlitchSphereGeometry::createSphereGeometryWithGlitch( float cx, float cy, f
                 vp[2] = cz + radius*f[1];
                 vp[1] = cy + radius*f[2];
 
-                if (this->hasNormals())
-                {
-                    float* np = MeshBuffer::getNormalData(vi);
-                    if (lambda > 0.f)
-                    {
-                        float length = std::sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
-                        np[0] = f[0] / length;
-                        np[1] = f[1] / length;
-                        np[2] = f[2] / length;
-                    }
-                    else
-                    {
-                        np[0] = f[0];
-                        np[1] = f[1];
-                        np[2] = f[2];
-                    }
-                }
-
                 if (this->hasUVs())
                 {
                     float* uv = MeshBuffer::getUVData(vi);
@@ -144,6 +127,13 @@ void GlitchSphereGeometry::createSphereGeometryWithGlitch( float cx, float cy, f
         assert(index_count == num_tris*3);
     }
 
+    // Normals of the deformed surface, the glitch modulation is not radial
+    if (this->hasNormals())
+    {
+        computeNormals(*this);
+    }
+    MeshBuffer::touch();
+
     if(hasResolutionChanged || colormap != m_lastColormap)
     {
         setColormap(colormap);
@@ -202,6 +192,7 @@ void GlitchSphereGeometry::setColormap(int colormap)
             }
         }
     }
+    MeshBuffer::touch();
 }
 
 inline void GlitchSphereGeometry::Cache::update(size_t n)
@@ -21,8 +21,9 @@ public:
         int colormap = 0;
     };
 
-    GlitchSphereGeometry( MeshVertexAttribute attributes = MeshVertexAttribute::Normal | MeshVertexAttribute::Color | MeshVertexAttribute::UV )
-    : MeshBuffer( MeshPrimitiveType::Triangles, attributes )
+    GlitchSphereGeometry( MeshVertexAttribute attributes = MeshVertexAttribute::Normal | MeshVertexAttribute::Color | MeshVertexAttribute::UV,
+                          MeshVertexLayout layout = MeshVertexLayout::Separate, size_t stride = 0 )
+    : MeshBuffer( MeshPrimitiveType::Triangles, attributes, layout, stride )
     {}
     
     void createSphereGeometryWithGlitch( float cx, float cy, float cz, float radius, int resolution, float t, float lambda, int colormap=0);
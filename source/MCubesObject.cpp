@@ -4,34 +4,115 @@
 #include <fx/PerlinNoise.h>
 #include <fx/TilingSimplexFlowNoise.h>
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <functional>
 
+namespace {
 
-void MCubesObject::compute(float scale, float iso, unsigned N, unsigned slice, unsigned nslices)
+struct Params
+{
+    float x0 = 123.3456f;
+    float y0 = 732.5489f;
+    float z0 = 129.3983f;
+};
+
+float samplefun_noise(float x,float y,float z,void* userdata)
+{
+    Params p = userdata ? *(Params*)userdata : Params();
+
+    int octaves = 3;
+    float perstistence = 0.75;
+    float noise = PerlinNoise::fabsnoise( x+p.x0,y+p.y0,z+p.z0, octaves,perstistence );
+        
+    // center-sphere cut-out
+    return fabs(noise) - (0.5f / (x*x + y*y + (z-1.f)*(z-1.f)));
+}
+
+const unsigned NoVertex = ~0u;
+
+/// Regular lattice of the stitched mesher, point (i,j,k) is at origin+(i,j,k)*scale
+struct Lattice
 {
-    struct Params
+    unsigned N; ///< Number of cubes per axis
+    float scale;
+    float iso;
+    Params pos;
+
+    float coord(unsigned i) const { return -1.f - scale*.5f + i*scale; }
+
+    float sample(float x, float y, float z) const
     {
-        float x0 = 123.3456f;
-        float y0 = 732.5489f;
-        float z0 = 129.3983f;
-    };
+        Params p = pos;
+        return samplefun_noise(x, y, z, &p);
+    }
 
-    auto samplefun_sphere = [](float x,float y,float z,void*) 
+    void normal(const float* p, float* n) const
     {
-        return std::sqrt(x*x + y*y + z*z); 
-    };
+        // central differences, as in MarchingCubes::triangulate()
+        const float delta = 0.001f;
+        n[0] = sample(p[0]-delta, p[1], p[2]) - sample(p[0]+delta, p[1], p[2]);
+        n[1] = sample(p[0], p[1]-delta, p[2]) - sample(p[0], p[1]+delta, p[2]);
+        n[2] = sample(p[0], p[1], p[2]-delta) - sample(p[0], p[1], p[2]+delta);
+        float length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+    }
 
-    auto samplefun_noise = [](float x,float y,float z,void* userdata) -> float
+    bool crosses(float f0, float f1) const { return (f0 < iso) != (f1 < iso); }
+
+    void computePlane(unsigned k, MCubesPlane& plane) const
     {
-        Params p = userdata ? *(Params*)userdata : Params();
+        const unsigned M = N+1;
+        const float z = coord(k);
+
+        plane.samples.resize(M*M);
+        for(unsigned j=0; j < M; ++j)
+            for(unsigned i=0; i < M; ++i)
+                plane.samples[j*M+i] = sample(coord(i), coord(j), z);
+
+        plane.xEdges.assign(M*M, NoVertex);
+        plane.yEdges.assign(M*M, NoVertex);
+        plane.vertices.clear();
+        plane.normals.clear();
+
+        auto addVertex = [&plane,this](float x, float y, float z) -> unsigned
+        {
+            const float p[3] = { x, y, z };
+            float n[3];
+            normal(p, n);
+            plane.vertices.insert(plane.vertices.end(), p, p+3);
+            plane.normals .insert(plane.normals .end(), n, n+3);
+            return static_cast<unsigned>(plane.vertices.size()/3 - 1);
+        };
+
+        for(unsigned j=0; j < M; ++j)
+            for(unsigned i=0; i < M; ++i)
+            {
+                const float f0 = plane.samples[j*M+i];
+                if(i < N && crosses(f0, plane.samples[j*M+i+1]))
+                {
+                    float ofs = MarchingCubes::edgeOffset(f0, plane.samples[j*M+i+1], iso);
+                    plane.xEdges[j*M+i] = addVertex(coord(i) + ofs*scale, coord(j), z);
+                }
+                if(j < N && crosses(f0, plane.samples[(j+1)*M+i]))
+                {
+                    float ofs = MarchingCubes::edgeOffset(f0, plane.samples[(j+1)*M+i], iso);
+                    plane.yEdges[j*M+i] = addVertex(coord(i), coord(j) + ofs*scale, z);
+                }
+            }
+    }
+};
+
+} // namespace
 
-        int octaves = 3;
-        float perstistence = 0.75;
-        float noise = PerlinNoise::fabsnoise( x+p.x0,y+p.y0,z+p.z0, octaves,perstistence );
-            
-        // center-sphere cut-out
-        return fabs(noise) - (0.5f / (x*x + y*y + (z-1.f)*(z-1.f)));
+void MCubesObject::compute(float scale, float iso, unsigned N, unsigned slice, unsigned nslices)
+{
+    auto samplefun_sphere = [](float x,float y,float z,void*) 
+    {
+        return std::sqrt(x*x + y*y + z*z); 
     };
 
     auto samplefun_psrdnoise = [](float x,float y,float z,void* userdata) -> float
@@ -52,6 +133,7 @@ void MCubesObject::compute(float scale, float iso, unsigned N, unsigned slice, u
 
     this->setNumVertices(0);
     this->setNumIndices(0);
+    this->setNumSharedVertices(0);
     this->resize( N*N * MAX_POINTS_PER_CUBE    / nslices, 
                   N*N * MAX_TRIANGLES_PER_CUBE / nslices );
 
@@ -59,7 +141,9 @@ void MCubesObject::compute(float scale, float iso, unsigned N, unsigned slice, u
     unsigned total_num_points=0;
     unsigned index=0;
         
-    unsigned zistep=N/nslices, zi0=slice*zistep, ziend=(slice+1)*zistep;
+    // Slabs are cut from the same global z-range for any number of slices, so
+    // concatenating the slices in order always yields the same mesh.
+    unsigned zi0=slice*N/nslices, ziend=(slice+1)*N/nslices;
     for(unsigned zi=zi0; zi < ziend; ++zi)
         for(unsigned yi=0; yi < N; ++yi)
             for(unsigned xi=0; xi < N; ++xi)
@@ -83,7 +167,8 @@ void MCubesObject::compute(float scale, float iso, unsigned N, unsigned slice, u
                     this->getVertexData(index), 
                     this->getNormalData(index), 
                     this->getIndexData(total_num_triangles), index,
-                    num_triangles, num_points, (void*)&pos);
+                    num_triangles, num_points, (void*)&pos,
+                    (unsigned)this->getVertexStride(), (unsigned)this->getNormalStride());
 
                 index += num_points;
                 total_num_triangles += num_triangles;
@@ -94,16 +179,144 @@ void MCubesObject::compute(float scale, float iso, unsigned N, unsigned slice, u
             }
 }
 
+void MCubesObject::computeStitched(float scale, float iso, unsigned N, unsigned slice, unsigned nslices, MCubesSeams* seams)
+{
+    const Lattice lattice{ N, scale, iso, { fPosX,fPosY,fPosZ } };
+    const unsigned M = N+1;
+
+    size_t num_vertices = 0;
+    size_t num_indices = 0;
+    this->setNumVertices(0);
+    this->setNumIndices(0);
+    this->setNumSharedVertices(0);
+    this->numLeadingSharedVertices = 0;
+    this->resize( N*N, N*N );
+
+    const unsigned zi0=slice*N/nslices, ziend=(slice+1)*N/nslices;
+    if(zi0 == ziend)
+        return;
+
+    // Seam s is the plane between slice s and s+1
+    auto seamAt = [&](unsigned k) -> MCubesSeam*
+    {
+        if(seams && k == zi0   && slice > 0)         return &seams->at(slice-1);
+        if(seams && k == ziend && slice+1 < nslices) return &seams->at(slice);
+        return nullptr;
+    };
+
+    auto getPlane = [&](unsigned k, MCubesPlane& storage) -> const MCubesPlane*
+    {
+        if(MCubesSeam* seam = seamAt(k))
+        {
+            std::call_once(seam->computed, [&]() { lattice.computePlane(k, seam->plane); });
+            return &seam->plane;
+        }
+        lattice.computePlane(k, storage);
+        return &storage;
+    };
+
+    auto appendVertex = [&](const float* p, const float* n) -> unsigned
+    {
+        this->ensure(1, 0);
+        std::copy(p, p+3, this->getVertexData(num_vertices));
+        std::copy(n, n+3, this->getNormalData(num_vertices));
+        this->setNumVertices(++num_vertices);
+        return static_cast<unsigned>(num_vertices-1);
+    };
+
+    auto appendPlane = [&](const MCubesPlane& plane) -> unsigned
+    {
+        const unsigned base = static_cast<unsigned>(num_vertices);
+        for(size_t i=0; i < plane.vertices.size()/3; ++i)
+            appendVertex(&plane.vertices[3*i], &plane.normals[3*i]);
+        return base;
+    };
+
+    // Vertices are emitted per lattice plane in global order, so the upper
+    // plane appended last is exactly the head of the next slice.
+    MCubesPlane storage[2];
+    int cur = 0;
+    const MCubesPlane* lower = getPlane(zi0, storage[cur]);
+    unsigned lowerBase = appendPlane(*lower);
+    if(seamAt(zi0))
+        this->numLeadingSharedVertices = lower->vertices.size()/3;
+
+    std::vector<unsigned> zEdges(M*M);
+    for(unsigned k=zi0; k < ziend; ++k)
+    {
+        const MCubesPlane* upper = getPlane(k+1, storage[1-cur]);
+
+        // z-edges between lower and upper plane
+        std::fill(zEdges.begin(), zEdges.end(), NoVertex);
+        for(unsigned j=0; j < M; ++j)
+            for(unsigned i=0; i < M; ++i)
+            {
+                const float f0 = lower->samples[j*M+i];
+                const float f1 = upper->samples[j*M+i];
+                if(lattice.crosses(f0, f1))
+                {
+                    const float p[3] = { lattice.coord(i), lattice.coord(j), 
+                        lattice.coord(k) + MarchingCubes::edgeOffset(f0, f1, iso)*scale };
+                    float n[3];
+                    lattice.normal(p, n);
+                    zEdges[j*M+i] = appendVertex(p, n);
+                }
+            }
+
+        const unsigned upperBase = appendPlane(*upper);
+        if(k+1 == ziend && seamAt(ziend))
+            this->setNumSharedVertices(upper->vertices.size()/3);
+
+        // triangles of all cubes between lower and upper plane
+        for(unsigned j=0; j < N; ++j)
+            for(unsigned i=0; i < N; ++i)
+            {
+                const unsigned a = j*M+i;
+                const unsigned corner[4] = { a, a+1, a+M+1, a+M };
+                const float f[8] = {
+                    lower->samples[corner[0]], lower->samples[corner[1]], lower->samples[corner[2]], lower->samples[corner[3]],
+                    upper->samples[corner[0]], upper->samples[corner[1]], upper->samples[corner[2]], upper->samples[corner[3]] };
+
+                const int* tris = MarchingCubes::edgeTriangles(MarchingCubes::cubeIndex(f, iso));
+                if(tris[0] < 0)
+                    continue;
+
+                const unsigned edgeVertex[12] = {
+                    lowerBase + lower->xEdges[a],   lowerBase + lower->yEdges[a+1],
+                    lowerBase + lower->xEdges[a+M], lowerBase + lower->yEdges[a],
+                    upperBase + upper->xEdges[a],   upperBase + upper->yEdges[a+1],
+                    upperBase + upper->xEdges[a+M], upperBase + upper->yEdges[a],
+                    zEdges[a], zEdges[a+1], zEdges[a+M+1], zEdges[a+M] };
+
+                this->ensure(0, 5);
+                unsigned* indices = this->getIndexData() + num_indices;
+                for(int t=0; tris[t] >= 0; ++t)
+                    *indices++ = edgeVertex[tris[t]];
+                num_indices = indices - this->getIndexData();
+                this->setNumIndices(num_indices);
+            }
+
+        lower = upper;
+        lowerBase = upperBase;
+        cur = 1-cur;
+    }
+}
+
 void MCubesObject::compute(int slice)
 {
-    compute(fScale,fIsovalue,2<<iSizePot,slice,nSlices);
+    numLeadingSharedVertices = 0;
+    if(bStitched)
+        computeStitched(fScale,fIsovalue,2<<iSizePot,slice,nSlices,seams.get());
+    else
+        compute(fScale,fIsovalue,2<<iSizePot,slice,nSlices);
 }
 
-bool MCubesObject::update(float posx, float posy, float posz, float scale, float iso, int pow2, unsigned slice, unsigned nslices)
+bool MCubesObject::update(float posx, float posy, float posz, float scale, float iso, int pow2, unsigned slice, unsigned nslices, bool stitched)
 {
     pow2 = std::max(std::min(pow2,7),1);
-    if(posx != fPosX || posy != fPosY || posz != fPosZ || scale != fScale || iso != fIsovalue || pow2 != iSizePot || nslices != nSlices)
+    if(posx != fPosX || posy != fPosY || posz != fPosZ || scale != fScale || iso != fIsovalue || pow2 != iSizePot || nslices != nSlices || stitched != bStitched)
     {
+        bStitched = stitched;
         fPosX = posx;
         fPosY = posy;
         fPosZ = posz;
@@ -1,21 +1,62 @@
 #pragma once
 
 #include <glutils/MeshBuffer.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// Samples and edge vertices of one z-plane of the marching cubes lattice
+struct MCubesPlane
+{
+    std::vector<float> samples;   ///< (N+1)^2 lattice samples
+    std::vector<unsigned> xEdges; ///< vertex per x-edge, index into vertices or ~0u
+    std::vector<unsigned> yEdges; ///< vertex per y-edge, index into vertices or ~0u
+    std::vector<float> vertices;  ///< edge vertices ordered by (y,x), x-edge before y-edge
+    std::vector<float> normals;
+};
+
+/// Lattice plane between two adjacent stitched slices, computed only once by
+/// whichever of the two slices gets there first.
+struct MCubesSeam
+{
+    std::once_flag computed;
+    MCubesPlane plane;
+};
+
+typedef std::vector<MCubesSeam> MCubesSeams;
 
 struct MCubesObject : public MeshBuffer
 {
+    MCubesObject(MeshVertexLayout layout = MeshVertexLayout::Separate)
+    : MeshBuffer(MeshPrimitiveType::Triangles, MeshVertexAttribute::Normal, layout)
+    {}
+
     float fScale = 1/16.f;
     float fIsovalue = .5f;
     int iSizePot = 5;
     int nSlices = 1;
+    bool bStitched = false;
+
+    float fPosX = 0.f;
+    float fPosY = 0.f;
+    float fPosZ = 0.f;
 
-    float fPosX;
-    float fPosY;
-    float fPosZ;
+    /// Seams shared by all slices in stitched mode, nSlices-1 entries
+    std::shared_ptr<MCubesSeams> seams;
+
+    /// Number of leading vertices which repeat the shared tail of the
+    /// previous slice (its lower seam), they must keep their order.
+    size_t numLeadingSharedVertices = 0;
 
     void compute(float scale, float iso, unsigned N, unsigned slice=0, unsigned nslices=1);
     void compute(int slice=0);
 
-    bool update(float posx, float posy, float posz, float scale, float iso, int pow2, unsigned slice=0, unsigned nslices=1);
+    /// Stitched variant of compute(): cubes tile a regular lattice with edge
+    /// length scale and share their edge vertices, also across slices via
+    /// seams. The vertices of the upper seam are appended last and marked as
+    /// shared, so merging all slices in order gives a watertight mesh.
+    void computeStitched(float scale, float iso, unsigned N, unsigned slice=0, unsigned nslices=1, MCubesSeams* seams=nullptr);
+
+    bool update(float posx, float posy, float posz, float scale, float iso, int pow2, unsigned slice=0, unsigned nslices=1, bool stitched=false);
     bool create();
 };
@@ -1,5 +1,13 @@
 #include "MCubesObjectRenderer.h"
+#include <glutils/MeshCache.h>
+#include <glutils/MeshWeld.h>
 #include <utils/ComputeThreads.h>
+#include <utils/ParallelFor.h>
+#include <algorithm>
+#include <cstring> // memcpy
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
 
 #define MCUBES_PARALLEL // Comment out to disable parallel compute (for debugging purposes)
 //#define MCUBES_PARALLEL_INSTANT_UPDATE // Uncomment to trigger instant update for each slice (will lead to flicker)
@@ -10,17 +18,28 @@ std::mutex g_mutex_set_dirty;
 
 void MCubesObjectRenderer::clear()
 {
+    if(cacheWriter.joinable())
+        cacheWriter.join();
     if(computeThreadsPtr)
     {
         delete computeThreadsPtr;
         computeThreadsPtr = nullptr;
     }
     objects.clear();
+    snapshots.clear();
+    retired.clear();
     glmesh.clear();
+    statsBefore.clear();
+    statsAfter.clear();
+    publishedBefore = publishedAfter = MeshCacheStats();
+    publishedSimplify = MeshSimplifyStats();
+    sliceSimplifyStats.clear();
+    lodChains.clear();
+    streamRegions.clear();
     numObjects = 0;
 }
 
-bool MCubesObjectRenderer::create(unsigned nslices)
+bool MCubesObjectRenderer::create(unsigned nslices, MeshVertexLayout layout, const MeshVertexFormat& format)
 {
     clear();
 
@@ -30,15 +49,26 @@ bool MCubesObjectRenderer::create(unsigned nslices)
     if(ok)
     {
         objects.resize(nslices);
+        snapshots.resize(nslices);
+        retired.resize(nslices);
         for(unsigned i=0; i < numObjects; ++i)
         {
-            objects[i] = std::make_shared<MCubesObject>();
+            objects[i] = std::make_shared<MCubesObject>(layout);
+            snapshots[i] = freeze(*objects[i]);
         }
+        statsBefore.resize(nslices);
+        statsAfter.resize(nslices);
+        sliceSimplifyStats.resize(nslices);
+        lodChains.resize(nslices);
+        streamRegions.resize(nslices);
 
         glmesh.resize(nslices);
+        streamingApplied = streamingUploads;
         for(unsigned i=0; i < numObjects; ++i)
         {
-            glmesh[i].setMeshBuffer(objects[i]);
+            glmesh[i].setMeshBuffer(snapshots[i]);
+            glmesh[i].setVertexFormat(format);
+            glmesh[i].setStreaming(streamingApplied);
             if(!glmesh[i].prepare())
             {
                 ok = false;
@@ -53,6 +83,7 @@ bool MCubesObjectRenderer::create(unsigned nslices)
             [this](int i)
         {
             objects[i]->compute(i);
+            finishSlice(i);
 
   #ifdef MCUBES_PARALLEL_INSTANT_UPDATE
             // Trigger instant update for each slice (will lead to flicker)
@@ -67,7 +98,129 @@ bool MCubesObjectRenderer::create(unsigned nslices)
     return ok;
 }
 
-void MCubesObjectRenderer::update(float x,float y,float z,float scale,float iso,int pot)
+namespace {
+
+/// Increment when the generated meshes change for the same parameters
+constexpr uint32_t CacheVersion = 2;
+
+constexpr const char* CacheExtension = ".gtmc";
+
+/// FNV-1a over the parameters that determine the mesh
+uint64_t parameterHash(std::initializer_list<float> values, std::initializer_list<uint32_t> ints)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    auto hashWord = [&h](uint32_t w) { h = (h ^ w) * 0x100000001b3ull; };
+    for (float f : values)
+    {
+        uint32_t w;
+        std::memcpy(&w, &f, sizeof(w));
+        hashWord(w);
+    }
+    for (uint32_t i : ints)
+        hashWord(i);
+    return h;
+}
+
+/// Removes the least recently written or loaded cache files until the
+/// others fit into maxBytes. A latest file larger than maxBytes on its own
+/// is removed instead, rather than everything else.
+void evictCacheFiles(const std::filesystem::path& directory, uint64_t maxBytes, const std::filesystem::path& latest)
+{
+    namespace fs = std::filesystem;
+    struct Entry
+    {
+        fs::file_time_type time;
+        uint64_t size;
+        fs::path path;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+    {
+        if (it->path().extension() != CacheExtension)
+            continue;
+        std::error_code ecEntry;
+        const uint64_t size = it->file_size(ecEntry);
+        const fs::file_time_type time = it->last_write_time(ecEntry);
+        if (ecEntry)
+            continue;
+        if (size > maxBytes && it->path() == latest)
+        {
+            fs::remove(it->path(), ecEntry);
+            continue;
+        }
+        entries.push_back({ time, size, it->path() });
+        total += size;
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+    for (const Entry& entry : entries)
+    {
+        if (total <= maxBytes)
+            break;
+        if (fs::remove(entry.path, ec))
+            total -= entry.size;
+    }
+}
+
+} // namespace
+
+std::string MCubesObjectRenderer::cacheFilename(uint64_t key) const
+{
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << CacheExtension;
+    return (std::filesystem::path(cacheDirectory) / name.str()).string();
+}
+
+bool MCubesObjectRenderer::loadCache(uint64_t key)
+{
+    std::vector<MeshBuffer*> parts;
+    for (auto& ptr : objects)
+        parts.push_back(ptr.get());
+    const std::string filename = cacheFilename(key);
+    if (!readMeshCache(filename, parts, key))
+        return false;
+    // Recently used for the eviction
+    std::error_code ec;
+    std::filesystem::last_write_time(filename, std::filesystem::file_time_type::clock::now(), ec);
+
+    // Levels of detail are not cached
+    lodLaunched = lodLevels;
+    clustersLaunched = clusters;
+    budgetLaunched = memoryBudget;
+    parallelFor(numObjects, 0, [this](size_t i) { buildLevels(unsigned(i)); });
+    for (unsigned i = 0; i < numObjects; ++i)
+        uploadSlice(i);
+    publishStats();
+    return true;
+}
+
+void MCubesObjectRenderer::storeCache(uint64_t key)
+{
+    // Writing takes long for large meshes, the frame loop does not wait
+    if (cacheWriting.load())
+        return;
+    if (cacheWriter.joinable())
+        cacheWriter.join();
+
+    // The snapshots are immutable, the writer shares them
+    cacheWriting = true;
+    cacheWriter = std::thread([this, parts = snapshots, filename = cacheFilename(key), key,
+                               directory = cacheDirectory, compress = cacheCompressed, maxBytes = cacheMaxBytes]()
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        std::vector<const MeshBuffer*> ptrs;
+        for (const auto& ptr : parts)
+            ptrs.push_back(ptr.get());
+        writeMeshCache(filename, ptrs, key, compress);
+        if (maxBytes > 0)
+            evictCacheFiles(directory, maxBytes, filename);
+        cacheWriting = false;
+    });
+}
+
+void MCubesObjectRenderer::update(float x,float y,float z,float scale,float iso,int pot,bool stitched)
 {
     static bool compute_launched = false;
     isComputing = computeThreadsPtr ? computeThreadsPtr->numDirty()>0 : false;
@@ -78,41 +231,317 @@ void MCubesObjectRenderer::update(float x,float y,float z,float scale,float iso,
     if(compute_launched && !isComputing)
     {
         // update all slices at once
+        for(unsigned i=0; i < numObjects; ++i)
+            uploadSlice(i);
+        publishStats();
+        compute_launched = false;
+
+        if (pendingCacheKey)
+            storeCache(pendingCacheKey);
+        pendingCacheKey = 0;
+        finishStream();
+    }
+    trimToBudget();
+
+    if(streamingApplied != streamingUploads)
+    {
+        // Reallocates the GL buffers, so only while no region is written
+        streamingApplied = streamingUploads;
         for(unsigned i=0; i < numObjects; ++i)
         {
-            glmesh[i].setDirty();
+            glmesh[i].setStreaming(streamingApplied);
             glmesh[i].prepare();
         }
-        compute_launched = false;
     }
 
     bool recompute_needed = false;
     for(unsigned i=0; i < numObjects; ++i)
-        recompute_needed |= objects[i]->update(x,y,z,scale,iso,pot,i,numObjects);
+        recompute_needed |= objects[i]->update(x,y,z,scale,iso,pot,i,numObjects,stitched);
+    recompute_needed |= streamWriter && !streamLaunched;
+    recompute_needed |= recomputeRequested;
 
     if(recompute_needed)
     {
+        const bool cacheable = !cacheDirectory.empty() && pot >= cacheMinPot && !streamWriter;
+        const uint64_t key = cacheable ? parameterHash({ x, y, z, scale, iso, simplifyRatio }, { CacheVersion, uint32_t(pot), uint32_t(stitched), numObjects, uint32_t(optimizeMeshes) }) : 0;
+        recomputeRequested = false;
+        std::fill(statsBefore.begin(), statsBefore.end(), MeshCacheStats());
+        std::fill(statsAfter.begin(), statsAfter.end(), MeshCacheStats());
+        std::fill(sliceSimplifyStats.begin(), sliceSimplifyStats.end(), MeshSimplifyStats());
+        if(cacheable && loadCache(key))
+            return;
+        pendingCacheKey = key;
+        streamLaunched = streamWriter != nullptr;
+        optimizeLaunched = optimizeMeshes;
+        simplifyLaunched = simplifyRatio;
+        lodLaunched = lodLevels;
+        clustersLaunched = clusters;
+        budgetLaunched = memoryBudget;
+
+        // Fresh seams for each run, they are computed once by either adjacent slice
+        auto seams = stitched ? std::make_shared<MCubesSeams>(numObjects-1) : nullptr;
+        for(unsigned i=0; i < numObjects; ++i)
+            objects[i]->seams = seams;
+
 #ifdef MCUBES_PARALLEL
+        // The finest level is written into the GL buffers by the compute
+        // threads, the GPU may still read the regions of earlier meshes
+        for(unsigned i=0; i < numObjects; ++i)
+            streamRegions[i] = glmesh[i].level(0).beginWrite();
   #ifdef MCUBES_PARALLEL_INSTANT_UPDATE
         if(computeThreadsPtr->numDirty()==0)
   #endif
             computeThreadsPtr->launchAll();
         compute_launched = true;
+        // Until completion the compute threads own the builders and retired
+        // snapshots, e.g. computeMemory() must not walk them
+        isComputing = true;
 #else
         for(unsigned i=0; i < numObjects; ++i)
         {
             objects[i]->compute(i);
-            glmesh[i].setDirty();
-            glmesh[i].prepare();
+            finishSlice(i);
+            uploadSlice(i);
         }
+        publishStats();
+        if (pendingCacheKey)
+            storeCache(pendingCacheKey);
+        pendingCacheKey = 0;
+        finishStream();
 #endif
     }
 }
 
-void MCubesObjectRenderer::draw(int i)
+void MCubesObjectRenderer::finishSlice(unsigned i)
+{
+    MCubesObject& object = *objects[i];
+    if (!object.bStitched)
+    {
+        // Unstitched cubes repeat their edge vertices, as triangle soup every
+        // edge is open and simplification locks all vertices. Always, so that
+        // cached slices can get levels of detail too.
+        weldVertices(object, 0.f, false, 1);
+    }
+    if (simplifyLaunched < 1.f)
+    {
+        // One slice per compute thread already
+        MeshSimplifyOptions options;
+        options.targetTriangles = static_cast<size_t>(simplifyLaunched * (object.numIndices() / 3));
+        options.numFixedLeading = object.numLeadingSharedVertices;
+        options.numThreads = 1;
+        options.numPartitions = 1;
+        sliceSimplifyStats[i] = simplifyMesh(object, options);
+    }
+    if (optimizeLaunched)
+    {
+        statsBefore[i] = analyzeVertexCache(object);
+        optimizeVertexCache(object);
+        optimizeVertexFetch(object, object.numLeadingSharedVertices);
+        statsAfter[i] = analyzeVertexCache(object);
+    }
+    buildLevels(i);
+    if (streamRegions[i].valid())
+        streamRegions[i].write(*lodChains[i][0].mesh);
+    if (streamWriter)
+        streamWriter->append(i, *lodChains[i][0].mesh);
+}
+
+void MCubesObjectRenderer::buildLevels(unsigned i)
+{
+    // Clusters reorder the triangles, so level 0 gets them before it is frozen
+    MCubesObject& object = *objects[i];
+    std::vector<MeshCluster> baseClusters;
+    if (clustersLaunched)
+        baseClusters = buildClusters(object);
+    // Over budget the snapshot gets the storage it needs rather than the
+    // estimate the slice was computed in, which can be many times larger
+    if (budgetLaunched > 0 && meshMemoryAllocated() > budgetLaunched && !object.getVertexArena().isExternal())
+        object.reserveExact(object.numVertices(), object.numIndices() / 3);
+    MeshSnapshot base = freeze(object, std::move(retired[i]));
+
+    // One slice per thread already, vertex order within coarse levels is free
+    MeshSimplifyOptions options;
+    options.numThreads = 1;
+    options.numPartitions = 1;
+    lodChains[i] = buildLODChain(base, lodLaunched, .5f, options, [this](MeshBuffer& mesh, MeshLOD& level)
+    {
+        if (optimizeLaunched)
+        {
+            optimizeVertexCache(mesh);
+            optimizeVertexFetch(mesh);
+        }
+        if (clustersLaunched)
+            level.clusters = buildClusters(mesh);
+    });
+    lodChains[i][0].clusters = std::move(baseClusters);
+}
+
+void MCubesObjectRenderer::uploadSlice(unsigned i)
+{
+    if (lodChains[i].empty())
+    {
+        glmesh[i].setDirty();
+    }
+    else
+    {
+        // The previous snapshot is released by the GL mesh below, so its
+        // storage can go back to the compute thread unless it is shared
+        retired[i] = std::move(snapshots[i]);
+        snapshots[i] = lodChains[i][0].mesh;
+        glmesh[i].setLevels(std::move(lodChains[i]));
+    }
+    // Drawn without copying if written from this snapshot by finishSlice()
+    glmesh[i].level(0).endWrite(streamRegions[i]);
+    streamRegions[i] = GLMeshStreamRegion();
+    lodChains[i].clear();
+    glmesh[i].prepare();
+    ++generation;
+}
+
+void MCubesObjectRenderer::trimToBudget()
+{
+    if (memoryBudget == 0 || meshMemoryAllocated() <= memoryBudget)
+        return;
+    // Replaced slices are only kept to be reused, the compute buffers are
+    // empty between computations
+    for (MeshSnapshot& snapshot : retired)
+        snapshot.reset();
+    std::vector<MeshBuffer*> idle;
+    for (auto& ptr : objects)
+        idle.push_back(ptr.get());
+    enforceMemoryBudget(idle, memoryBudget);
+}
+
+bool MCubesObjectRenderer::isStreamingUploads() const
+{
+    return numObjects > 0 && glmesh[0].level(0).isStreaming();
+}
+
+MeshMemoryStats MCubesObjectRenderer::computeMemory() const
+{
+    MeshMemoryStats stats;
+    if (isComputing)
+        return stats;
+    for (const auto& ptr : objects)
+        stats += memoryStats(*ptr);
+    for (const MeshSnapshot& snapshot : retired)
+    {
+        if (snapshot)
+            stats += memoryStats(*snapshot);
+    }
+    return stats;
+}
+
+MeshMemoryStats MCubesObjectRenderer::sliceMemory() const
+{
+    MeshMemoryStats stats;
+    for (const GLMeshLOD& mesh : glmesh)
+    {
+        for (unsigned level = 0; level < mesh.numLevels(); ++level)
+        {
+            if (mesh.getLevel(level).mesh)
+                stats += memoryStats(*mesh.getLevel(level).mesh);
+        }
+    }
+    return stats;
+}
+
+void MCubesObjectRenderer::setOptimizeMeshes(bool enable)
+{
+    if (enable != optimizeMeshes)
+        recomputeRequested = true;
+    optimizeMeshes = enable;
+}
+
+void MCubesObjectRenderer::setSimplifyRatio(float ratio)
+{
+    ratio = std::clamp(ratio, 0.f, 1.f);
+    if (ratio != simplifyRatio)
+        recomputeRequested = true;
+    simplifyRatio = ratio;
+}
+
+void MCubesObjectRenderer::setLODLevels(unsigned n)
+{
+    n = std::max(n, 1u);
+    if (n != lodLevels)
+        recomputeRequested = true;
+    lodLevels = n;
+}
+
+void MCubesObjectRenderer::setClusters(bool enable)
+{
+    if (enable != clusters)
+        recomputeRequested = true;
+    clusters = enable;
+}
+
+MeshSimplifyStats MCubesObjectRenderer::simplifyStats() const
+{
+    return publishedSimplify;
+}
+
+MeshCacheStats MCubesObjectRenderer::cacheStats(bool optimized) const
+{
+    return optimized ? publishedAfter : publishedBefore;
+}
+
+void MCubesObjectRenderer::publishStats()
+{
+    // The compute threads are done with the slices, the UI reads these only
+    publishedBefore = publishedAfter = MeshCacheStats();
+    publishedSimplify = MeshSimplifyStats();
+    for (unsigned i = 0; i < numObjects; ++i)
+    {
+        publishedBefore += statsBefore[i];
+        publishedAfter += statsAfter[i];
+        const MeshSimplifyStats& s = sliceSimplifyStats[i];
+        publishedSimplify.numTrianglesBefore += s.numTrianglesBefore;
+        publishedSimplify.numTrianglesAfter  += s.numTrianglesAfter;
+        publishedSimplify.numVerticesBefore  += s.numVerticesBefore;
+        publishedSimplify.numVerticesAfter   += s.numVerticesAfter;
+        publishedSimplify.error = std::max(publishedSimplify.error, s.error);
+    }
+}
+
+bool MCubesObjectRenderer::streamExport(const std::string& filename)
+{
+    const bool computing = computeThreadsPtr && computeThreadsPtr->numDirty() > 0;
+    if (streamWriter || numObjects == 0 || computing)
+        return false;
+
+    auto writer = std::make_unique<MeshStreamWriter>();
+    if (!writer->open(filename, objects[0]->getAttributes()))
+    {
+        streamStatus = "Cannot write " + filename;
+        return false;
+    }
+    // Picked up by the next update(), the compute threads are idle until then
+    streamWriter = std::move(writer);
+    streamLaunched = false;
+    streamStatus = "Streaming " + filename + "...";
+    return true;
+}
+
+void MCubesObjectRenderer::finishStream()
+{
+    if (!streamWriter || !streamLaunched)
+        return;
+
+    std::ostringstream status;
+    if (streamWriter->close())
+        status << "Streamed " << streamWriter->numVertices() << " vertices, " << streamWriter->numPrimitives() << " triangles";
+    else
+        status << "Streaming failed";
+    streamStatus = status.str();
+    streamWriter.reset();
+    streamLaunched = false;
+}
+
+void MCubesObjectRenderer::draw(int i, unsigned level)
 {
     if(i>=0 && i<(int)numObjects)
-        glmesh[i].draw();
+        glmesh[i].draw(level);
 }
 
 void MCubesObjectRenderer::draw()
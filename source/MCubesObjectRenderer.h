@@ -1,10 +1,18 @@
 #pragma once
 
 #include "MCubesObject.h"
-#include <glutils/GLMeshObject.h>
+#include <glutils/GLMeshLOD.h>
 #include <glutils/GLError.h>
+#include <glutils/MeshBufferIO.h> // MeshStreamWriter
+#include <glutils/MeshMemory.h>
+#include <glutils/MeshOptimizer.h>
+#include <glutils/MeshSimplify.h>
+#include <glutils/MeshSnapshot.h>
+#include <atomic>
 #include <vector>
 #include <mutex>
+#include <string>
+#include <thread>
 
 class ComputeThreads;
 
@@ -18,16 +26,139 @@ struct MCubesObjectRenderer
 
     void clear();
 
-    bool create(unsigned nslices=4);
+    bool create(unsigned nslices=4, MeshVertexLayout layout=MeshVertexLayout::Separate, const MeshVertexFormat& format=MeshVertexFormat());
 
-    void update(float x,float y,float z,float scale,float iso,int pot);
+    void update(float x,float y,float z,float scale,float iso,int pot,bool stitched=false);
 
-    void draw(int i);
+    void draw(int i, unsigned level=0);
     void draw();
+
+    /// Directory for cached meshes, empty to disable caching (default). Meshes
+    /// with a resolution of at least cacheMinPot are stored after computation
+    /// on a background thread and reloaded instead of recomputed, keyed by a
+    /// hash of the parameters. A store is skipped while the previous one is
+    /// still written. Above cacheMaxBytes the least recently used files are
+    /// removed, 0 for no limit.
+    std::string cacheDirectory;
+    int cacheMinPot = 6;
+    bool cacheCompressed = false; ///< store with compressMesh(), lossy
+    uint64_t cacheMaxBytes = uint64_t(2) << 30;
+
+    /// Reorder triangles and vertices of each slice for the GPU vertex cache
+    /// after computation, in the compute threads. Triggers a recompute.
+    void setOptimizeMeshes(bool enable);
+    bool isOptimizingMeshes() const { return optimizeMeshes; }
+
+    /// Vertex cache statistics of all slices of the last completed
+    /// computation, before and after optimization. Empty for meshes loaded
+    /// from the cache.
+    MeshCacheStats cacheStats(bool optimized) const;
+
+    /// Decimate each slice to the given fraction of its triangles after
+    /// computation, before optimization, 1 to keep all. Seams stay intact.
+    /// Triggers a recompute.
+    void setSimplifyRatio(float ratio);
+    float getSimplifyRatio() const { return simplifyRatio; }
+
+    /// Summed statistics of all slices of the last completed computation,
+    /// empty for meshes loaded from the cache
+    MeshSimplifyStats simplifyStats() const;
+
+    /// Number of levels of detail per slice, each further level halves the
+    /// triangles by decimation. Seams stay intact, so slices at different
+    /// levels fit together. Needs shared vertices, unstitched slices are
+    /// welded after computation, so also when loaded from the cache.
+    /// Triggers a recompute, see GLMeshLOD::selectLevel().
+    void setLODLevels(unsigned n);
+    unsigned getLODLevels() const { return lodLevels; }
+
+    /// Split each level into clusters with culling bounds, see buildClusters()
+    /// and GLMeshLOD::draw(). Reorders the triangles, triggers a recompute.
+    void setClusters(bool enable);
+    bool hasClusters() const { return clusters; }
+
+    /// Bytes of mesh storage, see meshMemoryAllocated(), above which the idle
+    /// compute buffers are trimmed and replaced slices are released instead
+    /// of reused. Slices computed over budget are compacted before they are
+    /// handed over. 0 for no limit.
+    void setMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+    size_t getMemoryBudget() const { return memoryBudget; }
+
+    /// Storage of the compute buffers, including replaced slices kept for
+    /// reuse. Empty while isComputing, the compute threads reallocate them.
+    MeshMemoryStats computeMemory() const;
+    /// Storage of the finished slices, all levels of detail
+    MeshMemoryStats sliceMemory() const;
+
+    /// Upload the finest level of each slice through persistently mapped
+    /// buffers, written by the compute threads, so the GL thread only fences
+    /// and draws. Applied between computations, falls back to regular
+    /// uploads without GL 4.4 or ARB_buffer_storage, see GLMeshObject::setStreaming().
+    void setStreamingUploads(bool enable) { streamingUploads = enable; }
+    bool getStreamingUploads() const { return streamingUploads; }
+    /// True if the slices are actually uploaded by streaming
+    bool isStreamingUploads() const;
+
+    /// Recomputes all slices with the current parameters and streams them
+    /// into a .ply or .stl file as they finish, see MeshStreamWriter.
+    bool streamExport(const std::string& filename);
+    bool isStreaming() const { return streamWriter != nullptr; }
+    std::string streamStatus; ///< result of the last streamExport()
     
+    /// Mutable meshes of the compute threads, emptied when a slice is finished
     std::vector<std::shared_ptr<MCubesObject>> objects;
-    std::vector<GLMeshObject> glmesh;
+    /// Finished meshes of all slices, replaced together after a computation.
+    /// Immutable, so they can be shared with other threads, e.g. an exporter.
+    std::vector<MeshSnapshot> snapshots;
+    std::vector<GLMeshLOD> glmesh;
     unsigned numObjects=0;
     ComputeThreads* computeThreadsPtr = nullptr;
     bool isComputing = false;
+    unsigned generation = 0; ///< incremented on each new snapshot of a slice, e.g. to rebuild derived data
+
+private:
+    bool loadCache(uint64_t key);
+    void storeCache(uint64_t key);
+    std::string cacheFilename(uint64_t key) const;
+
+    uint64_t pendingCacheKey = 0; ///< store after the running compute, 0 for none
+    std::thread cacheWriter;
+    std::atomic<bool> cacheWriting = false;
+
+    void finishStream();
+    void finishSlice(unsigned i);
+    void buildLevels(unsigned i);
+    void uploadSlice(unsigned i);
+    void trimToBudget();
+    void publishStats();
+
+    bool optimizeMeshes = false;
+    bool recomputeRequested = false;
+    bool optimizeLaunched = false; ///< optimizeMeshes of the running computation
+    std::vector<MeshCacheStats> statsBefore; ///< per slice, written by the compute threads
+    std::vector<MeshCacheStats> statsAfter;
+    MeshCacheStats publishedBefore; ///< sums of the last completed computation
+    MeshCacheStats publishedAfter;
+
+    float simplifyRatio = 1.f;
+    float simplifyLaunched = 1.f; ///< simplifyRatio of the running computation
+    std::vector<MeshSimplifyStats> sliceSimplifyStats; ///< written by the compute threads
+    MeshSimplifyStats publishedSimplify;
+
+    unsigned lodLevels = 1;
+    unsigned lodLaunched = 1; ///< lodLevels of the running computation
+    bool clusters = false;
+    bool clustersLaunched = false; ///< clusters of the running computation
+    std::vector<std::vector<MeshLOD>> lodChains; ///< built by the compute threads, uploaded by update()
+    std::vector<MeshSnapshot> retired; ///< previous snapshots, their storage is reused by freeze()
+
+    size_t memoryBudget = 0;
+    size_t budgetLaunched = 0; ///< memoryBudget of the running computation
+
+    bool streamingUploads = false;
+    bool streamingApplied = false; ///< streamingUploads set on the GL meshes
+    std::vector<GLMeshStreamRegion> streamRegions; ///< written by the compute threads
+
+    std::unique_ptr<MeshStreamWriter> streamWriter;
+    bool streamLaunched = false;
 };
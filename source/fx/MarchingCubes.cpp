@@ -335,7 +335,8 @@ void normalize( float* v )
 void triangulate( float x, float y, float z, 
                   SampleFunc sample, GradientFunc gradient, float isovalue, float scale,
                   float* points, float* normals, unsigned* indices, unsigned start_index,
-                  unsigned& num_triangles, unsigned& num_points, void* userdata )
+                  unsigned& num_triangles, unsigned& num_points, void* userdata,
+                  unsigned point_stride, unsigned normal_stride )
 {
 //    float points [12*3];
 //    float normals[12*3];
@@ -376,7 +377,7 @@ void triangulate( float x, float y, float z,
         
         float ofs = get_offset( f[v0], f[v1], isovalue );
 
-        float* p = &points[num_points*3];
+        float* p = &points[num_points*point_stride];
         p[0] = x + (cube_verts[v0][0] + ofs * cube_edge_dir[i][0]) * scale;
         p[1] = y + (cube_verts[v0][1] + ofs * cube_edge_dir[i][1]) * scale;
         p[2] = z + (cube_verts[v0][2] + ofs * cube_edge_dir[i][2]) * scale;
@@ -385,7 +386,7 @@ void triangulate( float x, float y, float z,
         {
             if(gradient)
             {
-                float* normal = &normals[num_points*3];
+                float* normal = &normals[num_points*normal_stride];
                 gradient(p[0], p[1], p[2], normal[0], normal[1], normal[2], userdata);
                 normalize( normal );
                 normal[0] *= -1;
@@ -396,7 +397,7 @@ void triangulate( float x, float y, float z,
             {
                 // central differences
                 const float delta = 0.001f;
-                float* normal = &normals[num_points*3];
+                float* normal = &normals[num_points*normal_stride];
                 normal[0] = sample(p[0]-delta, p[1], p[2], userdata) - sample(p[0]+delta, p[1], p[2], userdata);
                 normal[1] = sample(p[0], p[1]-delta, p[2], userdata) - sample(p[0], p[1]+delta, p[2], userdata),
                 normal[2] = sample(p[0], p[1], p[2]-delta, userdata) - sample(p[0], p[1], p[2]+delta, userdata);
@@ -421,4 +422,22 @@ void triangulate( float x, float y, float z,
     }
 }
 
+int cubeIndex( const float f[8], float isovalue )
+{
+    int index = 0;
+    for( int i=0; i < 8; i++ )
+        if( f[i] < isovalue ) index |= 1<<i;
+    return index;
+}
+
+const int* edgeTriangles( int cube_index )
+{
+    return tri_tab[ cube_index ];
+}
+
+float edgeOffset( float val1, float val2, float isovalue )
+{
+    return get_offset( val1, val2, isovalue );
+}
+
 } // namespace
@@ -9,9 +9,27 @@ typedef void (*GradientFunc)( float x, float y, float z, float& grad_x, float& g
 /// Triangulate isosurface inside a cube of a density function via the 
 /// marching cubes algorithm, with cube edge length \a scale.
 /// Buffers are pre-allocated for storage of up to 5 triangles and 12 points.
-/// Normal pointer is optional.
+/// Normal pointer is optional. Points and normals are written with the given
+/// strides (in floats) to support interleaved vertex buffers.
 void triangulate( float x, float y, float z, 
                   SampleFunc sample, GradientFunc gradient, float isovalue,float scale,
                   float* points, float* normals, unsigned* indices, unsigned start_index,
-                  unsigned& num_triangles, unsigned& num_points, void* userdata=nullptr );
+                  unsigned& num_triangles, unsigned& num_points, void* userdata=nullptr,
+                  unsigned point_stride=3, unsigned normal_stride=3 );
+
+// Table access for meshers that share edge vertices between cubes.
+// Cube corners and edges are numbered as in Paul Bourke's tables: corners
+// 0-3 are (0,0,0),(1,0,0),(1,1,0),(0,1,0) and 4-7 the same at z=1; edges 0-3
+// connect corners 0-1,1-2,2-3,3-0, edges 4-7 the same at z=1 and edges 8-11
+// connect corner i to i+4.
+
+/// Cube configuration index for the 8 corner samples.
+int cubeIndex( const float f[8], float isovalue );
+
+/// Triangles of a cube configuration as triples of cube edge indices, 
+/// terminated by -1 (up to 5 triangles).
+const int* edgeTriangles( int cube_index );
+
+/// Relative position in [0,1] of the isovalue crossing between two samples.
+float edgeOffset( float val1, float val2, float isovalue );
 }
@@ -38,6 +38,18 @@ int Frustum::clip_aabb( float aabb_min[3], float aabb_max[3] ) const
     return 1;
 }
 
+int Frustum::clip_sphere( const float center[3], float radius ) const
+{
+    int result = 0;
+    for( int i=0; i < 6; i++ )
+    {
+        float d = distance( planes[i], center );
+        if( d < -radius ) return -1;
+        if( d < radius ) result = 1;
+    }
+    return result;
+}
+
 void Frustum::normalize_plane( float p[4] )
 {
     float mag = (float)sqrt(p[0]*p[0] + p[1]*p[1] + p[2]*p[2] );
@@ -19,6 +19,13 @@ public:
     ///    1  if intersecting
     int clip_aabb( float aabb_min[3], float aabb_max[3] ) const;
 
+    /// Test if sphere is inside frustum, requires normalized planes
+    /// Returns
+    ///   -1  if outside
+    ///    0  if inside
+    ///    1  if intersecting
+    int clip_sphere( const float center[3], float radius ) const;
+
 private:
     // 6-sided viewing frustum
     // a plane is represented by the equation
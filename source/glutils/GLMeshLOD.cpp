@@ -0,0 +1,77 @@
+#include "GLMeshLOD.h"
+
+bool GLMeshLOD::prepare()
+{
+    bool ok = true;
+    for (GLMeshObject& glmesh : m_glmesh)
+        ok = glmesh.prepare() && ok;
+    return ok;
+}
+
+void GLMeshLOD::draw(unsigned level) const
+{
+    if (level < m_glmesh.size())
+        m_glmesh[level].draw();
+}
+
+size_t GLMeshLOD::draw(unsigned level, const Frustum& frustum, const float* eye) const
+{
+    if (level >= m_glmesh.size())
+        return 0;
+    const MeshLOD& lod = m_levels[level];
+    if (lod.clusters.empty())
+    {
+        m_glmesh[level].draw();
+        return lod.mesh->numIndices();
+    }
+    const size_t numIndices = cullClusters(lod.clusters, frustum, eye, m_ranges);
+    m_glmesh[level].draw(m_ranges);
+    return numIndices;
+}
+
+void GLMeshLOD::setMeshBuffer( std::shared_ptr<const MeshBuffer> pbuf )
+{
+    setLevels({ MeshLOD{ pbuf, 0.f, {} } });
+}
+
+void GLMeshLOD::setLevels( std::vector<MeshLOD> levels )
+{
+    m_levels = std::move(levels);
+    // Keep the GL objects of remaining levels, buffers are reallocated on demand
+    m_glmesh.resize(m_levels.size());
+    for (size_t i = 0; i < m_levels.size(); ++i)
+    {
+        m_glmesh[i].setMeshBuffer(m_levels[i].mesh);
+        m_glmesh[i].setVertexFormat(m_format);
+    }
+    if (!m_glmesh.empty())
+        m_glmesh[0].setStreaming(m_streaming);
+    setDirty();
+}
+
+void GLMeshLOD::setDirty()
+{
+    for (GLMeshObject& glmesh : m_glmesh)
+        glmesh.setDirty();
+    if (!m_levels.empty())
+        boundingSphere(*m_levels[0].mesh, m_center, m_radius);
+}
+
+void GLMeshLOD::setVertexFormat( const MeshVertexFormat& format )
+{
+    m_format = format;
+    for (GLMeshObject& glmesh : m_glmesh)
+        glmesh.setVertexFormat(format);
+}
+
+void GLMeshLOD::setStreaming( bool enable )
+{
+    m_streaming = enable;
+    if (!m_glmesh.empty())
+        m_glmesh[0].setStreaming(enable);
+}
+
+unsigned GLMeshLOD::selectLevel( const float modelview[16], const float projection[16], float viewportHeight ) const
+{
+    return selectLOD(m_levels, m_center, m_radius, modelview, projection, viewportHeight, maxPixelError);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "GLMeshObject.h"
+#include "MeshLOD.h"
+
+/// GLMeshObject per level of detail of a mesh. With a single level set by
+/// setMeshBuffer() it behaves like a plain GLMeshObject.
+class GLMeshLOD
+{
+public:
+    bool prepare();
+    void draw(unsigned level=0) const;
+    /// Draws the clusters of the level inside the frustum, facing the eye
+    /// unless eye is null, see cullClusters(). Levels without clusters are
+    /// drawn whole. Returns the number of indices drawn.
+    size_t draw(unsigned level, const Frustum& frustum, const float* eye) const;
+
+    void setMeshBuffer( std::shared_ptr<const MeshBuffer> pbuf );
+    /// Finest level first, see buildLODChain()
+    void setLevels( std::vector<MeshLOD> levels );
+    /// Updates the bounds, call after changing the mesh buffers
+    void setDirty();
+
+    void setVertexFormat( const MeshVertexFormat& format );
+
+    /// Streaming uploads of the finest level, the coarser ones are small,
+    /// see GLMeshObject::setStreaming()
+    void setStreaming( bool enable );
+
+    size_t numLevels() const { return m_levels.size(); }
+    const MeshLOD& getLevel( unsigned level ) const { return m_levels[level]; }
+    /// Uploaded level, e.g. for its position dequantization
+    const GLMeshObject& level( unsigned level ) const { return m_glmesh[level]; }
+          GLMeshObject& level( unsigned level )       { return m_glmesh[level]; }
+
+    /// Coarsest level with a projected error of at most maxPixelError, see selectLOD()
+    unsigned selectLevel( const float modelview[16], const float projection[16], float viewportHeight ) const;
+    float maxPixelError = 1.f;
+
+private:
+    std::vector<MeshLOD> m_levels;
+    std::vector<GLMeshObject> m_glmesh;
+    MeshVertexFormat m_format;
+    bool m_streaming = false;
+    mutable std::vector<MeshIndexRange> m_ranges; ///< scratch of draw()
+    float m_center[3] = { 0, 0, 0 };
+    float m_radius = 0.f;
+};
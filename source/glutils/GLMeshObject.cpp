@@ -1,6 +1,75 @@
 #include "GLMeshObject.h"
 #include "GLError.h"
 #include <algorithm>
+#include <cstring> // memcpy
+
+namespace {
+
+/// Extra capacity of each streaming region, so similar meshes fit without reallocating the ring
+constexpr size_t StreamHeadroomDivisor = 4;
+/// Buffers are reallocated for meshes below this fraction of the allocation
+constexpr size_t ShrinkDivisor = 4;
+/// Per wait for a region the GPU still reads, in nanoseconds
+constexpr GLuint64 StreamFenceTimeout = 1000000000;
+
+bool sameFormat( const MeshVertexFormat& a, const MeshVertexFormat& b )
+{
+    return a.position == b.position && a.normal == b.normal && a.color == b.color && a.index == b.index;
+}
+
+size_t indexSize( GLenum type )
+{
+    return type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned);
+}
+
+} // namespace
+
+bool GLMeshStreamRegion::write( const MeshBuffer& mb )
+{
+    source = nullptr;
+    const size_t num_verts = mb.numVertices();
+    const size_t num_indices = mb.numIndices();
+    if( !valid() || num_verts > vertexCapacity || num_indices > indexCapacity
+        || mb.isInterleaved() != interleaved || mb.hasNormals() != hasNormals || mb.hasColors() != hasColors
+        || (interleaved && mb.getVertexStride() != stride) )
+        return false;
+
+    if( num_verts > 0 )
+    {
+        if( !format.isFloat() )
+        {
+            quantization = computePositionQuantization(mb, format.position);
+            packVertices(mb, format, quantization, 0, num_verts, vertices[0]);
+        }
+        else if( interleaved )
+        {
+            quantization = MeshPositionQuantization();
+            std::memcpy(vertices[0], mb.getVertexData(), num_verts * stride * sizeof(float));
+        }
+        else
+        {
+            quantization = MeshPositionQuantization();
+            std::memcpy(vertices[0], mb.getVertexData(), num_verts * 3 * sizeof(float));
+            if( hasNormals )
+                std::memcpy(vertices[1], mb.getNormalData(), num_verts * 3 * sizeof(float));
+            if( hasColors )
+                std::memcpy(vertices[2], mb.getColorData(), num_verts * 4 * sizeof(float));
+        }
+    }
+    if( num_indices > 0 )
+    {
+        if( indexType == GL_UNSIGNED_SHORT )
+            packIndices16(mb, 0, num_indices, reinterpret_cast<uint16_t*>(indices));
+        else
+            std::memcpy(indices, mb.getIndexData(), num_indices * sizeof(unsigned));
+    }
+
+    source = &mb;
+    version = mb.version();
+    numVertices = num_verts;
+    numIndices = num_indices;
+    return true;
+}
 
 bool GLMeshObject::prepare()
 {
@@ -15,22 +84,111 @@ void GLMeshObject::draw() const
 
     if( m_numIndices>0 )
     {
+        // Region 0 unless streaming
+        const size_t first_index = m_drawRegion * m_numIndicesAllocated;
+        const GLint base_vertex = static_cast<GLint>(m_drawRegion * m_numVertsAllocated);
         glBindVertexArray(m_vao);
-        glDrawElements(m_type, static_cast<GLsizei>(m_numIndices), GL_UNSIGNED_INT, reinterpret_cast<void*>(0));
+        glDrawElementsBaseVertex(m_type, static_cast<GLsizei>(m_numIndices), m_indexType,
+            reinterpret_cast<void*>(first_index * indexSize(m_indexType)), base_vertex);
         glBindVertexArray(0);
         GL::checkGLError("GLMesh::draw()");
     }
 }
 
-void GLMeshObject::setMeshBuffer( std::shared_ptr<MeshBuffer> pbuf )
+void GLMeshObject::draw( const std::vector<MeshIndexRange>& ranges ) const
 {
+    assert( m_initialized );
+    if( m_dirty || ranges.empty() )
+        return;
+
+    const size_t index_size = indexSize(m_indexType);
+    const size_t first_index = m_drawRegion * m_numIndicesAllocated;
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    counts.reserve(ranges.size());
+    offsets.reserve(ranges.size());
+    for( const MeshIndexRange& r : ranges )
+    {
+        if( r.firstIndex + r.numIndices > m_numIndices )
+            continue;
+        counts.push_back(static_cast<GLsizei>(r.numIndices));
+        offsets.push_back(reinterpret_cast<const void*>((first_index + r.firstIndex) * index_size));
+    }
+    if( counts.empty() )
+        return;
+
+    const std::vector<GLint> base_vertices(counts.size(), static_cast<GLint>(m_drawRegion * m_numVertsAllocated));
+    glBindVertexArray(m_vao);
+    glMultiDrawElementsBaseVertex(m_type, counts.data(), m_indexType, offsets.data(), static_cast<GLsizei>(counts.size()), base_vertices.data());
+    glBindVertexArray(0);
+    GL::checkGLError("GLMesh::draw(ranges)");
+}
+
+void GLMeshObject::setMeshBuffer( std::shared_ptr<const MeshBuffer> pbuf )
+{
+    // Buffers are kept for meshes of the same layout, e.g. the next snapshot
+    const bool same_layout = m_pMeshBuffer && m_pMeshBuffer->getPrimitiveType() == pbuf->getPrimitiveType()
+        && m_pMeshBuffer->getAttributes() == pbuf->getAttributes() && m_pMeshBuffer->getLayout() == pbuf->getLayout()
+        && m_pMeshBuffer->getVertexStride() == pbuf->getVertexStride() && m_pMeshBuffer->getNormalOffset() == pbuf->getNormalOffset()
+        && m_pMeshBuffer->getColorOffset() == pbuf->getColorOffset();
     m_pMeshBuffer = pbuf;
     m_type = static_cast<GLenum>(pbuf->getPrimitiveType());
     m_hasNormals = pbuf->hasNormals();
     m_hasColors = pbuf->hasColors();
+    m_interleaved = pbuf->isInterleaved();
+    m_stride = pbuf->getVertexStride();
+    m_normalOffset = pbuf->getNormalOffset();
+    m_colorOffset = pbuf->getColorOffset();
+    if( !same_layout )
+        m_numVertsAllocated = 0; // force re-allocation
     setDirty();
 }
 
+void GLMeshObject::setVertexFormat( const MeshVertexFormat& format )
+{
+    if( sameFormat(format, m_format) )
+        return;
+    m_format = format;
+    m_numVertsAllocated = 0; // force re-allocation with new attribute pointers
+    if( m_pMeshBuffer )
+        setDirty();
+}
+
+void GLMeshObject::setStreaming( bool enable )
+{
+    if( enable == m_streamingRequested )
+        return;
+    m_streamingRequested = enable;
+    m_numVertsAllocated = 0; // force re-allocation
+    if( m_pMeshBuffer )
+        setDirty();
+}
+
+GLMeshStreamRegion GLMeshObject::beginWrite()
+{
+    if( !isStreaming() )
+        return GLMeshStreamRegion();
+
+    // The region after the drawn one stopped being drawn longest ago
+    const int r = (m_drawRegion + 1) % NumStreamRegions;
+    if( m_fences[r] )
+    {
+        while( glClientWaitSync(m_fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, StreamFenceTimeout) == GL_TIMEOUT_EXPIRED )
+            ;
+        glDeleteSync(m_fences[r]);
+        m_fences[r] = nullptr;
+    }
+    m_writeRegion = r;
+    m_regions[r].source = nullptr;
+    return m_regions[r];
+}
+
+void GLMeshObject::endWrite( const GLMeshStreamRegion& region )
+{
+    if( region.valid() && region.ring == m_ring && region.index == m_writeRegion )
+        m_regions[region.index] = region;
+}
+
 void GLMeshObject::setDirty()
 {
     m_numVerts   = m_pMeshBuffer->numVertices();
@@ -42,7 +200,7 @@ bool GLMeshObject::ensureUploaded()
 {
     if( m_dirty )
     {
-        m_dirty = !upload();
+        m_dirty = !(isStreaming() ? uploadStreaming() : upload());
     }
     return !m_dirty;
 }
@@ -53,7 +211,9 @@ bool GLMeshObject::ensureAllocated()
         if( !create() )
             return false;
 
-    bool needs_realloc = m_numVerts > m_numVertsAllocated || m_numIndices > m_numIndicesAllocated;
+    // Buffers are kept across meshes, unless these are much smaller
+    bool needs_realloc = m_numVerts > m_numVertsAllocated || m_numIndices > m_numIndicesAllocated
+                      || m_numIndices < m_numIndicesAllocated / ShrinkDivisor;
     if( needs_realloc )
         return allocate( m_numVerts, m_numIndices );
     
@@ -72,44 +232,119 @@ bool GLMeshObject::create()
 
 bool GLMeshObject::allocate( size_t num_verts, size_t num_indices )
 {
-    struct FloatPointer {
+    struct AttribPointer {
         GLuint index;
         GLint channels;
+        GLenum type;
         GLboolean normalized;
         GLsizei stride;
+        size_t offset; ///< in bytes
         bool active;
     };
 
-    const std::vector<FloatPointer> pointers {
-        { 0, 3, GL_FALSE, 0, true },
-        { 1, 3, GL_FALSE, 0, m_hasNormals },
-        { 3, 4, GL_FALSE, 0, m_hasColors } };
+    // 10:10:10:2 vertex attributes are core since OpenGL 3.3 only
+    if( m_format.normal == MeshNormalFormat::Int2101010 && !(GLEW_VERSION_3_3 || GLEW_ARB_vertex_type_2_10_10_10_rev) )
+        m_format.normal = MeshNormalFormat::Float;
+
+    // A streaming ring holds NumStreamRegions meshes with some headroom each,
+    // in blocks of ring_verts vertices per attribute
+    bool streaming = m_streamingRequested && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) && num_verts > 0 && num_indices > 0;
+    if( streaming )
+    {
+        num_verts += num_verts / StreamHeadroomDivisor;
+        num_indices += num_indices / StreamHeadroomDivisor;
+    }
+    const size_t ring_verts = streaming ? NumStreamRegions * num_verts : num_verts;
+
+    std::vector<AttribPointer> pointers;
+    size_t total_bytes = 0;
+    if( !m_format.isFloat() )
+    {
+        // packed interleaved vertices
+        const MeshPackedLayout layout(m_format, m_pMeshBuffer->getAttributes());
+        const GLsizei stride = static_cast<GLsizei>(layout.stride);
 
-    auto getTotalNumFloats = [&num_verts, &pointers]() -> size_t
+        const bool float_pos = m_format.position == MeshPositionFormat::Float;
+        const GLenum pos_type = float_pos ? GL_FLOAT : (m_format.position == MeshPositionFormat::Half ? GL_HALF_FLOAT : GL_UNSIGNED_SHORT);
+        const GLboolean pos_normalized = m_format.position == MeshPositionFormat::UNorm16 ? GL_TRUE : GL_FALSE;
+
+        AttribPointer normal { 1, 3, GL_FLOAT, GL_FALSE, stride, layout.normalOffset, m_hasNormals };
+        if( m_format.normal == MeshNormalFormat::Int2101010 ) { normal.channels = 4; normal.type = GL_INT_2_10_10_10_REV; normal.normalized = GL_TRUE; }
+        if( m_format.normal == MeshNormalFormat::Octahedral ) { normal.channels = 2; normal.type = GL_SHORT;              normal.normalized = GL_TRUE; }
+
+        AttribPointer color { 3, 4, GL_FLOAT, GL_FALSE, stride, layout.colorOffset, m_hasColors };
+        if( m_format.color == MeshColorFormat::RGBA8 ) { color.type = GL_UNSIGNED_BYTE; color.normalized = GL_TRUE; }
+
+        pointers = { { 0, 3, pos_type, pos_normalized, stride, 0, true }, normal, color };
+        total_bytes = layout.stride * ring_verts;
+    }
+    else if( m_interleaved )
     {
-        size_t total = 0;
-        for (const auto& p : pointers)
+        const GLsizei stride = static_cast<GLsizei>(m_stride * sizeof(float));
+        pointers = {
+            { 0, 3, GL_FLOAT, GL_FALSE, stride, 0,                            true },
+            { 1, 3, GL_FLOAT, GL_FALSE, stride, m_normalOffset*sizeof(float), m_hasNormals },
+            { 3, 4, GL_FLOAT, GL_FALSE, stride, m_colorOffset *sizeof(float), m_hasColors } };
+        total_bytes = m_stride * ring_verts * sizeof(float);
+    }
+    else
+    {
+        // one block per attribute
+        pointers = {
+            { 0, 3, GL_FLOAT, GL_FALSE, 0, 0, true },
+            { 1, 3, GL_FLOAT, GL_FALSE, 0, 0, m_hasNormals },
+            { 3, 4, GL_FLOAT, GL_FALSE, 0, 0, m_hasColors } };
+        for (auto& p : pointers)
         {
             if (p.active)
-                total += p.channels * num_verts;
+            {
+                p.offset = total_bytes;
+                total_bytes += p.channels * ring_verts * sizeof(float);
+            }
         }
-        return total;
-    };
+    }
 
-    glBindVertexArray(m_vao);
+    m_indexType = m_format.index == MeshIndexFormat::Smallest && num_verts < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    const size_t index_size = indexSize(m_indexType);
+    const size_t index_bytes = index_size * num_indices * (streaming ? NumStreamRegions : 1);
+
+    // Immutable storage cannot be respecified, so a ring gets new buffers
+    if( streaming || isStreaming() )
+        releaseStreaming();
 
+    glBindVertexArray(m_vao);
     glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-    glBufferData(GL_ARRAY_BUFFER, getTotalNumFloats()*sizeof(float), nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+    if( streaming )
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, total_bytes, nullptr, flags);
+        glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, index_bytes, nullptr, flags);
+        m_mappedVertices = glMapBufferRange(GL_ARRAY_BUFFER, 0, total_bytes, flags);
+        m_mappedIndices = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, index_bytes, flags);
+        if( !m_mappedVertices || !m_mappedIndices )
+        {
+            // Fall back to regular buffers
+            GL::clearGLError("GLMesh::allocate() - mapping");
+            releaseStreaming();
+            streaming = false;
+            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+        }
+    }
+    if( !streaming )
+    {
+        glBufferData(GL_ARRAY_BUFFER, total_bytes, nullptr, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, nullptr, GL_STATIC_DRAW);
+    }
 
-    size_t offsetInFloats = 0;
     for (const auto& p : pointers)
     {
         if (p.active)
         {
             glEnableVertexAttribArray(p.index);
-            const void* ptr = reinterpret_cast<void*>(offsetInFloats * sizeof(float));
-            glVertexAttribPointer(p.index, p.channels, GL_FLOAT, p.normalized, p.stride, ptr);
-            offsetInFloats += p.channels * num_verts;
+            const void* ptr = reinterpret_cast<void*>(p.offset);
+            glVertexAttribPointer(p.index, p.channels, p.type, p.normalized, p.stride, ptr);
         }
         else
         {
@@ -117,11 +352,38 @@ bool GLMeshObject::allocate( size_t num_verts, size_t num_indices )
         }
     }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned)*num_indices, nullptr, GL_STATIC_DRAW);
-
     glBindVertexArray(0);
 
+    if( streaming )
+    {
+        ++m_ring;
+        uint8_t* vertices = static_cast<uint8_t*>(m_mappedVertices);
+        const bool separate = m_format.isFloat() && !m_interleaved;
+        for( int r = 0; r < NumStreamRegions; ++r )
+        {
+            GLMeshStreamRegion& region = m_regions[r];
+            region = GLMeshStreamRegion();
+            region.index = r;
+            region.ring = m_ring;
+            for( size_t k = 0; k < pointers.size(); ++k )
+            {
+                // Blocks per attribute, or one block of whole vertices
+                const size_t vertex_bytes = separate ? pointers[k].channels * sizeof(float) : total_bytes / ring_verts;
+                if( pointers[k].active && (separate || k == 0) )
+                    region.vertices[k] = vertices + pointers[k].offset + r * num_verts * vertex_bytes;
+            }
+            region.indices = static_cast<uint8_t*>(m_mappedIndices) + r * num_indices * index_size;
+            region.vertexCapacity = num_verts;
+            region.indexCapacity = num_indices;
+            region.format = m_format;
+            region.interleaved = m_interleaved;
+            region.stride = m_stride;
+            region.hasNormals = m_hasNormals;
+            region.hasColors = m_hasColors;
+            region.indexType = m_indexType;
+        }
+    }
+
     bool success = GL::checkGLError("GLMesh::allocate()");
     if( success )
     {
@@ -136,7 +398,52 @@ bool GLMeshObject::allocate( size_t num_verts, size_t num_indices )
     return success;
 }
 
-bool GLMeshObject::upload() const
+void GLMeshObject::releaseStreaming()
+{
+    // Deleting a buffer releases its mapping
+    glDeleteBuffers(1, &m_vbo);
+    glDeleteBuffers(1, &m_ibo);
+    glGenBuffers(1, &m_vbo);
+    glGenBuffers(1, &m_ibo);
+    for( GLsync& fence : m_fences )
+    {
+        if( fence )
+            glDeleteSync(fence);
+        fence = nullptr;
+    }
+    m_mappedVertices = nullptr;
+    m_mappedIndices = nullptr;
+    m_drawRegion = 0;
+    m_writeRegion = -1;
+}
+
+bool GLMeshObject::uploadStreaming()
+{
+    assert(m_pMeshBuffer->numVertices() == m_numVerts);
+    assert(m_numVerts <= m_numVertsAllocated);
+
+    // Without a region written from this mesh, write one now
+    if( m_writeRegion < 0 )
+        beginWrite();
+    GLMeshStreamRegion& region = m_regions[m_writeRegion];
+    const bool written = region.source == m_pMeshBuffer.get() && region.version == m_pMeshBuffer->version()
+                      && region.numVertices == m_numVerts && region.numIndices == m_numIndices;
+    if( !written && !region.write(*m_pMeshBuffer) )
+        return false;
+
+    // The mapping is coherent, so a fence after the draws of the previous
+    // region is all that is left before it can be written again
+    GLsync& fence = m_fences[m_drawRegion];
+    if( fence )
+        glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_drawRegion = m_writeRegion;
+    m_writeRegion = -1;
+    m_quantization = region.quantization;
+    return GL::checkGLError("GLMesh::uploadStreaming()");
+}
+
+bool GLMeshObject::upload()
 {
     GL::checkGLError("GLMesh::upload() - begin");
 
@@ -146,12 +453,8 @@ bool GLMeshObject::upload() const
     assert(m_numIndices <= m_numIndicesAllocated);
 
     size_t vsize = m_numVerts*3*sizeof(float);
-    size_t vofs = m_numVertsAllocated*3*sizeof(float);
     size_t isize = m_numIndices*sizeof(unsigned);
 
-    size_t csize = m_numVerts * 4 * sizeof(float);
-    size_t cofs = vofs + vsize;
-
     if (vsize > 0 && isize > 0)
     {
         size_t offsetInFloats = 0;
@@ -167,25 +470,53 @@ bool GLMeshObject::upload() const
                 data);
         };
 
-        bufferSubData(offsetInFloats, m_numVerts, 3, m_pMeshBuffer->getVertexData());
-        offsetInFloats += m_numVertsAllocated * 3;
+        if (!m_format.isFloat())
+        {
+            m_quantization = computePositionQuantization(*m_pMeshBuffer, m_format.position);
 
-        if (m_hasNormals)
+            const MeshPackedLayout layout(m_format, m_pMeshBuffer->getAttributes());
+            m_stagingVertices.resize(layout.stride * m_numVerts);
+            packVertices(*m_pMeshBuffer, m_format, m_quantization, 0, m_numVerts, m_stagingVertices.data());
+            glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(m_stagingVertices.size()), m_stagingVertices.data());
+        }
+        else if (m_interleaved)
         {
-            bufferSubData(offsetInFloats, m_numVerts, 3, m_pMeshBuffer->getNormalData());
-            offsetInFloats += m_numVertsAllocated * 3;
+            // single contiguous copy of all attributes
+            m_quantization = MeshPositionQuantization();
+            bufferSubData(0, m_numVerts, m_stride, m_pMeshBuffer->getVertexData());
         }
-        if (m_hasColors)
+        else
         {
-            bufferSubData(offsetInFloats, m_numVerts, 4, m_pMeshBuffer->getColorData());
-            offsetInFloats += m_numVertsAllocated * 4;
+            m_quantization = MeshPositionQuantization();
+            bufferSubData(offsetInFloats, m_numVerts, 3, m_pMeshBuffer->getVertexData());
+            offsetInFloats += m_numVertsAllocated * 3;
+
+            if (m_hasNormals)
+            {
+                bufferSubData(offsetInFloats, m_numVerts, 3, m_pMeshBuffer->getNormalData());
+                offsetInFloats += m_numVertsAllocated * 3;
+            }
+            if (m_hasColors)
+            {
+                bufferSubData(offsetInFloats, m_numVerts, 4, m_pMeshBuffer->getColorData());
+                offsetInFloats += m_numVertsAllocated * 4;
+            }
         }
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, isize, m_pMeshBuffer->getIndexData());
+        if (m_indexType == GL_UNSIGNED_SHORT)
+        {
+            m_stagingIndices.resize(m_numIndices);
+            packIndices16(*m_pMeshBuffer, 0, m_numIndices, m_stagingIndices.data());
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, m_numIndices*sizeof(uint16_t), m_stagingIndices.data());
+        }
+        else
+        {
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, isize, m_pMeshBuffer->getIndexData());
+        }
 
         glBindVertexArray(0);
     }
 
     return GL::checkGLError("GLMesh::upload()");
-}    
+}
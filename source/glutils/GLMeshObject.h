@@ -1,27 +1,98 @@
 #pragma once
 #include <memory>
+#include <vector>
 #include "MeshBuffer.h"
+#include "MeshBufferEncoding.h"
+#include "MeshClusters.h" // MeshIndexRange
 #include "GLConfig.h"
 
+/// Region of the persistently mapped ring of a streaming GLMeshObject that
+/// one mesh is written to, see GLMeshObject::beginWrite()
+struct GLMeshStreamRegion
+{
+    /// Packs or copies the vertices and indices of mb into the mapped memory.
+    /// Makes no GL calls, so any thread can write while the GL thread keeps
+    /// drawing other regions. Fails if mb does not fit or has another layout.
+    bool write( const MeshBuffer& mb );
+
+    bool valid() const { return index >= 0; }
+
+    int index = -1;    ///< in the ring, -1 for none
+    unsigned ring = 0; ///< allocation of the ring, regions of older ones are ignored
+    uint8_t* vertices[3] = { nullptr, nullptr, nullptr }; ///< position, normal and color blocks, only the first if interleaved or packed
+    uint8_t* indices = nullptr;
+    size_t vertexCapacity = 0;
+    size_t indexCapacity = 0;
+
+    // Layout the ring was allocated for
+    MeshVertexFormat format;
+    bool interleaved = false;
+    size_t stride = 0; ///< Interleaved vertex stride in floats
+    bool hasNormals = false;
+    bool hasColors = false;
+    GLenum indexType = GL_UNSIGNED_INT;
+
+    // Written mesh
+    const MeshBuffer* source = nullptr;
+    uint64_t version = 0;
+    size_t numVertices = 0;
+    size_t numIndices = 0;
+    MeshPositionQuantization quantization;
+};
+
 class GLMeshObject
 {
 public:
     bool prepare();
     void draw() const;
+    /// Draws the given index ranges only, e.g. from cullClusters()
+    void draw( const std::vector<MeshIndexRange>& ranges ) const;
 
-    void setMeshBuffer( std::shared_ptr<MeshBuffer> pbuf );
+    void setMeshBuffer( std::shared_ptr<const MeshBuffer> pbuf );
     void setDirty();
 
+    /// Attribute encodings on the GPU. Non-float formats are packed into a
+    /// single interleaved vertex buffer on upload, see MeshPackedLayout.
+    void setVertexFormat( const MeshVertexFormat& format );
+    const MeshVertexFormat& getVertexFormat() const { return m_format; }
+
+    /// Dequantization of uploaded positions, position = offset + scale * attribute
+    const float* getPositionScale () const { return m_quantization.scale; }
+    const float* getPositionOffset() const { return m_quantization.offset; }
+
+    /// Regions of the streaming ring, one drawn, one written and one the GPU may still read
+    static constexpr int NumStreamRegions = 3;
+
+    /// Upload through a ring of NumStreamRegions regions in persistently
+    /// mapped, coherent buffers (GL 4.4 or ARB_buffer_storage) instead of
+    /// glBufferSubData, so other threads can write the next mesh while the
+    /// current one is drawn, see beginWrite(). Without support the regular
+    /// upload is used. Takes effect with the next allocation.
+    void setStreaming( bool enable );
+    /// True if the ring is allocated
+    bool isStreaming() const { return m_mappedVertices != nullptr; }
+
+    /// Region for the next mesh, once the GPU finished reading it. Invalid
+    /// without streaming. GL thread only, like endWrite().
+    GLMeshStreamRegion beginWrite();
+    /// Hands a written region back. It is drawn without copying once the
+    /// mesh buffer it was written from is set and prepared, otherwise the
+    /// next upload writes it. The ring must not be reallocated meanwhile,
+    /// stale regions are ignored.
+    void endWrite( const GLMeshStreamRegion& region );
+
 protected:
     bool ensureUploaded();
     bool ensureAllocated();
 
     bool create();
     bool allocate( size_t num_verts, size_t num_indices );
-    bool upload() const;
+    bool upload();
+    bool uploadStreaming();
+    void releaseStreaming();
     
 private:
-    std::shared_ptr<MeshBuffer> m_pMeshBuffer;
+    std::shared_ptr<const MeshBuffer> m_pMeshBuffer;
     
     GLuint m_vao =0;
     GLuint m_vbo =0;
@@ -30,6 +101,25 @@ private:
     GLenum m_type =GL_TRIANGLES;
     bool m_hasNormals = true;
     bool m_hasColors = false;
+    bool m_interleaved = false;
+    size_t m_stride = 0;       ///< Interleaved vertex stride in floats
+    size_t m_normalOffset = 0; ///< Interleaved attribute offsets in floats
+    size_t m_colorOffset = 0;
+
+    MeshVertexFormat m_format;
+    MeshPositionQuantization m_quantization;
+    GLenum m_indexType = GL_UNSIGNED_INT;
+    std::vector<uint8_t>  m_stagingVertices; ///< Packed vertices
+    std::vector<uint16_t> m_stagingIndices;  ///< 16-bit indices
+
+    bool m_streamingRequested = false;
+    void* m_mappedVertices = nullptr;
+    void* m_mappedIndices = nullptr;
+    GLMeshStreamRegion m_regions[NumStreamRegions];
+    GLsync m_fences[NumStreamRegions] = {}; ///< set when a region stops being drawn
+    int m_drawRegion = 0;
+    int m_writeRegion = -1; ///< handed out by beginWrite()
+    unsigned m_ring = 0;
 
     bool m_initialized = false;
     bool m_dirty       = true;
@@ -0,0 +1,164 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstring> // memcpy
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// Bytes currently allocated by all MeshArenas of the process, external
+/// memory is not counted
+inline std::atomic<size_t>& meshArenaBytes()
+{
+    static std::atomic<size_t> bytes{ 0 };
+    return bytes;
+}
+
+/// Storage for parallel streams of trivially copyable elements, e.g. the
+/// vertex attributes of a MeshBuffer, in one aligned allocation. Stream i
+/// holds channels[i] elements per item. Growth leaves new items
+/// uninitialized and moves the existing items of all streams at once.
+///
+/// An arena can also adopt external memory with the same layout, e.g. a
+/// memory-mapped cache file, which is kept alive by an owner handle. The
+/// first reallocation copies the items into an own allocation.
+template<class T>
+class MeshArena
+{
+    static_assert(std::is_trivially_copyable<T>::value, "MeshArena requires trivially copyable elements");
+
+public:
+    static constexpr size_t Alignment = 64; ///< bytes, start of each stream
+
+    MeshArena() = default;
+    explicit MeshArena(std::vector<size_t> channels) : m_channels(std::move(channels)) { updateOffsets(0); }
+
+    /// Arena over external memory laid out as streamOffsets(channels, capacity)
+    MeshArena(std::vector<size_t> channels, size_t capacity, T* data, std::shared_ptr<void> owner)
+    : m_channels(std::move(channels)),
+      m_data(data),
+      m_capacity(capacity),
+      m_owner(std::move(owner))
+    {
+        updateOffsets(capacity);
+    }
+
+    MeshArena(const MeshArena& other) : m_channels(other.m_channels)
+    {
+        reserveExact(other.m_capacity, other.m_capacity, other);
+    }
+    MeshArena(MeshArena&& other) noexcept { swap(other); }
+    MeshArena& operator=(MeshArena other) noexcept { swap(other); return *this; }
+    ~MeshArena() { release(); }
+
+    void swap(MeshArena& other) noexcept
+    {
+        std::swap(m_channels, other.m_channels);
+        std::swap(m_offsets,  other.m_offsets);
+        std::swap(m_data,     other.m_data);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_allocated, other.m_allocated);
+        std::swap(m_owner,    other.m_owner);
+    }
+
+    size_t numStreams() const { return m_channels.size(); }
+    size_t channels(size_t stream) const { return m_channels[stream]; }
+    const std::vector<size_t>& channels() const { return m_channels; }
+
+    /// Start of each stream in elements for the given capacity, the last
+    /// entry is the total size. Streams start at Alignment boundaries.
+    static std::vector<size_t> streamOffsets(const std::vector<size_t>& channels, size_t capacity)
+    {
+        std::vector<size_t> offsets(channels.size() + 1);
+        size_t ofs = 0;
+        for (size_t i = 0; i < channels.size(); ++i)
+        {
+            offsets[i] = ofs;
+            ofs += (channels[i] * capacity + AlignmentInElements - 1) / AlignmentInElements * AlignmentInElements;
+        }
+        offsets.back() = ofs;
+        return offsets;
+    }
+
+    /// True if the memory is external, see adopting constructor
+    bool isExternal() const { return m_owner != nullptr; }
+
+    /// Number of items each stream can hold
+    size_t capacity() const { return m_capacity; }
+
+    /// Allocation size in bytes
+    size_t bytes() const { return m_offsets.empty() ? 0 : m_offsets.back() * sizeof(T); }
+
+          T* stream(size_t i)       { assert(i < numStreams()); return m_data + m_offsets[i]; }
+    const T* stream(size_t i) const { assert(i < numStreams()); return m_data + m_offsets[i]; }
+
+    /// Reallocate to exactly numItems, keeping the first numValid items of every stream
+    void reserveExact(size_t numItems, size_t numValid)
+    {
+        if (numItems == m_capacity)
+            return;
+        reserveExact(numItems, numValid, *this);
+    }
+
+    /// Grow to at least numItems by a factor of the current capacity
+    void grow(size_t numItems, size_t numValid, float growthFactor)
+    {
+        if (numItems <= m_capacity)
+            return;
+        const size_t grown = static_cast<size_t>(static_cast<double>(m_capacity) * growthFactor);
+        reserveExact(numItems > grown ? numItems : grown, numValid);
+    }
+
+private:
+    static constexpr size_t AlignmentInElements = Alignment / sizeof(T) > 0 ? Alignment / sizeof(T) : 1;
+
+    void updateOffsets(size_t capacity)
+    {
+        m_offsets = streamOffsets(m_channels, capacity);
+    }
+
+    void reserveExact(size_t numItems, size_t numValid, const MeshArena& src)
+    {
+        const std::vector<size_t> src_offsets = src.m_offsets;
+        const T* src_data = src.m_data;
+        if (numValid > src.m_capacity) numValid = src.m_capacity;
+        if (numValid > numItems)       numValid = numItems;
+
+        updateOffsets(numItems);
+        const size_t size = bytes();
+        T* data = size > 0 ? static_cast<T*>(::operator new(size, std::align_val_t(Alignment))) : nullptr;
+        if (src_data)
+        {
+            for (size_t i = 0; i < m_channels.size(); ++i)
+                std::memcpy(data + m_offsets[i], src_data + src_offsets[i], numValid * m_channels[i] * sizeof(T));
+        }
+
+        if (&src == this)
+            release();
+        m_data = data;
+        m_capacity = numItems;
+        m_allocated = size;
+        meshArenaBytes() += size;
+    }
+
+    void release()
+    {
+        if (m_owner)
+            m_owner.reset();
+        else if (m_data)
+            ::operator delete(m_data, std::align_val_t(Alignment));
+        meshArenaBytes() -= m_allocated;
+        m_data = nullptr;
+        m_allocated = 0;
+    }
+
+    std::vector<size_t> m_channels;
+    std::vector<size_t> m_offsets;
+    T* m_data = nullptr;
+    size_t m_capacity = 0;
+    size_t m_allocated = 0;        ///< bytes of the own allocation, 0 for external memory
+    std::shared_ptr<void> m_owner; ///< keeps external memory alive
+};
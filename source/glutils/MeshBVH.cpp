@@ -0,0 +1,478 @@
+#include "MeshBVH.h"
+#include "MeshBuffer.h"
+#include "MeshBufferView.h"
+#include <utils/ParallelFor.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+constexpr int NumBins = 16;
+constexpr size_t MaxLeafSize = 16;     ///< larger nodes are always split
+constexpr size_t MinParallelSize = 1 << 16;
+constexpr int MaxStackDepth = 128;
+constexpr int MaxSAHDepth = 96;         ///< median splits below, bounds the tree depth
+
+inline float halfArea(const float lo[3], const float hi[3])
+{
+    const float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+    return dx*dy + dy*dz + dz*dx;
+}
+
+inline void grow(float lo[3], float hi[3], const float* p)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        lo[k] = std::min(lo[k], p[k]);
+        hi[k] = std::max(hi[k], p[k]);
+    }
+}
+
+inline void emptyBox(float lo[3], float hi[3])
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        lo[k] = std::numeric_limits<float>::max();
+        hi[k] = -std::numeric_limits<float>::max();
+    }
+}
+
+/// Entry distance of the ray into the box, or a negative value for a miss
+inline float intersectBox(const float lo[3], const float hi[3], const float origin[3], const float invDir[3], float tmax)
+{
+    float t0 = 0.f, t1 = tmax;
+    for (int k = 0; k < 3; ++k)
+    {
+        float near = (lo[k] - origin[k]) * invDir[k];
+        float far  = (hi[k] - origin[k]) * invDir[k];
+        if (near > far) std::swap(near, far);
+        t0 = near > t0 ? near : t0;
+        t1 = far  < t1 ? far  : t1;
+        if (t0 > t1)
+            return -1.f;
+    }
+    return t0;
+}
+
+inline float boxDistance2(const float lo[3], const float hi[3], const float p[3])
+{
+    float d2 = 0.f;
+    for (int k = 0; k < 3; ++k)
+    {
+        const float d = p[k] < lo[k] ? lo[k] - p[k] : (p[k] > hi[k] ? p[k] - hi[k] : 0.f);
+        d2 += d * d;
+    }
+    return d2;
+}
+
+inline float dot(const float a[3], const float b[3]) { return a[0]*b[0] + a[1]*b[1] + a[2]*b[2]; }
+inline void sub(const float a[3], const float b[3], float r[3]) { r[0] = a[0]-b[0]; r[1] = a[1]-b[1]; r[2] = a[2]-b[2]; }
+inline void cross(const float a[3], const float b[3], float r[3])
+{
+    r[0] = a[1]*b[2] - a[2]*b[1];
+    r[1] = a[2]*b[0] - a[0]*b[2];
+    r[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+/// Closest point on triangle abc to p, Ericson, Real-Time Collision Detection, 5.1.5
+void closestPointTriangle(const float p[3], const float a[3], const float b[3], const float c[3], float r[3])
+{
+    float ab[3], ac[3], ap[3];
+    sub(b, a, ab); sub(c, a, ac); sub(p, a, ap);
+    auto set = [r](const float* q) { r[0] = q[0]; r[1] = q[1]; r[2] = q[2]; };
+    auto lerp = [r](const float* q, const float* e, float t) { r[0] = q[0] + t*e[0]; r[1] = q[1] + t*e[1]; r[2] = q[2] + t*e[2]; };
+
+    const float d1 = dot(ab, ap), d2 = dot(ac, ap);
+    if (d1 <= 0.f && d2 <= 0.f) { set(a); return; }
+
+    float bp[3];
+    sub(p, b, bp);
+    const float d3 = dot(ab, bp), d4 = dot(ac, bp);
+    if (d3 >= 0.f && d4 <= d3) { set(b); return; }
+
+    const float vc = d1*d4 - d3*d2;
+    if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) { lerp(a, ab, d1 / (d1 - d3)); return; }
+
+    float cp[3];
+    sub(p, c, cp);
+    const float d5 = dot(ab, cp), d6 = dot(ac, cp);
+    if (d6 >= 0.f && d5 <= d6) { set(c); return; }
+
+    const float vb = d5*d2 - d1*d6;
+    if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) { lerp(a, ac, d2 / (d2 - d6)); return; }
+
+    const float va = d3*d6 - d5*d4;
+    if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+    {
+        float bc[3];
+        sub(c, b, bc);
+        lerp(b, bc, (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        return;
+    }
+
+    const float denom = 1.f / (va + vb + vc);
+    const float v = vb * denom, w = vc * denom;
+    for (int k = 0; k < 3; ++k)
+        r[k] = a[k] + ab[k]*v + ac[k]*w;
+}
+
+} // namespace
+
+struct MeshBVH::Builder
+{
+    /// Triangle bounds, partitioned in place during the build so the
+    /// binning passes read them sequentially
+    struct Ref
+    {
+        float lo[3];
+        float hi[3];
+        float centroid[3];
+        uint32_t id;
+    };
+    std::vector<Ref> refs;
+
+    void bounds(size_t begin, size_t end, Node& node, float clo[3], float chi[3]) const
+    {
+        emptyBox(node.lo, node.hi);
+        emptyBox(clo, chi);
+        for (size_t i = begin; i < end; ++i)
+        {
+            grow(node.lo, node.hi, refs[i].lo);
+            grow(node.lo, node.hi, refs[i].hi);
+            grow(clo, chi, refs[i].centroid);
+        }
+    }
+
+    /// Partitions [begin,end) by the cheapest binned SAH split, returns end for a leaf
+    size_t split(size_t begin, size_t end, const Node& node, const float clo[3], const float chi[3], int level)
+    {
+        const size_t count = end - begin;
+        if (count <= 2)
+            return end;
+        if (level >= MaxSAHDepth)
+            return begin + count / 2;
+
+        // Bin the centroids along all axes in one pass over the triangles,
+        // small nodes use fewer bins
+        const int numBins = static_cast<int>(std::min<size_t>(NumBins, count));
+        float scale[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            scale[axis] = numBins / (chi[axis] - clo[axis]);
+            if (!std::isfinite(scale[axis]))
+                scale[axis] = 0.f;
+        }
+        size_t binCount[3][NumBins] = {};
+        float binLo[3][NumBins][3], binHi[3][NumBins][3];
+        for (int axis = 0; axis < 3; ++axis)
+            for (int b = 0; b < numBins; ++b)
+                emptyBox(binLo[axis][b], binHi[axis][b]);
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Ref& ref = refs[i];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const int b = std::min(numBins - 1, static_cast<int>((ref.centroid[axis] - clo[axis]) * scale[axis]));
+                ++binCount[axis][b];
+                grow(binLo[axis][b], binHi[axis][b], ref.lo);
+                grow(binLo[axis][b], binHi[axis][b], ref.hi);
+            }
+        }
+
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1, bestBin = 0;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (scale[axis] <= 0.f)
+                continue;
+
+            // Right sides swept from the end, left sides from the start
+            float rightArea[NumBins];
+            size_t rightCount[NumBins];
+            float lo[3], hi[3];
+            emptyBox(lo, hi);
+            size_t n = 0;
+            for (int b = numBins - 1; b > 0; --b)
+            {
+                if (binCount[axis][b]) { grow(lo, hi, binLo[axis][b]); grow(lo, hi, binHi[axis][b]); }
+                n += binCount[axis][b];
+                rightArea[b] = n ? halfArea(lo, hi) : 0.f;
+                rightCount[b] = n;
+            }
+            emptyBox(lo, hi);
+            n = 0;
+            for (int b = 0; b < numBins - 1; ++b)
+            {
+                if (binCount[axis][b]) { grow(lo, hi, binLo[axis][b]); grow(lo, hi, binHi[axis][b]); }
+                n += binCount[axis][b];
+                if (n == 0 || rightCount[b + 1] == 0)
+                    continue;
+                const float cost = halfArea(lo, hi) * n + rightArea[b + 1] * rightCount[b + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        // A leaf costs one intersection per triangle, a split one traversal step more
+        const float leafCost = halfArea(node.lo, node.hi) * (count - 1);
+        if (count <= MaxLeafSize && (bestAxis < 0 || bestCost >= leafCost))
+            return end;
+
+        size_t mid = begin;
+        if (bestAxis >= 0)
+        {
+            mid = std::partition(refs.begin() + begin, refs.begin() + end, [&](const Ref& ref)
+            {
+                return std::min(numBins - 1, static_cast<int>((ref.centroid[bestAxis] - clo[bestAxis]) * scale[bestAxis])) <= bestBin;
+            }) - refs.begin();
+        }
+        if (mid == begin || mid == end)
+        {
+            // Coincident centroids, split in the middle
+            mid = begin + count / 2;
+        }
+        return mid;
+    }
+
+    void build(std::vector<Node>& out, size_t begin, size_t end, int level)
+    {
+        Node node;
+        float clo[3], chi[3];
+        bounds(begin, end, node, clo, chi);
+        const size_t index = out.size();
+        out.push_back(node);
+
+        const size_t mid = split(begin, end, node, clo, chi, level);
+        if (mid == end)
+        {
+            out[index].offset = static_cast<uint32_t>(begin);
+            out[index].count = static_cast<uint32_t>(end - begin);
+            return;
+        }
+        out[index].count = 0;
+        build(out, begin, mid, level + 1);
+        out[index].offset = static_cast<uint32_t>(out.size() - index);
+        build(out, mid, end, level + 1);
+    }
+
+    /// Builds the subtrees of the first depth levels on own threads
+    std::vector<Node> buildParallel(size_t begin, size_t end, int depth, int level=0)
+    {
+        std::vector<Node> out;
+        if (depth <= 0 || end - begin < MinParallelSize)
+        {
+            out.reserve(end - begin);
+            build(out, begin, end, level);
+            return out;
+        }
+
+        Node node;
+        float clo[3], chi[3];
+        bounds(begin, end, node, clo, chi);
+        const size_t mid = split(begin, end, node, clo, chi, level);
+        if (mid == end)
+        {
+            node.offset = static_cast<uint32_t>(begin);
+            node.count = static_cast<uint32_t>(end - begin);
+            return { node };
+        }
+
+        std::vector<Node> first;
+        std::thread thread([&] { first = buildParallel(begin, mid, depth - 1, level + 1); });
+        std::vector<Node> second = buildParallel(mid, end, depth - 1, level + 1);
+        thread.join();
+
+        node.count = 0;
+        node.offset = static_cast<uint32_t>(1 + first.size());
+        out.reserve(1 + first.size() + second.size());
+        out.push_back(node);
+        out.insert(out.end(), first.begin(), first.end());
+        out.insert(out.end(), second.begin(), second.end());
+        return out;
+    }
+};
+
+void MeshBVH::clear()
+{
+    m_nodes.clear();
+    m_triangles.clear();
+    m_ids.clear();
+}
+
+size_t MeshBVH::bytesAllocated() const
+{
+    return m_nodes.capacity() * sizeof(Node) + m_triangles.capacity() * sizeof(Triangle) + m_ids.capacity() * sizeof(size_t);
+}
+
+void MeshBVH::build(const MeshBufferView& view, unsigned numThreads)
+{
+    clear();
+    if (view.getPrimitiveType() != MeshPrimitiveType::Triangles || view.numIndices() < 3)
+        return;
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Triangles of all parts in view order
+    const size_t numTriangles = view.numIndices() / 3;
+    std::vector<Triangle> triangles(numTriangles);
+    for (const MeshBufferView::Part& part : view.parts())
+    {
+        const unsigned* indices = part.mesh->getIndexData();
+        const size_t first = part.baseIndex / 3;
+        parallelFor(part.numIndices / 3, numThreads, [&](size_t t)
+        {
+            Triangle& tri = triangles[first + t];
+            for (int j = 0; j < 3; ++j)
+                std::copy(part.mesh->getVertexData(indices[3*t + j]), part.mesh->getVertexData(indices[3*t + j]) + 3, tri.v[j]);
+        });
+    }
+
+    Builder builder;
+    builder.refs.resize(numTriangles);
+    parallelFor(numTriangles, numThreads, [&](size_t t)
+    {
+        const Triangle& tri = triangles[t];
+        Builder::Ref& ref = builder.refs[t];
+        for (int k = 0; k < 3; ++k)
+        {
+            ref.lo[k] = std::min({ tri.v[0][k], tri.v[1][k], tri.v[2][k] });
+            ref.hi[k] = std::max({ tri.v[0][k], tri.v[1][k], tri.v[2][k] });
+            ref.centroid[k] = (tri.v[0][k] + tri.v[1][k] + tri.v[2][k]) / 3.f;
+        }
+        ref.id = static_cast<uint32_t>(t);
+    });
+
+    int depth = 0;
+    while ((1u << depth) < numThreads)
+        ++depth;
+    m_nodes = builder.buildParallel(0, numTriangles, depth);
+
+    m_triangles.resize(numTriangles);
+    m_ids.resize(numTriangles);
+    parallelFor(numTriangles, numThreads, [&](size_t i)
+    {
+        m_triangles[i] = triangles[builder.refs[i].id];
+        m_ids[i] = builder.refs[i].id;
+    });
+}
+
+bool MeshBVH::raycast(const float origin[3], const float direction[3], MeshRayHit& hit) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    float invDir[3];
+    for (int k = 0; k < 3; ++k)
+        invDir[k] = direction[k] != 0.f ? 1.f / direction[k] : std::numeric_limits<float>::max();
+
+    bool found = false;
+    uint32_t stack[MaxStackDepth];
+    int top = 0;
+    if (intersectBox(m_nodes[0].lo, m_nodes[0].hi, origin, invDir, hit.t) >= 0.f)
+        stack[top++] = 0;
+    while (top > 0)
+    {
+        const uint32_t index = stack[--top];
+        const Node& node = m_nodes[index];
+        if (node.count > 0)
+        {
+            // Moeller-Trumbore, both faces
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+            {
+                const Triangle& tri = m_triangles[i];
+                float e1[3], e2[3], p[3], s[3], q[3];
+                sub(tri.v[1], tri.v[0], e1);
+                sub(tri.v[2], tri.v[0], e2);
+                cross(direction, e2, p);
+                const float det = dot(e1, p);
+                if (std::fabs(det) < 1e-12f)
+                    continue;
+                const float inv = 1.f / det;
+                sub(origin, tri.v[0], s);
+                const float u = dot(s, p) * inv;
+                if (u < 0.f || u > 1.f)
+                    continue;
+                cross(s, e1, q);
+                const float v = dot(direction, q) * inv;
+                if (v < 0.f || u + v > 1.f)
+                    continue;
+                const float t = dot(e2, q) * inv;
+                if (t < 0.f || t >= hit.t)
+                    continue;
+                hit.t = t;
+                hit.u = u;
+                hit.v = v;
+                hit.triangle = m_ids[i];
+                found = true;
+            }
+            continue;
+        }
+
+        // Nearer child on top of the stack
+        const uint32_t first = index + 1, second = index + node.offset;
+        const float t0 = intersectBox(m_nodes[first].lo,  m_nodes[first].hi,  origin, invDir, hit.t);
+        const float t1 = intersectBox(m_nodes[second].lo, m_nodes[second].hi, origin, invDir, hit.t);
+        if (t0 >= 0.f && t1 >= 0.f)
+        {
+            stack[top++] = t0 <= t1 ? second : first;
+            stack[top++] = t0 <= t1 ? first : second;
+        }
+        else if (t0 >= 0.f)
+            stack[top++] = first;
+        else if (t1 >= 0.f)
+            stack[top++] = second;
+    }
+    return found;
+}
+
+bool MeshBVH::closestPoint(const float p[3], MeshClosestPoint& result) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    bool found = false;
+    float best2 = result.distance < std::numeric_limits<float>::max() ? result.distance * result.distance : result.distance;
+    uint32_t stack[MaxStackDepth];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const uint32_t index = stack[--top];
+        const Node& node = m_nodes[index];
+        if (boxDistance2(node.lo, node.hi, p) >= best2)
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+            {
+                const Triangle& tri = m_triangles[i];
+                float q[3], d[3];
+                closestPointTriangle(p, tri.v[0], tri.v[1], tri.v[2], q);
+                sub(q, p, d);
+                const float d2 = dot(d, d);
+                if (d2 < best2)
+                {
+                    best2 = d2;
+                    std::copy(q, q + 3, result.point);
+                    result.triangle = m_ids[i];
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        const uint32_t first = index + 1, second = index + node.offset;
+        const float d0 = boxDistance2(m_nodes[first].lo,  m_nodes[first].hi,  p);
+        const float d1 = boxDistance2(m_nodes[second].lo, m_nodes[second].hi, p);
+        stack[top++] = d0 <= d1 ? second : first;
+        stack[top++] = d0 <= d1 ? first : second;
+    }
+    if (found)
+        result.distance = std::sqrt(best2);
+    return found;
+}
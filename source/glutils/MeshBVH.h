@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+class MeshBufferView;
+
+struct MeshRayHit
+{
+    float t = std::numeric_limits<float>::max(); ///< origin + t * direction
+    float u = 0.f, v = 0.f; ///< barycentric coordinates of the second and third vertex
+    size_t triangle = 0;    ///< index of the triangle in the view
+};
+
+struct MeshClosestPoint
+{
+    float point[3] = { 0, 0, 0 };
+    float distance = std::numeric_limits<float>::max();
+    size_t triangle = 0;
+};
+
+/// Bounding volume hierarchy over the triangles of a mesh for ray casts and
+/// closest point queries. Built top-down with binned surface area heuristic
+/// splits, subtrees are built in parallel. Nodes are flattened depth-first
+/// into 32 bytes each, the triangle vertices are copied in leaf order, so
+/// queries do not touch the meshes and the meshes may change afterwards.
+class MeshBVH
+{
+public:
+    /// Rebuilds over all triangles of the view, other primitives are ignored.
+    /// Uses numThreads threads (0 for one per hardware thread).
+    void build(const MeshBufferView& view, unsigned numThreads=0);
+    void clear();
+
+    bool empty() const { return m_nodes.empty(); }
+    size_t numNodes() const { return m_nodes.size(); }
+    size_t numTriangles() const { return m_ids.size(); }
+    size_t bytesAllocated() const;
+
+    /// Nearest intersection with t in [0, hit.t), updates hit. Both faces hit.
+    bool raycast(const float origin[3], const float direction[3], MeshRayHit& hit) const;
+
+    /// Nearest surface point closer than result.distance, updates result
+    bool closestPoint(const float p[3], MeshClosestPoint& result) const;
+
+private:
+    struct Node
+    {
+        float lo[3];
+        uint32_t offset; ///< leaf: first triangle, inner: distance to the second child
+        float hi[3];
+        uint32_t count;  ///< triangles of a leaf, 0 for inner nodes with the first child next
+    };
+    static_assert(sizeof(Node) == 32, "MeshBVH::Node should fill half a cache line");
+
+    struct Triangle
+    {
+        float v[3][3];
+    };
+
+    struct Builder;
+
+    std::vector<Node> m_nodes;
+    std::vector<Triangle> m_triangles; ///< in leaf order
+    std::vector<size_t> m_ids;         ///< triangle in the view per leaf triangle
+};
@@ -1,9 +1,18 @@
 #include "MeshBuffer.h"
+#include <atomic>
 #include <stdexcept>
 
-MeshBuffer::MeshBuffer(MeshPrimitiveType type, MeshVertexAttribute attributes)
+uint64_t MeshBuffer::Version::nextId()
+{
+    // Only ordered by the buffer it is drawn for
+    static std::atomic<uint64_t> counter{ 0 };
+    return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+MeshBuffer::MeshBuffer(MeshPrimitiveType type, MeshVertexAttribute attributes, MeshVertexLayout layout, size_t stride)
     : m_type(type),
-      m_attributes(attributes)
+      m_attributes(attributes),
+      m_layout(layout)
 {
     switch (type)
     {
@@ -13,67 +22,145 @@ MeshBuffer::MeshBuffer(MeshPrimitiveType type, MeshVertexAttribute attributes)
     default:
         throw std::runtime_error("Invalid MeshPrimitiveType");
     }
+
+    if (isInterleaved())
+    {
+        // position, normal, color, uv
+        size_t packed = 3;
+        if (hasNormals()) { m_normalOffset = packed; packed += 3; }
+        if (hasColors ()) { m_colorOffset  = packed; packed += 4; }
+        if (hasUVs    ()) { m_uvOffset     = packed; packed += 2; }
+
+        if (stride != 0 && stride < packed)
+            throw std::runtime_error("Interleaved vertex stride too small for MeshVertexAttributes");
+        m_stride = stride != 0 ? stride : packed;
+        m_vertexArena = MeshArena<float>({ m_stride });
+    }
+    else
+    {
+        // absent attributes get empty streams
+        m_vertexArena = MeshArena<float>({ 3, hasNormals() ? 3u : 0u, hasColors() ? 4u : 0u, hasUVs() ? 2u : 0u });
+    }
+    m_indexArena = MeshArena<unsigned>({ 1 });
+}
+
+void MeshBuffer::resizeVertexStreams(size_t numVerts)
+{
+    if (numVerts > numVerticesAllocated())
+        m_vertexArena.reserveExact(numVerts, numVerticesAllocated());
+}
+
+void MeshBuffer::scatter(const std::vector<float>& data, size_t channels, size_t stream, size_t offset)
+{
+    const size_t n = data.size() / channels;
+    resizeVertexStreams(n);
+    touch();
+    if (n == 0)
+        return;
+
+    if (!isInterleaved())
+    {
+        std::copy(data.begin(), data.end(), m_vertexArena.stream(stream));
+        return;
+    }
+    float* dst = m_vertexArena.stream(0) + offset;
+    for (size_t i = 0; i < n; ++i)
+        std::copy(&data[i * channels], &data[i * channels] + channels, dst + i * m_stride);
 }
 
 void MeshBuffer::resize(size_t numVerts, size_t numPrimitives)
 {
-    if (                numVerts * 3 > m_vertices.size()) m_vertices.resize(numVerts * 3);
-    if (hasNormals() && numVerts * 3 > m_normals .size()) m_normals .resize(numVerts * 3);
-    if (hasColors () && numVerts * 4 > m_colors  .size()) m_colors  .resize(numVerts * 4);
-    if (hasUVs    () && numVerts * 2 > m_uvs     .size()) m_uvs     .resize(numVerts * 2);
-    
+    touch();
+    resizeVertexStreams(numVerts);
+
     size_t num_indices = numPrimitives * NumVertsPerPrimitive;
-    if (num_indices > m_indices.size()) m_indices.resize(num_indices);
+    if (num_indices > numIndicesAllocated())
+        m_indexArena.reserveExact(num_indices, numIndicesAllocated());
 }
 
 void MeshBuffer::ensure(size_t numAdditionalVerts, size_t numAdditionalPrimitives)
 {
-    while ((numVerticesAllocated() - numVertices()) < numAdditionalVerts)
-    {
-                          m_vertices.resize(2 * m_vertices.size());
-        if (hasNormals()) m_normals .resize(2 * m_normals .size());
-        if (hasColors ()) m_colors  .resize(2 * m_colors  .size());
-        if (hasUVs    ()) m_uvs     .resize(2 * m_uvs     .size());
-    }
+    touch();
+    // numVertices() is clamped to the allocation, so keep everything allocated
+    m_vertexArena.grow(numVertices() + numAdditionalVerts, numVerticesAllocated(), m_growthFactor);
 
     size_t num_additional_indices = numAdditionalPrimitives * NumVertsPerPrimitive;
-    while ((numIndicesAllocated() - numIndices()) < num_additional_indices)
-    {
-        m_indices.resize(2 * m_indices.size());
-    }
+    m_indexArena.grow(numIndices() + num_additional_indices, numIndicesAllocated(), m_growthFactor);
+}
+
+void MeshBuffer::reserveExact(size_t numVerts, size_t numPrimitives)
+{
+    touch();
+    numVerts = std::max(numVerts, numVertices());
+    m_vertexArena.reserveExact(numVerts, numVertices());
+
+    const size_t num_indices = std::max(numPrimitives * NumVertsPerPrimitive, numIndices());
+    m_indexArena.reserveExact(num_indices, numIndices());
+}
+
+bool MeshBuffer::setStorage(MeshArena<float> vertices, MeshArena<unsigned> indices)
+{
+    if (vertices.channels() != m_vertexArena.channels() || indices.channels() != m_indexArena.channels())
+        return false;
+    m_vertexArena = std::move(vertices);
+    m_indexArena = std::move(indices);
+    touch();
+    return true;
+}
+
+bool MeshBuffer::swapStorage(MeshBuffer& other)
+{
+    if (m_type != other.m_type || m_attributes != other.m_attributes || m_layout != other.m_layout || m_stride != other.m_stride)
+        return false;
+    m_vertexArena.swap(other.m_vertexArena);
+    m_indexArena.swap(other.m_indexArena);
+    std::swap(m_numVertices, other.m_numVertices);
+    std::swap(m_numIndices, other.m_numIndices);
+    std::swap(m_numSharedVertices, other.m_numSharedVertices);
+    touch();
+    other.touch();
+    return true;
 }
 
 bool MeshBuffer::merge(const MeshBuffer& other)
 {
     if (getPrimitiveType() != other.getPrimitiveType())
         return false;
+    touch();
 
-    const size_t index_ofs = numVertices();
+    // Our shared tail duplicates the head of other
+    const size_t index_ofs = numVertices() - numSharedVertices();
     {
-        const size_t n0 = numVertices();
+        const size_t n0 = index_ofs;
         const size_t n1 = other.numVertices();
 
-        m_vertices.resize(n0 * 3);
-        m_vertices.reserve((n0 + n1) * 3);
-        m_vertices.insert(m_vertices.end(), other.getVertexData(0), other.getVertexData(0) + n1 * 3);
+        m_vertexArena.grow(n0 + n1, n0, m_growthFactor);
 
-        if (hasNormals() && other.hasNormals())
-        {
-            m_normals.resize(n0 * 3);
-            m_normals.reserve((n0 + n1) * 3);
-            m_normals.insert(m_normals.end(), other.getNormalData(0), other.getNormalData(0) + n1 * 3);
-        }
-        if (hasColors() && other.hasColors())
+        const bool same_layout = getLayout() == other.getLayout() && getVertexStride() == other.getVertexStride() && getAttributes() == other.getAttributes();
+        if (same_layout && n1 > 0)
         {
-            m_colors.resize(n0 * 4);
-            m_colors.reserve((n0 + n1) * 4);
-            m_colors.insert(m_colors.end(), other.getColorData(0), other.getColorData(0) + n1 * 4);
+            // copy whole streams
+            auto append = [n0, n1](float* dst, const float* src, size_t stride)
+            {
+                std::copy(src, src + n1 * stride, dst + n0 * stride);
+            };
+
+                                              append(getVertexData(0), other.getVertexData(0), getVertexStride());
+            if (!isInterleaved() && hasNormals()) append(getNormalData(0), other.getNormalData(0), getNormalStride());
+            if (!isInterleaved() && hasColors ()) append(getColorData (0), other.getColorData (0), getColorStride ());
+            if (!isInterleaved() && hasUVs    ()) append(getUVData    (0), other.getUVData    (0), getUVStride    ());
         }
-        if (hasUVs() && other.hasUVs())
+        else
         {
-            m_uvs.resize(n0 * 2);
-            m_uvs.reserve((n0 + n1) * 2);
-            m_uvs.insert(m_uvs.end(), other.getUVData(0), other.getUVData(0) + n1 * 2);
+            // copy per vertex and attribute
+            auto copy = [](const float* src, float* dst, size_t channels) { std::copy(src, src + channels, dst); };
+            for (size_t i = 0; i < n1; ++i)
+            {
+                                                         copy(other.getVertexData(i), getVertexData(n0 + i), 3);
+                if (hasNormals() && other.hasNormals()) copy(other.getNormalData(i), getNormalData(n0 + i), 3);
+                if (hasColors () && other.hasColors ()) copy(other.getColorData (i), getColorData (n0 + i), 4);
+                if (hasUVs    () && other.hasUVs    ()) copy(other.getUVData    (i), getUVData    (n0 + i), 2);
+            }
         }
     }
 
@@ -81,12 +168,18 @@ bool MeshBuffer::merge(const MeshBuffer& other)
         const size_t n0 = numIndices();
         const size_t n1 = other.numIndices();
 
-        m_indices.resize(n0 + n1);
+        m_indexArena.grow(n0 + n1, n0, m_growthFactor);
 
+        unsigned* dst = m_indexArena.stream(0) + n0;
+        const unsigned* src = other.m_indexArena.stream(0);
         for (size_t i = 0; i < n1; ++i)
         {
-            m_indices[n0 + i] = other.m_indices[i] + (unsigned)index_ofs;
+            dst[i] = src[i] + (unsigned)index_ofs;
         }
+        m_numIndices = n0 + n1;
     }
+
+    m_numVertices = index_ofs + other.numVertices();
+    m_numSharedVertices = other.numSharedVertices();
     return true;
 }
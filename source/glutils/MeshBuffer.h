@@ -1,19 +1,24 @@
 #pragma once
 #include <vector>
 #include <cassert>
+#include <cstdint>
 #include <algorithm> // min
 #include <limits>
 
+#include "MeshArena.h"
 #include "MeshBufferTypes.h"
 
 class MeshBuffer
 {
 public:
-    MeshBuffer(MeshPrimitiveType type = MeshPrimitiveType::Triangles, MeshVertexAttribute attributes = MeshVertexAttribute::Normal);
+    /// For MeshVertexLayout::Interleaved a vertex stride (in floats) larger than
+    /// the packed attribute size can be given, e.g. to pad vertices to 64 bytes.
+    MeshBuffer(MeshPrimitiveType type = MeshPrimitiveType::Triangles, MeshVertexAttribute attributes = MeshVertexAttribute::Normal,
+               MeshVertexLayout layout = MeshVertexLayout::Separate, size_t stride = 0);
 
     MeshPrimitiveType getPrimitiveType() const { return m_type; }
     size_t getNumVertsPerPrimitive() const { return NumVertsPerPrimitive; }
-    
+
     MeshVertexAttribute getAttributes() const { return m_attributes; }
 
     bool hasAttribute(MeshVertexAttribute a) const { return has(m_attributes, a); }
@@ -21,50 +26,148 @@ public:
     bool hasColors()  const { return hasAttribute(MeshVertexAttribute::Color);  }
     bool hasUVs()     const { return hasAttribute(MeshVertexAttribute::UV); }
 
+    MeshVertexLayout getLayout() const { return m_layout; }
+    bool isInterleaved() const { return m_layout == MeshVertexLayout::Interleaved; }
+
+    /// Distance in floats between the attributes of consecutive vertices,
+    /// the vertex stride for all attributes in the interleaved layout.
+    size_t getVertexStride() const { return isInterleaved() ? m_stride : 3; }
+    size_t getNormalStride() const { return isInterleaved() ? m_stride : 3; }
+    size_t getColorStride () const { return isInterleaved() ? m_stride : 4; }
+    size_t getUVStride    () const { return isInterleaved() ? m_stride : 2; }
+
+    /// Offset in floats of an attribute inside an interleaved vertex, zero for separate arrays.
+    size_t getNormalOffset() const { return m_normalOffset; }
+    size_t getColorOffset () const { return m_colorOffset; }
+    size_t getUVOffset    () const { return m_uvOffset; }
+
+    /// Grow storage to at least numVerts and numPrimitives, new entries are uninitialized
     void resize(size_t numVerts, size_t numPrimitives);
 
+    /// Grow storage by the growth factor until the additional vertices and
+    /// primitives fit behind numVertices() and numIndices()
     void ensure(size_t numAdditionalVerts, size_t numAdditionalPrimitives);
 
+    /// Reallocate storage to exactly numVerts and numPrimitives (not below the
+    /// current counts), e.g. to trim a buffer after meshing.
+    void reserveExact(size_t numVerts, size_t numPrimitives);
+
+    float getGrowthFactor() const { return m_growthFactor; }
+    void setGrowthFactor(float f) { assert(f > 1.f); m_growthFactor = f; }
+
+    /// Bytes allocated for vertex attributes and indices
+    size_t bytesAllocated() const { return m_vertexArena.bytes() + m_indexArena.bytes(); }
+
     bool merge(const MeshBuffer& other);
-    
-    void setVertices( std::vector<float> v ) { assert(v.size()%3==0); m_vertices = v; }
-    void setNormals ( std::vector<float> n ) { assert(hasNormals() && n.size()%3==0); m_normals = n; }
-    void setColors  ( std::vector<float> c ) { assert(hasColors()  && c.size()%4==0); m_colors  = c; }
-    void setUVs     ( std::vector<float> t ) { assert(hasUVs()     && t.size()%2==0); m_uvs     = t; }
-    void setIndices ( std::vector<unsigned> i ) { m_indices = i; }
 
-    size_t numVerticesAllocated() const { return m_vertices.size() / 3; }
-    size_t numIndicesAllocated () const { return m_indices .size(); }
+    /// setVertices() and setIndices() reallocate to the given size, the other
+    /// attributes have to be set afterwards.
+    void setVertices( const std::vector<float>& v ) { assert(v.size()%3==0);                m_vertexArena.reserveExact(v.size()/3, v.size()/3); scatter(v, 3, PositionStream, 0); }
+    void setNormals ( const std::vector<float>& n ) { assert(hasNormals() && n.size()%3==0); scatter(n, 3, NormalStream, m_normalOffset); }
+    void setColors  ( const std::vector<float>& c ) { assert(hasColors()  && c.size()%4==0); scatter(c, 4, ColorStream,  m_colorOffset); }
+    void setUVs     ( const std::vector<float>& t ) { assert(hasUVs()     && t.size()%2==0); scatter(t, 2, UVStream,     m_uvOffset); }
+    void setIndices ( const std::vector<unsigned>& i ) { m_indexArena.reserveExact(i.size(), 0); std::copy(i.begin(), i.end(), m_indexArena.stream(0)); touch(); }
+
+    size_t numVerticesAllocated() const { return m_vertexArena.capacity(); }
+    size_t numIndicesAllocated () const { return m_indexArena .capacity(); }
 
     size_t numVertices() const { return std::min(m_numVertices,numVerticesAllocated()); }
     size_t numIndices()  const { return std::min(m_numIndices, numIndicesAllocated ()); }
 
-    void setNumVertices( size_t n ) { m_numVertices = n; }
-    void setNumIndices ( size_t n ) { m_numIndices  = n; }
-    
-          float*    getVertexData( size_t vidx=0 )       { assert(3*vidx<m_vertices.size()); return m_vertices.data() + 3*vidx; }
-          float*    getNormalData( size_t vidx=0 )       { assert(3*vidx<m_normals .size()); return m_normals .data() + 3*vidx; }
-          float*    getUVData    ( size_t vidx=0 )       { assert(2*vidx<m_uvs     .size()); return m_uvs     .data() + 2*vidx; }
-          float*    getColorData ( size_t vidx=0 )       { assert(4*vidx<m_colors  .size()); return m_colors  .data() + 4*vidx; }
-          unsigned* getIndexData ( size_t pidx=0 )       { assert(NumVertsPerPrimitive*pidx<m_indices .size()); return m_indices .data() + NumVertsPerPrimitive*pidx; }
-    
-    const float*    getVertexData( size_t vidx=0 ) const { assert(3*vidx<m_vertices.size()); return m_vertices.data() + 3*vidx; }
-    const float*    getNormalData( size_t vidx=0 ) const { assert(3*vidx<m_normals .size()); return m_normals .data() + 3*vidx; }
-    const float*    getUVData    ( size_t vidx=0 ) const { assert(2*vidx<m_uvs     .size()); return m_uvs     .data() + 2*vidx; }
-    const float*    getColorData ( size_t vidx=0 ) const { assert(4*vidx<m_colors  .size()); return m_colors  .data() + 4*vidx; }
-    const unsigned* getIndexData ( size_t pidx=0 ) const { assert(NumVertsPerPrimitive*pidx<m_indices .size()); return m_indices .data() + NumVertsPerPrimitive*pidx; }
-    
+    void setNumVertices( size_t n ) { m_numVertices = n; touch(); }
+    void setNumIndices ( size_t n ) { m_numIndices  = n; touch(); }
+
+    /// Number of trailing vertices which are identical copies of the leading
+    /// vertices of the next mesh part, e.g. the seam between stitched slices.
+    /// merge() drops them and lets their indices refer to the next part.
+    size_t numSharedVertices() const { return std::min(m_numSharedVertices, numVertices()); }
+    void setNumSharedVertices( size_t n ) { m_numSharedVertices = n; touch(); }
+
+    /// Renewed by all member functions changing the counts or the storage,
+    /// and by copies and assignments. Unique within the process, so a
+    /// (buffer, version) pair never repeats, even for a buffer reassigned or
+    /// allocated at the address of a freed one. Call touch() after writing
+    /// through the data pointers, so that derived data like MeshStatsCache
+    /// is recomputed.
+    uint64_t version() const { return m_version.value(); }
+    void touch() { m_version.increment(); }
+
+          float*    getVertexData( size_t vidx=0 )       { return attributeData(m_vertexArena, PositionStream, 0,              getVertexStride(), vidx); }
+          float*    getNormalData( size_t vidx=0 )       { return attributeData(m_vertexArena, NormalStream,   m_normalOffset, getNormalStride(), vidx); }
+          float*    getUVData    ( size_t vidx=0 )       { return attributeData(m_vertexArena, UVStream,       m_uvOffset,     getUVStride    (), vidx); }
+          float*    getColorData ( size_t vidx=0 )       { return attributeData(m_vertexArena, ColorStream,    m_colorOffset,  getColorStride (), vidx); }
+          unsigned* getIndexData ( size_t pidx=0 )       { return attributeData(m_indexArena,  0,              0,              NumVertsPerPrimitive, pidx); }
+
+    const float*    getVertexData( size_t vidx=0 ) const { return attributeData(m_vertexArena, PositionStream, 0,              getVertexStride(), vidx); }
+    const float*    getNormalData( size_t vidx=0 ) const { return attributeData(m_vertexArena, NormalStream,   m_normalOffset, getNormalStride(), vidx); }
+    const float*    getUVData    ( size_t vidx=0 ) const { return attributeData(m_vertexArena, UVStream,       m_uvOffset,     getUVStride    (), vidx); }
+    const float*    getColorData ( size_t vidx=0 ) const { return attributeData(m_vertexArena, ColorStream,    m_colorOffset,  getColorStride (), vidx); }
+    const unsigned* getIndexData ( size_t pidx=0 ) const { return attributeData(m_indexArena,  0,              0,              NumVertsPerPrimitive, pidx); }
+
+    /// Raw storage, e.g. for MeshCache
+    const MeshArena<float>&    getVertexArena() const { return m_vertexArena; }
+    const MeshArena<unsigned>& getIndexArena () const { return m_indexArena; }
+
+    /// Replace the storage by arenas with the same streams, e.g. arenas over a
+    /// memory-mapped MeshCache. Counts have to be set separately.
+    bool setStorage(MeshArena<float> vertices, MeshArena<unsigned> indices);
+
+    /// Exchange storage and counts with a buffer of the same format, without
+    /// copying, e.g. to hand a finished mesh over. Fails for other formats.
+    bool swapStorage(MeshBuffer& other);
+
 private:
+    /// Arena streams, the interleaved layout only uses PositionStream
+    enum { PositionStream = 0, NormalStream = 1, ColorStream = 2, UVStream = 3 };
+
+    template<class Arena>
+    static auto attributeData(Arena& arena, size_t stream, size_t offset, size_t stride, size_t vidx) -> decltype(arena.stream(0))
+    {
+        if (arena.numStreams() == 1) stream = 0;
+        assert(vidx==0 || vidx<arena.capacity()*arena.channels(stream)/stride);
+        return arena.stream(stream) + stride*vidx + offset;
+    }
+
+    void resizeVertexStreams(size_t numVerts);
+    void scatter(const std::vector<float>& data, size_t channels, size_t stream, size_t offset);
+
     MeshPrimitiveType m_type;
     MeshVertexAttribute m_attributes;
+    MeshVertexLayout m_layout;
     size_t NumVertsPerPrimitive;
 
-    std::vector<float>    m_vertices;
-    std::vector<float>    m_normals;
-    std::vector<float>    m_uvs;
-    std::vector<float>    m_colors;
-    std::vector<unsigned> m_indices;
+    size_t m_stride = 3;       ///< Interleaved vertex size in floats
+    size_t m_normalOffset = 0; ///< Interleaved attribute offsets in floats
+    size_t m_colorOffset = 0;
+    size_t m_uvOffset = 0;
+
+    MeshArena<float>    m_vertexArena; ///< Attribute streams or all interleaved attributes
+    MeshArena<unsigned> m_indexArena;
+    float m_growthFactor = 2.f;
 
     size_t m_numVertices = std::numeric_limits<size_t>::max();
     size_t m_numIndices  = std::numeric_limits<size_t>::max();
+    size_t m_numSharedVertices = 0;
+
+    /// Process-wide unique id, drawn on construction, copy and assignment,
+    /// and a plain count of the changes since, so that touch() in meshing
+    /// loops does not contend on a shared atomic. A new id is drawn when
+    /// the count overflows.
+    struct Version
+    {
+        static constexpr unsigned CountBits = 24;
+        static uint64_t nextId();
+
+        Version() = default;
+        Version(const Version&) {}
+        Version& operator=(const Version&) { renew(); return *this; }
+
+        void renew() { id = nextId(); count = 0; }
+        void increment() { if (++count >> CountBits) renew(); }
+        uint64_t value() const { return id << CountBits | count; }
+
+        uint64_t id = nextId();
+        uint64_t count = 0;
+    };
+    Version m_version;
 };
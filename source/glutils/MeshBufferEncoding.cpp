@@ -0,0 +1,266 @@
+#include "MeshBufferEncoding.h"
+#include "MeshBuffer.h"
+#include <cmath>
+#include <cstring> // memcpy
+
+uint16_t floatToHalf(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const int32_t  exp  = static_cast<int32_t>((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = x & 0x7fffff;
+
+    if (((x >> 23) & 0xff) == 0xff) // inf, nan
+        return static_cast<uint16_t>(sign | 0x7c00 | (mant ? 0x200 : 0));
+    if (exp >= 0x1f) // overflow to inf
+        return static_cast<uint16_t>(sign | 0x7c00);
+    if (exp <= 0)
+    {
+        if (exp < -10) // underflow to zero
+            return static_cast<uint16_t>(sign);
+        // denormal, round to nearest
+        mant |= 0x800000;
+        const uint32_t shift = static_cast<uint32_t>(14 - exp);
+        uint32_t h = mant >> shift;
+        if ((mant >> (shift - 1)) & 1) ++h;
+        return static_cast<uint16_t>(sign | h);
+    }
+
+    // normal, round to nearest (may carry into the exponent which is fine)
+    uint32_t h = sign | (static_cast<uint32_t>(exp) << 10) | (mant >> 13);
+    if (mant & 0x1000) ++h;
+    return static_cast<uint16_t>(h);
+}
+
+float halfToFloat(uint16_t h)
+{
+    const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exp  = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+
+    uint32_t x;
+    if (exp == 0x1f)
+    {
+        x = sign | 0x7f800000 | (mant << 13);
+    }
+    else if (exp == 0)
+    {
+        if (mant == 0)
+        {
+            x = sign;
+        }
+        else
+        {
+            // normalize denormal
+            int e = -1;
+            do { ++e; mant <<= 1; } while ((mant & 0x400) == 0);
+            x = sign | ((127 - 15 - e) << 23) | ((mant & 0x3ff) << 13);
+        }
+    }
+    else
+    {
+        x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+namespace {
+
+inline float clampSigned(float v) { return v < -1.f ? -1.f : (v > 1.f ? 1.f : v); }
+inline float clampUnsigned(float v) { return v < 0.f ? 0.f : (v > 1.f ? 1.f : v); }
+
+inline int32_t toSNorm(float v, int32_t maxval) { return static_cast<int32_t>(std::lround(clampSigned(v) * maxval)); }
+inline float fromSNorm(int32_t v, int32_t maxval) { return std::max(-1.f, v / static_cast<float>(maxval)); }
+
+inline uint32_t toUNorm(float v, uint32_t maxval) { return static_cast<uint32_t>(std::lround(clampUnsigned(v) * maxval)); }
+
+} // namespace
+
+uint32_t packNormal2101010(const float n[3])
+{
+    uint32_t packed = 0;
+    for (int i = 0; i < 3; ++i)
+        packed |= (static_cast<uint32_t>(toSNorm(n[i], 511)) & 0x3ff) << (10 * i);
+    return packed;
+}
+
+void unpackNormal2101010(uint32_t packed, float n[3])
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        int32_t v = static_cast<int32_t>((packed >> (10 * i)) & 0x3ff);
+        if (v & 0x200) v -= 0x400; // sign extend
+        n[i] = fromSNorm(v, 511);
+    }
+}
+
+void packNormalOctahedral(const float n[3], int16_t oct[2])
+{
+    const float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    float x = l1 > 0.f ? n[0] / l1 : 0.f;
+    float y = l1 > 0.f ? n[1] / l1 : 0.f;
+    if (n[2] < 0.f)
+    {
+        const float ox = x, oy = y;
+        x = (1.f - std::fabs(oy)) * (ox >= 0.f ? 1.f : -1.f);
+        y = (1.f - std::fabs(ox)) * (oy >= 0.f ? 1.f : -1.f);
+    }
+    oct[0] = static_cast<int16_t>(toSNorm(x, 32767));
+    oct[1] = static_cast<int16_t>(toSNorm(y, 32767));
+}
+
+void unpackNormalOctahedral(const int16_t oct[2], float n[3])
+{
+    float x = fromSNorm(oct[0], 32767);
+    float y = fromSNorm(oct[1], 32767);
+    float z = 1.f - std::fabs(x) - std::fabs(y);
+    if (z < 0.f)
+    {
+        const float ox = x, oy = y;
+        x = (1.f - std::fabs(oy)) * (ox >= 0.f ? 1.f : -1.f);
+        y = (1.f - std::fabs(ox)) * (oy >= 0.f ? 1.f : -1.f);
+    }
+    const float length = std::sqrt(x*x + y*y + z*z);
+    n[0] = x / length;
+    n[1] = y / length;
+    n[2] = z / length;
+}
+
+uint32_t packColorRGBA8(const float c[4])
+{
+    return toUNorm(c[0], 255) | (toUNorm(c[1], 255) << 8) | (toUNorm(c[2], 255) << 16) | (toUNorm(c[3], 255) << 24);
+}
+
+void unpackColorRGBA8(uint32_t packed, float c[4])
+{
+    for (int i = 0; i < 4; ++i)
+        c[i] = ((packed >> (8 * i)) & 0xff) / 255.f;
+}
+
+MeshPositionQuantization computePositionQuantization(const MeshBuffer& mb, MeshPositionFormat format)
+{
+    MeshPositionQuantization q;
+    const size_t n = mb.numVertices();
+    if (format != MeshPositionFormat::UNorm16 || n == 0)
+        return q;
+
+    float bbmin[3], bbmax[3];
+    const float* v = mb.getVertexData(0);
+    for (int k = 0; k < 3; ++k)
+        bbmin[k] = bbmax[k] = v[k];
+    for (size_t i = 1; i < n; ++i)
+    {
+        v = mb.getVertexData(i);
+        for (int k = 0; k < 3; ++k)
+        {
+            bbmin[k] = std::min(bbmin[k], v[k]);
+            bbmax[k] = std::max(bbmax[k], v[k]);
+        }
+    }
+
+    for (int k = 0; k < 3; ++k)
+    {
+        q.offset[k] = bbmin[k];
+        q.scale[k] = bbmax[k] > bbmin[k] ? bbmax[k] - bbmin[k] : 1.f;
+    }
+    return q;
+}
+
+MeshPackedLayout::MeshPackedLayout(const MeshVertexFormat& format, MeshVertexAttribute attributes)
+{
+    stride = format.position == MeshPositionFormat::Float ? 3 * sizeof(float) : 4 * sizeof(uint16_t);
+    if (has(attributes, MeshVertexAttribute::Normal))
+    {
+        normalOffset = stride;
+        stride += format.normal == MeshNormalFormat::Float ? 3 * sizeof(float) : sizeof(uint32_t);
+    }
+    if (has(attributes, MeshVertexAttribute::Color))
+    {
+        colorOffset = stride;
+        stride += format.color == MeshColorFormat::Float ? 4 * sizeof(float) : sizeof(uint32_t);
+    }
+}
+
+void packVertices(const MeshBuffer& mb, const MeshVertexFormat& format, const MeshPositionQuantization& q,
+                  size_t first, size_t count, void* dst)
+{
+    const MeshPackedLayout layout(format, mb.getAttributes());
+    uint8_t* out = static_cast<uint8_t*>(dst);
+
+    for (size_t i = first; i < first + count; ++i, out += layout.stride)
+    {
+        const float* v = mb.getVertexData(i);
+        switch (format.position)
+        {
+        case MeshPositionFormat::Float:
+            std::memcpy(out, v, 3 * sizeof(float));
+            break;
+        case MeshPositionFormat::Half:
+        {
+            const uint16_t h[4] = { floatToHalf(v[0]), floatToHalf(v[1]), floatToHalf(v[2]), 0 };
+            std::memcpy(out, h, sizeof(h));
+            break;
+        }
+        case MeshPositionFormat::UNorm16:
+        {
+            uint16_t u[4] = { 0, 0, 0, 0 };
+            for (int k = 0; k < 3; ++k)
+                u[k] = static_cast<uint16_t>(toUNorm((v[k] - q.offset[k]) / q.scale[k], 65535));
+            std::memcpy(out, u, sizeof(u));
+            break;
+        }
+        }
+
+        if (mb.hasNormals())
+        {
+            const float* n = mb.getNormalData(i);
+            uint8_t* p = out + layout.normalOffset;
+            switch (format.normal)
+            {
+            case MeshNormalFormat::Float:
+                std::memcpy(p, n, 3 * sizeof(float));
+                break;
+            case MeshNormalFormat::Int2101010:
+            {
+                const uint32_t packed = packNormal2101010(n);
+                std::memcpy(p, &packed, sizeof(packed));
+                break;
+            }
+            case MeshNormalFormat::Octahedral:
+            {
+                int16_t oct[2];
+                packNormalOctahedral(n, oct);
+                std::memcpy(p, oct, sizeof(oct));
+                break;
+            }
+            }
+        }
+
+        if (mb.hasColors())
+        {
+            const float* c = mb.getColorData(i);
+            uint8_t* p = out + layout.colorOffset;
+            if (format.color == MeshColorFormat::Float)
+            {
+                std::memcpy(p, c, 4 * sizeof(float));
+            }
+            else
+            {
+                const uint32_t packed = packColorRGBA8(c);
+                std::memcpy(p, &packed, sizeof(packed));
+            }
+        }
+    }
+}
+
+void packIndices16(const MeshBuffer& mb, size_t first, size_t count, uint16_t* dst)
+{
+    const unsigned* indices = mb.getIndexData() + first;
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = static_cast<uint16_t>(indices[i]);
+}
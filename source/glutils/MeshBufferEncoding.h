@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "MeshBufferTypes.h"
+
+class MeshBuffer;
+
+// Scalar encodings
+
+uint16_t floatToHalf(float f);
+float halfToFloat(uint16_t h);
+
+/// Signed normalized 10:10:10:2 as GL_INT_2_10_10_10_REV, w is set to 0
+uint32_t packNormal2101010(const float n[3]);
+void unpackNormal2101010(uint32_t packed, float n[3]);
+
+/// Octahedral mapping of a unit vector to 2x16-bit signed normalized
+void packNormalOctahedral(const float n[3], int16_t oct[2]);
+void unpackNormalOctahedral(const int16_t oct[2], float n[3]);
+
+uint32_t packColorRGBA8(const float c[4]);
+void unpackColorRGBA8(uint32_t packed, float c[4]);
+
+// Packed vertices
+
+/// Position = offset + scale * stored value, for MeshPositionFormat::UNorm16
+/// the bounding box is mapped to [0,1]^3, identity for other formats.
+struct MeshPositionQuantization
+{
+    float offset[3] = { 0.f, 0.f, 0.f };
+    float scale [3] = { 1.f, 1.f, 1.f };
+};
+
+MeshPositionQuantization computePositionQuantization(const MeshBuffer& mb, MeshPositionFormat format);
+
+/// Byte layout of a packed interleaved vertex with position, normal and color
+/// (as present in attributes). UVs are not packed. Attributes start at 4-byte
+/// boundaries, 16-bit positions are padded to 4 components.
+struct MeshPackedLayout
+{
+    MeshPackedLayout(const MeshVertexFormat& format, MeshVertexAttribute attributes);
+
+    size_t stride = 0;       ///< bytes per vertex
+    size_t normalOffset = 0; ///< bytes
+    size_t colorOffset = 0;  ///< bytes
+};
+
+/// Pack vertices [first,first+count) into dst according to MeshPackedLayout
+void packVertices(const MeshBuffer& mb, const MeshVertexFormat& format, const MeshPositionQuantization& q,
+                  size_t first, size_t count, void* dst);
+
+void packIndices16(const MeshBuffer& mb, size_t first, size_t count, uint16_t* dst);
@@ -0,0 +1,65 @@
+#include "MeshBufferHash.h"
+#include "MeshBuffer.h"
+#include "MeshBufferView.h"
+#include <cstring> // memcpy
+
+namespace {
+
+// FNV-1a variant processing 32-bit words instead of single bytes
+constexpr uint64_t FNVOffsetBasis = 0xcbf29ce484222325ull;
+constexpr uint64_t FNVPrime       = 0x100000001b3ull;
+
+inline void hashWord(uint64_t& h, uint32_t w)
+{
+    h = (h ^ w) * FNVPrime;
+}
+
+inline void hashFloats(uint64_t& h, const float* data, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t w;
+        std::memcpy(&w, data + i, sizeof(w));
+        hashWord(h, w);
+    }
+}
+
+} // namespace
+
+uint64_t hashMeshBuffer(const MeshBuffer& mb)
+{
+    return hashMeshBuffers({ &mb });
+}
+
+uint64_t hashMeshBuffers(const std::vector<const MeshBuffer*>& parts)
+{
+    return hashMeshBuffers(MeshBufferView(parts));
+}
+
+uint64_t hashMeshBuffers(const MeshBufferView& view)
+{
+    uint64_t h = FNVOffsetBasis;
+
+    // Vertices, interleaved per vertex so that the hash does not depend on the storage layout
+    for (const auto& part : view.parts())
+    {
+        const MeshBuffer* mb = part.mesh;
+        for (size_t i = 0; i < part.numVertices; ++i)
+        {
+                                hashFloats(h, mb->getVertexData(i), 3);
+            if (mb->hasNormals()) hashFloats(h, mb->getNormalData(i), 3);
+            if (mb->hasColors ()) hashFloats(h, mb->getColorData (i), 4);
+            if (mb->hasUVs    ()) hashFloats(h, mb->getUVData    (i), 2);
+        }
+    }
+
+    // Indices with the offsets MeshBuffer::merge() would apply
+    for (const auto& part : view.parts())
+    {
+        const unsigned* indices = part.numIndices > 0 ? part.mesh->getIndexData() : nullptr;
+        for (size_t i = 0; i < part.numIndices; ++i)
+            hashWord(h, static_cast<uint32_t>(indices[i] + part.baseVertex));
+    }
+
+    return h;
+}
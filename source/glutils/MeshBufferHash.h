@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+class MeshBuffer;
+class MeshBufferView;
+
+/// Content hash over the used vertex attributes and indices of a mesh.
+/// Multiple buffers are hashed as if they were merged via MeshBuffer::merge()
+/// in the given order, i.e. the result does not depend on how a mesh is split
+/// into parts as long as the concatenated output is the same.
+uint64_t hashMeshBuffer(const MeshBuffer& mb);
+uint64_t hashMeshBuffers(const std::vector<const MeshBuffer*>& parts);
+uint64_t hashMeshBuffers(const MeshBufferView& view);
@@ -1,31 +1,1312 @@
 #include "MeshBufferIO.h"
 #include "MeshBuffer.h"
+#include "MeshBufferView.h"
+#include "MeshBufferEncoding.h" // packColorRGBA8()
+#include <utils/MappedFile.h>
+#include <utils/ParallelFor.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring> // memcpy
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 
-void writeOBJ(std::ostream& os, const MeshBuffer& mb)
+namespace {
+
+/// Uninitialized output buffer, reused across chunks
+struct TextBuffer
+{
+    std::unique_ptr<char[]> data;
+    size_t capacity = 0;
+    size_t size = 0;
+
+    char* reserve(size_t n)
+    {
+        if (n > capacity)
+        {
+            data.reset(new char[n]);
+            capacity = n;
+        }
+        return data.get();
+    }
+};
+
+inline char* appendFloat(char* p, float f)
+{
+    // shortest representation that round-trips, at most 15 characters for float
+    return std::to_chars(p, p + 16, f).ptr;
+}
+
+inline char* appendIndex(char* p, size_t i)
+{
+    return std::to_chars(p, p + 20, i).ptr;
+}
+
+inline char* appendVec3(char* p, const char* prefix, size_t prefixLength, const float* v)
+{
+    for (size_t i = 0; i < prefixLength; ++i)
+        *p++ = prefix[i];
+    p = appendFloat(p, v[0]); *p++ = ' ';
+    p = appendFloat(p, v[1]); *p++ = ' ';
+    p = appendFloat(p, v[2]); *p++ = '\n';
+    return p;
+}
+
+/// Range of lines of one part
+struct OBJChunk
+{
+    enum Kind { Positions, Normals, Faces };
+
+    Kind kind;
+    const MeshBufferView::Part* part;
+    size_t first;
+    size_t count;
+};
+
+constexpr size_t OBJChunkSize = 1 << 16; ///< lines
+
+void formatOBJChunk(const OBJChunk& chunk, size_t numVertsPerPrimitive, bool normals, TextBuffer& buf)
+{
+    const MeshBuffer* mb = chunk.part->mesh;
+    const size_t end = chunk.first + chunk.count;
+    char* p = nullptr;
+    switch (chunk.kind)
+    {
+    case OBJChunk::Positions:
+        p = buf.reserve(chunk.count * 64);
+        for (size_t i = chunk.first; i < end; ++i)
+            p = appendVec3(p, "v ", 2, mb->getVertexData(i));
+        break;
+
+    case OBJChunk::Normals:
+        p = buf.reserve(chunk.count * 64);
+        for (size_t i = chunk.first; i < end; ++i)
+            p = appendVec3(p, "vn ", 3, mb->getNormalData(i));
+        break;
+
+    case OBJChunk::Faces:
+    {
+        const size_t m = numVertsPerPrimitive;
+        const size_t ofs = chunk.part->baseVertex + 1; // OBJ indices are 1-based
+        p = buf.reserve(chunk.count * (m * 48 + 8));
+        for (size_t i = chunk.first; i < end; ++i)
+        {
+            const unsigned* f = mb->getIndexData(i);
+            *p++ = 'f';
+            for (size_t j = 0; j < m; ++j)
+            {
+                *p++ = ' ';
+                p = appendIndex(p, f[j] + ofs);
+                if (normals)
+                {
+                    *p++ = '/'; *p++ = '/';
+                    p = appendIndex(p, f[j] + ofs);
+                }
+            }
+            *p++ = '\n';
+        }
+        break;
+    }
+    }
+    buf.size = static_cast<size_t>(p - buf.data.get());
+}
+
+} // namespace
+
+void writeOBJ(std::ostream& os, const MeshBuffer& mb, unsigned numThreads)
+{
+    writeOBJ(os, MeshBufferView(mb), numThreads);
+}
+
+void writeOBJ(std::ostream& os, const MeshBufferView& view, unsigned numThreads)
+{
+    const bool normals = view.hasNormals();
+    const size_t m = view.getNumVertsPerPrimitive();
+
+    // Positions, normals and faces of all parts, in file order
+    std::vector<OBJChunk> chunks;
+    auto addChunks = [&chunks](OBJChunk::Kind kind, const MeshBufferView::Part& part, size_t count)
+    {
+        for (size_t first = 0; first < count; first += OBJChunkSize)
+            chunks.push_back({ kind, &part, first, std::min(OBJChunkSize, count - first) });
+    };
+    for (const auto& part : view.parts())
+        addChunks(OBJChunk::Positions, part, part.numVertices);
+    if (normals)
+        for (const auto& part : view.parts())
+            addChunks(OBJChunk::Normals, part, part.numVertices);
+    for (const auto& part : view.parts())
+        addChunks(OBJChunk::Faces, part, part.numIndices / m);
+
+    // Format a batch of chunks in parallel, then write them in order
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<TextBuffer> buffers(numThreads);
+    for (size_t batch = 0; batch < chunks.size(); batch += numThreads)
+    {
+        const size_t n = std::min<size_t>(numThreads, chunks.size() - batch);
+        parallelFor(n, numThreads, [&](size_t i)
+        {
+            formatOBJChunk(chunks[batch + i], m, normals, buffers[i]);
+        });
+        for (size_t i = 0; i < n; ++i)
+            os.write(buffers[i].data.get(), static_cast<std::streamsize>(buffers[i].size));
+    }
+}
+
+namespace {
+
+bool isLittleEndian()
+{
+    const uint16_t one = 1;
+    uint8_t first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+/// Records are staged in chunks of this many elements for bulk writes
+constexpr size_t BinaryChunkSize = 1 << 14;
+
+template<class T>
+inline uint8_t* put(uint8_t* p, T value)
+{
+    std::memcpy(p, &value, sizeof(T));
+    return p + sizeof(T);
+}
+
+inline uint8_t* putFloats(uint8_t* p, const float* v, size_t n)
+{
+    std::memcpy(p, v, n * sizeof(float));
+    return p + n * sizeof(float);
+}
+
+template<class T>
+inline T get(const uint8_t* p)
+{
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+void write(std::ostream& os, const std::vector<uint8_t>& buf, size_t size)
+{
+    os.write(reinterpret_cast<const char*>(buf.data()), static_cast<std::streamsize>(size));
+}
+
+bool read(std::istream& is, std::vector<uint8_t>& buf, size_t size)
+{
+    buf.resize(size);
+    is.read(reinterpret_cast<char*>(buf.data()), static_cast<std::streamsize>(size));
+    return static_cast<size_t>(is.gcount()) == size;
+}
+
+// PLY
+
+enum class PLYType { Unknown, Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+PLYType plyType(const std::string& name)
+{
+    if (name == "char"   || name == "int8"   ) return PLYType::Int8;
+    if (name == "uchar"  || name == "uint8"  ) return PLYType::UInt8;
+    if (name == "short"  || name == "int16"  ) return PLYType::Int16;
+    if (name == "ushort" || name == "uint16" ) return PLYType::UInt16;
+    if (name == "int"    || name == "int32"  ) return PLYType::Int32;
+    if (name == "uint"   || name == "uint32" ) return PLYType::UInt32;
+    if (name == "float"  || name == "float32") return PLYType::Float32;
+    if (name == "double" || name == "float64") return PLYType::Float64;
+    return PLYType::Unknown;
+}
+
+size_t plySize(PLYType type)
+{
+    switch (type)
+    {
+    case PLYType::Int8:  case PLYType::UInt8:   return 1;
+    case PLYType::Int16: case PLYType::UInt16:  return 2;
+    case PLYType::Int32: case PLYType::UInt32: case PLYType::Float32: return 4;
+    case PLYType::Float64: return 8;
+    default: return 0;
+    }
+}
+
+/// Scalar as float, integer colors are normalized by the caller
+float plyValue(const uint8_t* p, PLYType type)
+{
+    switch (type)
+    {
+    case PLYType::Int8:    return static_cast<float>(get<int8_t>(p));
+    case PLYType::UInt8:   return static_cast<float>(get<uint8_t>(p));
+    case PLYType::Int16:   return static_cast<float>(get<int16_t>(p));
+    case PLYType::UInt16:  return static_cast<float>(get<uint16_t>(p));
+    case PLYType::Int32:   return static_cast<float>(get<int32_t>(p));
+    case PLYType::UInt32:  return static_cast<float>(get<uint32_t>(p));
+    case PLYType::Float32: return get<float>(p);
+    case PLYType::Float64: return static_cast<float>(get<double>(p));
+    default: return 0.f;
+    }
+}
+
+unsigned plyIndex(const uint8_t* p, PLYType type)
+{
+    switch (type)
+    {
+    case PLYType::Int8:  case PLYType::UInt8:  return get<uint8_t>(p);
+    case PLYType::Int16: case PLYType::UInt16: return get<uint16_t>(p);
+    default: return get<uint32_t>(p);
+    }
+}
+
+struct PLYProperty
+{
+    std::string name;
+    PLYType type = PLYType::Unknown;
+    size_t offset = 0;                     ///< bytes, in vertex record
+    PLYType countType = PLYType::Unknown;  ///< for list properties
+};
+
+struct PLYElement
+{
+    std::string name;
+    size_t count = 0;
+    std::vector<PLYProperty> properties;
+    size_t size = 0; ///< bytes per vertex record
+};
+
+/// Vertex properties written by writePLY()
+struct PLYVertexFormat
+{
+    bool normals = false;
+    bool colors = false;
+    bool uvs = false;
+
+    size_t size() const { return 12 + (normals ? 12 : 0) + (colors ? 4 : 0) + (uvs ? 8 : 0); }
+};
+
+/// countWidth > 0 pads the counts with zeros, so that they can be patched later
+void writePLYHeader(std::ostream& os, const PLYVertexFormat& format, size_t numVertices, size_t numFaces, int countWidth=0)
+{
+    const char fill = os.fill('0');
+    os << "ply\n"
+       << "format binary_little_endian 1.0\n"
+       << "comment gltoys\n"
+       << "element vertex " << std::setw(countWidth) << numVertices << "\n"
+       << "property float x\nproperty float y\nproperty float z\n";
+    if (format.normals) os << "property float nx\nproperty float ny\nproperty float nz\n";
+    if (format.colors)  os << "property uchar red\nproperty uchar green\nproperty uchar blue\nproperty uchar alpha\n";
+    if (format.uvs)     os << "property float s\nproperty float t\n";
+    os << "element face " << std::setw(countWidth) << numFaces << "\n"
+       << "property list uchar uint vertex_indices\n"
+       << "end_header\n";
+    os.fill(fill);
+}
+
+/// Vertex records of mb in [first,end)
+void writePLYVertices(std::ostream& os, const MeshBuffer& mb, size_t first, size_t end, const PLYVertexFormat& format, std::vector<uint8_t>& buf)
+{
+    buf.resize(std::max(buf.size(), BinaryChunkSize * format.size()));
+    for (; first < end; first += BinaryChunkSize)
+    {
+        const size_t last = std::min(first + BinaryChunkSize, end);
+        uint8_t* p = buf.data();
+        for (size_t i = first; i < last; ++i)
+        {
+                                p = putFloats(p, mb.getVertexData(i), 3);
+            if (format.normals) p = putFloats(p, mb.getNormalData(i), 3);
+            if (format.colors)  p = put(p, packColorRGBA8(mb.getColorData(i)));
+            if (format.uvs)     p = putFloats(p, mb.getUVData(i), 2);
+        }
+        write(os, buf, static_cast<size_t>(p - buf.data()));
+    }
+}
+
+/// Face records with m indices each, offset by baseVertex
+void writePLYFaces(std::ostream& os, const unsigned* indices, size_t numFaces, size_t m, size_t baseVertex, std::vector<uint8_t>& buf)
+{
+    buf.resize(std::max(buf.size(), BinaryChunkSize * (1 + m * sizeof(uint32_t))));
+    for (size_t first = 0; first < numFaces; first += BinaryChunkSize)
+    {
+        const size_t end = std::min(first + BinaryChunkSize, numFaces);
+        uint8_t* p = buf.data();
+        for (size_t i = first * m; i < end * m; i += m)
+        {
+            p = put(p, static_cast<uint8_t>(m));
+            for (size_t j = 0; j < m; ++j)
+                p = put(p, static_cast<uint32_t>(indices[i + j] + baseVertex));
+        }
+        write(os, buf, static_cast<size_t>(p - buf.data()));
+    }
+}
+
+} // namespace
+
+bool writePLY(std::ostream& os, const MeshBufferView& view)
 {
-    const std::string endl = "\n";
+    if (!isLittleEndian())
+        return false;
+
+    PLYVertexFormat format;
+    format.normals = view.hasNormals();
+    format.colors  = view.hasColors();
+    format.uvs     = view.hasUVs();
+    const size_t m = view.getNumVertsPerPrimitive();
+    writePLYHeader(os, format, view.numVertices(), view.numIndices() / m);
 
-    const size_t numVertices = mb.numVertices();
-    for (size_t i = 0; i < numVertices; ++i)
+    std::vector<uint8_t> buf;
+    for (const auto& part : view.parts())
+        writePLYVertices(os, *part.mesh, 0, part.numVertices, format, buf);
+
+    for (const auto& part : view.parts())
     {
-        const float* v = mb.getVertexData(i);
-        os << "v " << v[0] << " " << v[1] << " " << v[2] << endl;
+        const size_t numPartFaces = part.numIndices / m;
+        if (numPartFaces > 0)
+            writePLYFaces(os, part.mesh->getIndexData(), numPartFaces, m, part.baseVertex, buf);
     }
 
-    for (size_t i = 0; i < numVertices; ++i)
+    return os.good();
+}
+
+bool readPLY(std::istream& is, MeshBuffer& mb)
+{
+    if (!isLittleEndian())
+        return false;
+
+    // Header
+    std::string line;
+    if (!std::getline(is, line) || line.compare(0, 3, "ply") != 0)
+        return false;
+
+    std::vector<PLYElement> elements;
+    bool binary = false;
+    while (std::getline(is, line))
     {
-        const float* n = mb.getNormalData(i);
-        os << "n " << n[0] << " " << n[1] << " " << n[2] << endl;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        std::istringstream ss(line);
+        std::string keyword;
+        ss >> keyword;
+        if (keyword == "format")
+        {
+            std::string format;
+            ss >> format;
+            binary = format == "binary_little_endian";
+        }
+        else if (keyword == "element")
+        {
+            PLYElement e;
+            ss >> e.name >> e.count;
+            elements.push_back(e);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PLYElement& e = elements.back();
+            PLYProperty prop;
+            std::string type;
+            ss >> type;
+            if (type == "list")
+            {
+                std::string count_type, item_type;
+                ss >> count_type >> item_type >> prop.name;
+                prop.countType = plyType(count_type);
+                prop.type = plyType(item_type);
+            }
+            else
+            {
+                ss >> prop.name;
+                prop.type = plyType(type);
+                prop.offset = e.size;
+                e.size += plySize(prop.type);
+            }
+            if (prop.type == PLYType::Unknown)
+                return false;
+            e.properties.push_back(prop);
+        }
+        else if (keyword == "end_header")
+        {
+            break;
+        }
     }
+    if (!binary)
+        return false;
+
+    // Vertices first, optionally followed by faces, further elements are ignored
+    if (elements.empty() || elements[0].name != "vertex")
+        return false;
+    const PLYElement* vertices = &elements[0];
+    const PLYElement* faces = elements.size() > 1 && elements[1].name == "face" ? &elements[1] : nullptr;
 
-    const size_t m = mb.getNumVertsPerPrimitive();
-    const size_t numIndices = mb.numIndices() / m;
-    for (size_t i = 0; i < numIndices; ++i)
+    // Attributes from the vertex properties
+
+    auto find = [vertices](std::initializer_list<const char*> names) -> const PLYProperty*
     {
-        const unsigned* f = mb.getIndexData(i);
-        os << "f";
-        for (size_t j = 0; j < m; ++j)
-            os << " " << f[j] + 1 << "//" << f[j] + 1; // OBJ indices are 1-based
-        os << endl;
+        for (const char* name : names)
+            for (const auto& prop : vertices->properties)
+                if (prop.name == name && prop.countType == PLYType::Unknown)
+                    return &prop;
+        return nullptr;
+    };
+    const PLYProperty* position[3] = { find({"x"}), find({"y"}), find({"z"}) };
+    const PLYProperty* normal[3]   = { find({"nx"}), find({"ny"}), find({"nz"}) };
+    const PLYProperty* color[4]    = { find({"red","r"}), find({"green","g"}), find({"blue","b"}), find({"alpha","a"}) };
+    const PLYProperty* uv[2]       = { find({"s","u","texture_u"}), find({"t","v","texture_v"}) };
+    if (!position[0] || !position[1] || !position[2])
+        return false;
+
+    MeshVertexAttribute attributes = MeshVertexAttribute(0);
+    if (normal[0] && normal[1] && normal[2]) attributes |= MeshVertexAttribute::Normal;
+    if (color[0] && color[1] && color[2])    attributes |= MeshVertexAttribute::Color;
+    if (uv[0] && uv[1])                      attributes |= MeshVertexAttribute::UV;
+
+    // Faces must come as list of a single uniform size
+    size_t m = 3;
+    const PLYProperty* faceIndices = nullptr;
+    if (faces && faces->count > 0)
+    {
+        if (faces->properties.size() != 1 || faces->properties[0].countType == PLYType::Unknown)
+            return false;
+        faceIndices = &faces->properties[0];
     }
+
+    // Vertex block in one read
+    std::vector<uint8_t> buf;
+    if (!read(is, buf, vertices->count * vertices->size))
+        return false;
+
+    auto convert = [&buf, vertices](const PLYProperty* const* props, size_t channels, float* dst, size_t stride, float scale)
+    {
+        for (size_t c = 0; c < channels; ++c)
+        {
+            const PLYProperty* prop = props[c];
+            const float s = prop && prop->type == PLYType::UInt8 ? scale : 1.f;
+            const uint8_t* src = buf.data() + (prop ? prop->offset : 0);
+            for (size_t i = 0; i < vertices->count; ++i)
+                dst[i * stride + c] = prop ? plyValue(src + i * vertices->size, prop->type) * s : 1.f;
+        }
+    };
+
+    // Face block, size per face is given by the count of the first face
+    std::vector<uint8_t> faceBuf;
+    if (faceIndices)
+    {
+        const size_t countSize = plySize(faceIndices->countType);
+        uint8_t count[8] = {};
+        is.read(reinterpret_cast<char*>(count), static_cast<std::streamsize>(countSize));
+        m = plyIndex(count, faceIndices->countType);
+        if (m != 2 && m != 3 && m != 4)
+            return false;
+
+        const size_t faceSize = countSize + m * plySize(faceIndices->type);
+        if (!read(is, faceBuf, faces->count * faceSize - countSize))
+            return false;
+        faceBuf.insert(faceBuf.begin(), count, count + countSize);
+    }
+
+    const MeshPrimitiveType type = m == 2 ? MeshPrimitiveType::Lines : (m == 4 ? MeshPrimitiveType::Quads : MeshPrimitiveType::Triangles);
+    MeshBuffer result(type, attributes, mb.getLayout());
+    result.resize(vertices->count, faces ? faces->count : 0);
+    result.setNumVertices(vertices->count);
+    result.setNumIndices((faces ? faces->count : 0) * m);
+
+    if (vertices->count > 0)
+    {
+                                      convert(position, 3, result.getVertexData(), result.getVertexStride(), 1.f);
+        if (result.hasNormals())      convert(normal,   3, result.getNormalData(), result.getNormalStride(), 1.f);
+        if (result.hasColors())       convert(color,    4, result.getColorData(),  result.getColorStride(),  1.f / 255.f);
+        if (result.hasUVs())          convert(uv,       2, result.getUVData(),     result.getUVStride(),     1.f);
+    }
+
+    if (faceIndices && faces->count > 0)
+    {
+        const size_t countSize = plySize(faceIndices->countType);
+        const size_t indexSize = plySize(faceIndices->type);
+        const size_t faceSize = countSize + m * indexSize;
+        unsigned* dst = result.getIndexData();
+        for (size_t i = 0; i < faces->count; ++i)
+        {
+            const uint8_t* p = faceBuf.data() + i * faceSize;
+            if (plyIndex(p, faceIndices->countType) != m)
+                return false;
+            for (size_t j = 0; j < m; ++j)
+            {
+                const unsigned index = plyIndex(p + countSize + j * indexSize, faceIndices->type);
+                if (index >= vertices->count)
+                    return false;
+                dst[i * m + j] = index;
+            }
+        }
+    }
+
+    mb = std::move(result);
+    return true;
+}
+
+// STL
+
+namespace {
+
+constexpr size_t STLHeaderSize = 80;
+constexpr size_t STLTriangleSize = 50; // normal, 3 vertices, attribute byte count
+
+void writeSTLHeader(std::ostream& os, uint32_t numTriangles)
+{
+    char header[STLHeaderSize] = "binary STL, gltoys";
+    os.write(header, sizeof(header));
+    os.write(reinterpret_cast<const char*>(&numTriangles), sizeof(numTriangles));
+}
+
+/// Triangle records with facet normals computed from the vertices
+void writeSTLTriangles(std::ostream& os, const MeshBuffer& mb, size_t numTriangles, std::vector<uint8_t>& buf)
+{
+    buf.resize(std::max(buf.size(), BinaryChunkSize * STLTriangleSize));
+    for (size_t first = 0; first < numTriangles; first += BinaryChunkSize)
+    {
+        const size_t end = std::min(first + BinaryChunkSize, numTriangles);
+        uint8_t* p = buf.data();
+        for (size_t i = first; i < end; ++i)
+        {
+            const unsigned* f = mb.getIndexData(i);
+            const float* v[3] = { mb.getVertexData(f[0]), mb.getVertexData(f[1]), mb.getVertexData(f[2]) };
+            const float e1[3] = { v[1][0]-v[0][0], v[1][1]-v[0][1], v[1][2]-v[0][2] };
+            const float e2[3] = { v[2][0]-v[0][0], v[2][1]-v[0][1], v[2][2]-v[0][2] };
+            float normal[3] = { e1[1]*e2[2]-e1[2]*e2[1], e1[2]*e2[0]-e1[0]*e2[2], e1[0]*e2[1]-e1[1]*e2[0] };
+            const float length = std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+            if (length > 0.f)
+                for (float& c : normal) c /= length;
+
+            p = putFloats(p, normal, 3);
+            for (int j = 0; j < 3; ++j)
+                p = putFloats(p, v[j], 3);
+            p = put(p, uint16_t(0));
+        }
+        write(os, buf, static_cast<size_t>(p - buf.data()));
+    }
+}
+
+} // namespace
+
+bool writeSTL(std::ostream& os, const MeshBufferView& view)
+{
+    if (!isLittleEndian() || view.getPrimitiveType() != MeshPrimitiveType::Triangles)
+        return false;
+
+    const size_t numTriangles = view.numIndices() / 3;
+    if (numTriangles > std::numeric_limits<uint32_t>::max())
+        return false;
+
+    writeSTLHeader(os, static_cast<uint32_t>(numTriangles));
+    std::vector<uint8_t> buf;
+    for (const auto& part : view.parts())
+        writeSTLTriangles(os, *part.mesh, part.numIndices / 3, buf);
+
+    return os.good();
+}
+
+bool readSTL(std::istream& is, MeshBuffer& mb)
+{
+    if (!isLittleEndian())
+        return false;
+
+    std::vector<uint8_t> buf;
+    if (!read(is, buf, STLHeaderSize + sizeof(uint32_t)))
+        return false;
+    const size_t numTriangles = get<uint32_t>(buf.data() + STLHeaderSize);
+
+    if (!read(is, buf, numTriangles * STLTriangleSize))
+        return false;
+
+    MeshBuffer result(MeshPrimitiveType::Triangles, MeshVertexAttribute::Normal, mb.getLayout());
+    result.resize(3 * numTriangles, numTriangles);
+    result.setNumVertices(3 * numTriangles);
+    result.setNumIndices(3 * numTriangles);
+
+    for (size_t i = 0; i < numTriangles; ++i)
+    {
+        const uint8_t* p = buf.data() + i * STLTriangleSize;
+        for (size_t j = 0; j < 3; ++j)
+        {
+            const size_t vidx = 3 * i + j;
+            std::memcpy(result.getNormalData(vidx), p, 3 * sizeof(float));
+            std::memcpy(result.getVertexData(vidx), p + 12 * (j + 1), 3 * sizeof(float));
+            result.getIndexData()[vidx] = static_cast<unsigned>(vidx);
+        }
+    }
+
+    mb = std::move(result);
+    return true;
+}
+
+// glTF
+
+namespace {
+
+/// Accessor for one attribute array or the indices of a part
+struct GLBAccessor
+{
+    const MeshBuffer* mesh;
+    enum Kind { Position, Normal, Color, UV, Index } kind;
+    size_t count;
+    size_t channels;
+    size_t byteOffset;
+
+    size_t byteLength() const { return count * channels * 4; }
+};
+
+const char* glbType(size_t channels)
+{
+    switch (channels)
+    {
+    case 1: return "SCALAR";
+    case 2: return "VEC2";
+    case 3: return "VEC3";
+    default: return "VEC4";
+    }
+}
+
+std::string jsonFloat(float f)
+{
+    char buf[32];
+    return std::string(buf, std::to_chars(buf, buf + sizeof(buf), f).ptr);
+}
+
+/// Streams the attribute array, directly for separate layouts and staged for interleaved ones
+void writeGLBAccessor(std::ostream& os, const GLBAccessor& a, std::vector<uint8_t>& buf)
+{
+    const MeshBuffer* mb = a.mesh;
+    if (a.count == 0)
+        return;
+
+    if (a.kind == GLBAccessor::Index)
+    {
+        os.write(reinterpret_cast<const char*>(mb->getIndexData()), static_cast<std::streamsize>(a.byteLength()));
+        return;
+    }
+
+    auto data = [mb, &a](size_t i) -> const float*
+    {
+        switch (a.kind)
+        {
+        case GLBAccessor::Normal: return mb->getNormalData(i);
+        case GLBAccessor::Color:  return mb->getColorData(i);
+        case GLBAccessor::UV:     return mb->getUVData(i);
+        default:                  return mb->getVertexData(i);
+        }
+    };
+
+    if (!mb->isInterleaved())
+    {
+        os.write(reinterpret_cast<const char*>(data(0)), static_cast<std::streamsize>(a.byteLength()));
+        return;
+    }
+
+    const size_t recordSize = a.channels * sizeof(float);
+    buf.resize(BinaryChunkSize * recordSize);
+    for (size_t first = 0; first < a.count; first += BinaryChunkSize)
+    {
+        const size_t end = std::min(first + BinaryChunkSize, a.count);
+        uint8_t* p = buf.data();
+        for (size_t i = first; i < end; ++i)
+            p = putFloats(p, data(i), a.channels);
+        write(os, buf, static_cast<size_t>(p - buf.data()));
+    }
+}
+
+} // namespace
+
+bool writeGLB(std::ostream& os, const MeshBufferView& view)
+{
+    if (!isLittleEndian() || view.getPrimitiveType() == MeshPrimitiveType::Quads)
+        return false;
+
+    // Layout of the binary chunk, all arrays are 4-byte aligned
+    std::vector<GLBAccessor> accessors;
+    std::vector<std::vector<size_t>> primitives; // accessor indices per mesh
+    size_t binLength = 0;
+    auto add = [&](const MeshBuffer* mb, GLBAccessor::Kind kind, size_t count, size_t channels)
+    {
+        primitives.back().push_back(accessors.size());
+        accessors.push_back({ mb, kind, count, channels, binLength });
+        binLength += accessors.back().byteLength();
+    };
+    for (const auto& part : view.parts())
+    {
+        const MeshBuffer* mb = part.mesh;
+        const size_t n = mb->numVertices();
+        if (n == 0 || part.numIndices == 0)
+            continue;
+        primitives.emplace_back();
+                             add(mb, GLBAccessor::Position, n, 3);
+        if (view.hasNormals()) add(mb, GLBAccessor::Normal,   n, 3);
+        if (view.hasColors())  add(mb, GLBAccessor::Color,    n, 4);
+        if (view.hasUVs())     add(mb, GLBAccessor::UV,       n, 2);
+        add(mb, GLBAccessor::Index, part.numIndices, 1);
+    }
+
+    // JSON chunk
+    std::ostringstream json;
+    json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"gltoys\"},\"scene\":0,\"scenes\":[{\"nodes\":[";
+    for (size_t i = 0; i < primitives.size(); ++i)
+        json << (i ? "," : "") << i;
+    json << "]}],\"nodes\":[";
+    for (size_t i = 0; i < primitives.size(); ++i)
+        json << (i ? "," : "") << "{\"mesh\":" << i << "}";
+
+    const int mode = view.getPrimitiveType() == MeshPrimitiveType::Lines ? 1 : 4;
+    const char* semantics[] = { "POSITION", "NORMAL", "COLOR_0", "TEXCOORD_0" };
+    json << "],\"meshes\":[";
+    for (size_t i = 0; i < primitives.size(); ++i)
+    {
+        json << (i ? "," : "") << "{\"primitives\":[{\"attributes\":{";
+        const auto& ids = primitives[i];
+        for (size_t j = 0; j + 1 < ids.size(); ++j)
+            json << (j ? "," : "") << "\"" << semantics[accessors[ids[j]].kind] << "\":" << ids[j];
+        json << "},\"indices\":" << ids.back() << ",\"mode\":" << mode << "}]}";
+    }
+
+    json << "],\"accessors\":[";
+    for (size_t i = 0; i < accessors.size(); ++i)
+    {
+        const GLBAccessor& a = accessors[i];
+        const bool index = a.kind == GLBAccessor::Index;
+        json << (i ? "," : "") << "{\"bufferView\":" << i << ",\"componentType\":" << (index ? 5125 : 5126) // UNSIGNED_INT, FLOAT
+             << ",\"count\":" << a.count << ",\"type\":\"" << glbType(a.channels) << "\"";
+        if (a.kind == GLBAccessor::Position)
+        {
+            // bounds are required for positions
+            float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+            float hi[3] = { -lo[0], -lo[1], -lo[2] };
+            for (size_t v = 0; v < a.count; ++v)
+            {
+                const float* p = a.mesh->getVertexData(v);
+                for (int k = 0; k < 3; ++k)
+                {
+                    lo[k] = std::min(lo[k], p[k]);
+                    hi[k] = std::max(hi[k], p[k]);
+                }
+            }
+            json << ",\"min\":[" << jsonFloat(lo[0]) << "," << jsonFloat(lo[1]) << "," << jsonFloat(lo[2]) << "]"
+                 << ",\"max\":[" << jsonFloat(hi[0]) << "," << jsonFloat(hi[1]) << "," << jsonFloat(hi[2]) << "]";
+        }
+        json << "}";
+    }
+
+    json << "],\"bufferViews\":[";
+    for (size_t i = 0; i < accessors.size(); ++i)
+    {
+        const GLBAccessor& a = accessors[i];
+        json << (i ? "," : "") << "{\"buffer\":0,\"byteOffset\":" << a.byteOffset << ",\"byteLength\":" << a.byteLength()
+             << ",\"target\":" << (a.kind == GLBAccessor::Index ? 34963 : 34962) << "}"; // ELEMENT_ARRAY_BUFFER, ARRAY_BUFFER
+    }
+    json << "],\"buffers\":[{\"byteLength\":" << binLength << "}]}";
+
+    std::string jsonChunk = json.str();
+    jsonChunk.resize((jsonChunk.size() + 3) & ~size_t(3), ' ');
+
+    // Header, JSON chunk and binary chunk header, then stream the arrays
+    const uint64_t totalLength = 12 + 8 + jsonChunk.size() + 8 + binLength;
+    if (totalLength > std::numeric_limits<uint32_t>::max())
+        return false;
+
+    std::vector<uint8_t> buf(28);
+    uint8_t* p = buf.data();
+    p = put(p, uint32_t(0x46546C67)); // "glTF"
+    p = put(p, uint32_t(2));
+    p = put(p, static_cast<uint32_t>(totalLength));
+    p = put(p, static_cast<uint32_t>(jsonChunk.size()));
+    p = put(p, uint32_t(0x4E4F534A)); // "JSON"
+    write(os, buf, static_cast<size_t>(p - buf.data()));
+    os.write(jsonChunk.data(), static_cast<std::streamsize>(jsonChunk.size()));
+
+    p = buf.data();
+    p = put(p, static_cast<uint32_t>(binLength));
+    p = put(p, uint32_t(0x004E4942)); // "BIN"
+    write(os, buf, static_cast<size_t>(p - buf.data()));
+
+    for (const auto& a : accessors)
+        writeGLBAccessor(os, a, buf);
+
+    return os.good();
+}
+
+// OBJ reader
+
+namespace {
+
+/// Parsed content of a line-aligned chunk of an OBJ file
+struct OBJChunkData
+{
+    std::vector<float> positions;
+    std::vector<float> colors;
+    std::vector<float> normals;
+    std::vector<float> uvs;
+
+    /// Triangle corners as (v,vt,vn). Absolute indices are 0-based global
+    /// ones, relative indices are stored as index into the chunk minus
+    /// RelativeBias and resolved against the chunk bases, they may refer to
+    /// earlier chunks. Missing indices are NoIndex.
+    std::vector<int64_t> corners;
+
+    bool error = false;
+};
+
+constexpr int64_t NoIndex = std::numeric_limits<int64_t>::max();
+constexpr int64_t RelativeBias = int64_t(1) << 41;
+
+inline const char* skipSpaces(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    return p;
+}
+
+inline const char* nextLine(const char* p, const char* end)
+{
+    while (p < end && *p != '\n')
+        ++p;
+    return p < end ? p + 1 : end;
+}
+
+/// Up to maxCount floats, returns the number parsed
+inline size_t parseFloats(const char*& p, const char* end, float* dst, size_t maxCount)
+{
+    size_t n = 0;
+    while (n < maxCount)
+    {
+        p = skipSpaces(p, end);
+        // from_chars does not accept a leading '+'
+        if (p < end && *p == '+') ++p;
+        const auto result = std::from_chars(p, end, dst[n]);
+        if (result.ec != std::errc())
+            break;
+        p = result.ptr;
+        ++n;
+    }
+    return n;
+}
+
+/// OBJ index (1-based, negative relative to count) to the OBJChunkData encoding
+inline int64_t chunkIndex(long long objIndex, size_t localCount)
+{
+    if (objIndex > 0 && objIndex < RelativeBias / 2)
+        return objIndex - 1;
+    if (objIndex < 0 && -objIndex < RelativeBias / 2)
+        return static_cast<int64_t>(localCount) + objIndex - RelativeBias;
+    return NoIndex;
+}
+
+void parseOBJChunk(const char* p, const char* end, OBJChunkData& chunk)
+{
+    std::vector<int64_t> polygon;
+    while (p < end)
+    {
+        p = skipSpaces(p, end);
+        const char* line = p;
+        p = nextLine(p, end);
+        if (line + 1 >= end)
+            continue;
+
+        if (line[0] == 'v' && line[1] == ' ')
+        {
+            const char* q = line + 2;
+            float values[6];
+            const size_t n = parseFloats(q, p, values, 6);
+            if (n < 3) { chunk.error = true; continue; }
+            chunk.positions.insert(chunk.positions.end(), values, values + 3);
+            if (n == 6)
+            {
+                chunk.colors.insert(chunk.colors.end(), values + 3, values + 6);
+                chunk.colors.push_back(1.f);
+            }
+        }
+        else if (line[0] == 'v' && line[1] == 'n')
+        {
+            const char* q = line + 2;
+            float values[3];
+            if (parseFloats(q, p, values, 3) != 3) { chunk.error = true; continue; }
+            chunk.normals.insert(chunk.normals.end(), values, values + 3);
+        }
+        else if (line[0] == 'v' && line[1] == 't')
+        {
+            const char* q = line + 2;
+            float values[3] = { 0.f, 0.f, 0.f };
+            if (parseFloats(q, p, values, 3) < 1) { chunk.error = true; continue; }
+            chunk.uvs.insert(chunk.uvs.end(), values, values + 2);
+        }
+        else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+        {
+            // corners v, v/vt, v//vn or v/vt/vn
+            polygon.clear();
+            const char* q = line + 1;
+            for (;;)
+            {
+                q = skipSpaces(q, p);
+                long long idx[3] = { 0, 0, 0 };
+                auto result = std::from_chars(q, p, idx[0]);
+                if (result.ec != std::errc())
+                    break;
+                q = result.ptr;
+                for (int k = 1; k < 3 && q < p && *q == '/'; ++k)
+                {
+                    ++q;
+                    result = std::from_chars(q, p, idx[k]);
+                    if (result.ec == std::errc())
+                        q = result.ptr;
+                }
+                polygon.push_back(chunkIndex(idx[0], chunk.positions.size() / 3));
+                polygon.push_back(idx[1] ? chunkIndex(idx[1], chunk.uvs.size() / 2) : NoIndex);
+                polygon.push_back(idx[2] ? chunkIndex(idx[2], chunk.normals.size() / 3) : NoIndex);
+            }
+
+            const size_t n = polygon.size() / 3;
+            if (n < 3) { chunk.error = true; continue; }
+            for (size_t i = 1; i + 1 < n; ++i)
+            {
+                chunk.corners.insert(chunk.corners.end(), &polygon[0], &polygon[3]);
+                chunk.corners.insert(chunk.corners.end(), &polygon[3 * i], &polygon[3 * i + 6]);
+            }
+        }
+        // other statements (comments, groups, materials, lines, ...) are ignored
+    }
+}
+
+inline int64_t resolveIndex(int64_t idx, size_t base)
+{
+    return idx < 0 ? static_cast<int64_t>(base) + idx + RelativeBias : idx;
+}
+
+} // namespace
+
+bool readOBJ(const std::filesystem::path& filename, MeshBuffer& mb, unsigned numThreads)
+{
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+    const char* begin = reinterpret_cast<const char*>(file.data());
+    const char* end = begin + file.size();
+
+    // Line-aligned chunks, a few per thread to balance the load
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t numChunks = std::max<size_t>(1, std::min<size_t>(4 * numThreads, file.size() / (1 << 16)));
+    std::vector<const char*> bounds(numChunks + 1, end);
+    bounds[0] = begin;
+    for (size_t i = 1; i < numChunks; ++i)
+        bounds[i] = std::max(bounds[i - 1], nextLine(begin + i * file.size() / numChunks, end));
+
+    std::vector<OBJChunkData> chunks(numChunks);
+    parallelFor(numChunks, numThreads, [&](size_t i)
+    {
+        parseOBJChunk(bounds[i], bounds[i + 1], chunks[i]);
+    });
+
+    // Chunk bases and totals
+    struct Bases { size_t positions = 0, normals = 0, uvs = 0, corners = 0; };
+    std::vector<Bases> bases(numChunks + 1);
+    bool colors = true;
+    for (size_t i = 0; i < numChunks; ++i)
+    {
+        const OBJChunkData& c = chunks[i];
+        if (c.error)
+            return false;
+        colors &= c.colors.size() / 4 == c.positions.size() / 3;
+        bases[i + 1].positions = bases[i].positions + c.positions.size() / 3;
+        bases[i + 1].normals   = bases[i].normals   + c.normals.size() / 3;
+        bases[i + 1].uvs       = bases[i].uvs       + c.uvs.size() / 2;
+        bases[i + 1].corners   = bases[i].corners   + c.corners.size() / 3;
+    }
+    const Bases& total = bases.back();
+    if (total.positions == 0 || total.positions > std::numeric_limits<unsigned>::max())
+        return false;
+
+    MeshVertexAttribute attributes = MeshVertexAttribute(0);
+    if (total.normals > 0) attributes |= MeshVertexAttribute::Normal;
+    if (colors)            attributes |= MeshVertexAttribute::Color;
+    if (total.uvs > 0)     attributes |= MeshVertexAttribute::UV;
+
+    MeshBuffer result(MeshPrimitiveType::Triangles, attributes, mb.getLayout());
+    result.resize(total.positions, total.corners / 3);
+    result.setNumVertices(total.positions);
+    result.setNumIndices(total.corners);
+
+    // Normal and UV per position, set by the corners referencing it
+    constexpr uint32_t Unset = ~0u;
+    std::unique_ptr<std::atomic<uint32_t>[]> normalOf(result.hasNormals() ? new std::atomic<uint32_t>[total.positions] : nullptr);
+    std::unique_ptr<std::atomic<uint32_t>[]> uvOf    (result.hasUVs()     ? new std::atomic<uint32_t>[total.positions] : nullptr);
+
+    std::atomic<bool> valid(true);
+    parallelFor(numChunks, numThreads, [&](size_t i)
+    {
+        const OBJChunkData& c = chunks[i];
+        const size_t n = c.positions.size() / 3;
+        const size_t base = bases[i].positions;
+        for (size_t v = 0; v < n; ++v)
+        {
+            float* dst = result.getVertexData(base + v);
+            std::copy(&c.positions[3 * v], &c.positions[3 * v] + 3, dst);
+            if (result.hasColors())
+                std::copy(&c.colors[4 * v], &c.colors[4 * v] + 4, result.getColorData(base + v));
+            if (normalOf) normalOf[base + v].store(Unset, std::memory_order_relaxed);
+            if (uvOf)     uvOf    [base + v].store(Unset, std::memory_order_relaxed);
+        }
+    });
+
+    parallelFor(numChunks, numThreads, [&](size_t i)
+    {
+        const OBJChunkData& c = chunks[i];
+        const Bases& b = bases[i];
+        unsigned* indices = total.corners > 0 ? result.getIndexData() + b.corners : nullptr;
+        for (size_t k = 0; k < c.corners.size() / 3; ++k)
+        {
+            const int64_t v  = resolveIndex(c.corners[3 * k + 0], b.positions);
+            const int64_t vt = c.corners[3 * k + 1];
+            const int64_t vn = c.corners[3 * k + 2];
+            if (v == NoIndex || v < 0 || static_cast<size_t>(v) >= total.positions)
+            {
+                valid = false;
+                return;
+            }
+            indices[k] = static_cast<unsigned>(v);
+            if (normalOf && vn != NoIndex)
+            {
+                const int64_t n = resolveIndex(vn, b.normals);
+                if (n >= 0 && static_cast<size_t>(n) < total.normals)
+                    normalOf[v].store(static_cast<uint32_t>(n), std::memory_order_relaxed);
+            }
+            if (uvOf && vt != NoIndex)
+            {
+                const int64_t t = resolveIndex(vt, b.uvs);
+                if (t >= 0 && static_cast<size_t>(t) < total.uvs)
+                    uvOf[v].store(static_cast<uint32_t>(t), std::memory_order_relaxed);
+            }
+        }
+    });
+    if (!valid)
+        return false;
+
+    // Gather normals and UVs, chunks are located via the bases
+    auto gather = [&](std::atomic<uint32_t>* source, size_t Bases::* count, std::vector<float> OBJChunkData::* data,
+                      size_t channels, float* (MeshBuffer::*dst)(size_t))
+    {
+        parallelFor(numChunks, numThreads, [&](size_t i)
+        {
+            for (size_t v = bases[i].positions; v < bases[i + 1].positions; ++v)
+            {
+                float* out = (result.*dst)(v);
+                const uint32_t src = source[v].load(std::memory_order_relaxed);
+                if (src == Unset)
+                {
+                    std::fill(out, out + channels, 0.f);
+                    continue;
+                }
+                const size_t chunk = static_cast<size_t>(std::upper_bound(bases.begin(), bases.end(), src,
+                    [count](size_t value, const Bases& b) { return value < b.*count; }) - bases.begin()) - 1;
+                const float* in = &(chunks[chunk].*data)[(src - bases[chunk].*count) * channels];
+                std::copy(in, in + channels, out);
+            }
+        });
+    };
+    if (normalOf) gather(normalOf.get(), &Bases::normals, &OBJChunkData::normals, 3, &MeshBuffer::getNormalData);
+    if (uvOf)     gather(uvOf.get(),     &Bases::uvs,     &OBJChunkData::uvs,     2, &MeshBuffer::getUVData);
+
+    mb = std::move(result);
+    return true;
+}
+
+// Streaming
+
+namespace {
+
+/// Zero-padded count width in the streamed PLY header, patched on close
+constexpr int PLYCountWidth = 10;
+
+PLYVertexFormat plyVertexFormat(MeshVertexAttribute attributes)
+{
+    PLYVertexFormat format;
+    format.normals = has(attributes, MeshVertexAttribute::Normal);
+    format.colors  = has(attributes, MeshVertexAttribute::Color);
+    format.uvs     = has(attributes, MeshVertexAttribute::UV);
+    return format;
+}
+
+bool copyStream(std::istream& is, std::ostream& os, std::vector<uint8_t>& buf)
+{
+    buf.resize(std::max<size_t>(buf.size(), 1 << 20));
+    while (is.read(reinterpret_cast<char*>(buf.data()), static_cast<std::streamsize>(buf.size())) || is.gcount() > 0)
+        os.write(reinterpret_cast<const char*>(buf.data()), is.gcount());
+    return os.good();
+}
+
+} // namespace
+
+MeshStreamWriter::~MeshStreamWriter()
+{
+    discard();
+}
+
+bool MeshStreamWriter::open(const std::filesystem::path& filename, MeshVertexAttribute attributes, MeshPrimitiveType type)
+{
+    discard();
+    if (!isLittleEndian())
+        return false;
+
+    std::string ext = filename.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (ext == ".ply")
+        m_format = Format::PLY;
+    else if (ext == ".stl" && type == MeshPrimitiveType::Triangles)
+        m_format = Format::STL;
+    else
+        return false;
+
+    m_filename = filename;
+    m_tmpFilename = filename;
+    m_tmpFilename += ".tmp";
+    m_attributes = m_format == Format::PLY ? attributes : MeshVertexAttribute(0);
+    m_type = type;
+    m_nextPart = 0;
+    m_failed = false;
+    m_numVertices = 0;
+    m_numPrimitives = 0;
+    m_numTailVertices = 0;
+    m_tail.clear();
+
+    const auto mode = std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc;
+    m_file.open(m_tmpFilename, mode);
+    if (m_format == Format::PLY)
+    {
+        m_facesFilename = filename;
+        m_facesFilename += ".faces.tmp";
+        m_faces.open(m_facesFilename, mode);
+        if (!m_faces.is_open())
+        {
+            discard();
+            return false;
+        }
+
+        writePLYHeader(m_file, plyVertexFormat(m_attributes), 0, 0, PLYCountWidth);
+    }
+    else
+    {
+        writeSTLHeader(m_file, 0);
+    }
+    m_headerSize = m_file.tellp();
+
+    if (!m_file.good())
+    {
+        discard();
+        return false;
+    }
+    return true;
+}
+
+bool MeshStreamWriter::append(size_t partIndex, const MeshBuffer& part)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_turn.wait(lock, [&] { return m_nextPart == partIndex || m_failed; });
+    if (m_failed || !isOpen())
+        return false;
+
+    if (!appendPart(part))
+        m_failed = true;
+    ++m_nextPart;
+    m_turn.notify_all();
+    return !m_failed;
+}
+
+bool MeshStreamWriter::appendPart(const MeshBuffer& part)
+{
+    if (part.getPrimitiveType() != m_type)
+        return false;
+    for (MeshVertexAttribute a : { MeshVertexAttribute::Normal, MeshVertexAttribute::Color, MeshVertexAttribute::UV })
+        if (has(m_attributes, a) && !part.hasAttribute(a))
+            return false;
+
+    const size_t m = part.getNumVertsPerPrimitive();
+    const size_t numPartPrimitives = part.numIndices() / m;
+    if (m_format == Format::STL)
+    {
+        writeSTLTriangles(m_file, part, numPartPrimitives, m_buf);
+        m_numPrimitives += numPartPrimitives;
+        return m_file.good() && m_numPrimitives <= std::numeric_limits<uint32_t>::max();
+    }
+
+    // The pending tail of the previous part is replaced by the head of this one
+    const size_t baseVertex = m_numVertices;
+    const size_t numShared = part.numSharedVertices();
+    const size_t numOwn = part.numVertices() - numShared;
+    const PLYVertexFormat format = plyVertexFormat(m_attributes);
+    writePLYVertices(m_file, part, 0, numOwn, format, m_buf);
+    m_numVertices += numOwn;
+
+    std::ostringstream tail;
+    writePLYVertices(tail, part, numOwn, part.numVertices(), format, m_buf);
+    const std::string tailBytes = tail.str();
+    m_tail.assign(tailBytes.begin(), tailBytes.end());
+    m_numTailVertices = numShared;
+
+    if (numPartPrimitives > 0)
+        writePLYFaces(m_faces, part.getIndexData(), numPartPrimitives, m, baseVertex, m_buf);
+    m_numPrimitives += numPartPrimitives;
+    return m_file.good() && m_faces.good();
+}
+
+bool MeshStreamWriter::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!isOpen())
+        return false;
+
+    bool ok = !m_failed;
+    if (ok && m_format == Format::PLY)
+    {
+        // Tail of the last part, nothing follows it
+        m_file.write(reinterpret_cast<const char*>(m_tail.data()), static_cast<std::streamsize>(m_tail.size()));
+        m_numVertices += m_numTailVertices;
+
+        m_faces.seekg(0);
+        ok = copyStream(m_faces, m_file, m_buf);
+
+        m_file.seekp(0);
+        writePLYHeader(m_file, plyVertexFormat(m_attributes), m_numVertices, m_numPrimitives, PLYCountWidth);
+        ok = ok && m_file.tellp() == m_headerSize;
+    }
+    else if (ok)
+    {
+        m_file.seekp(0);
+        writeSTLHeader(m_file, static_cast<uint32_t>(m_numPrimitives));
+    }
+
+    ok = ok && m_file.good();
+    m_file.close();
+    ok = ok && !m_file.fail();
+    if (ok)
+    {
+        std::error_code ec;
+        std::filesystem::rename(m_tmpFilename, m_filename, ec);
+        ok = !ec;
+    }
+    discard();
+    return ok;
+}
+
+void MeshStreamWriter::discard()
+{
+    std::error_code ec;
+    if (m_file.is_open())
+        m_file.close();
+    if (!m_tmpFilename.empty())
+        std::filesystem::remove(m_tmpFilename, ec);
+    if (m_faces.is_open())
+        m_faces.close();
+    if (!m_facesFilename.empty())
+        std::filesystem::remove(m_facesFilename, ec);
+    m_tmpFilename.clear();
+    m_facesFilename.clear();
+    m_tail.clear();
+    m_failed = true;
+    m_turn.notify_all();
 }
@@ -1,4 +1,113 @@
 #pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <mutex>
 #include <ostream>
+#include <vector>
+#include "MeshBufferTypes.h"
 class MeshBuffer;
-void writeOBJ(std::ostream& os, const MeshBuffer& mb);
+class MeshBufferView;
+
+/// Wavefront OBJ with positions, normals (if all parts have them) and faces.
+/// Lines are formatted with std::to_chars in chunks, on numThreads threads
+/// (0 for one per hardware thread) and written in order.
+void writeOBJ(std::ostream& os, const MeshBuffer& mb, unsigned numThreads=1);
+/// Writes all parts of the view as one mesh in a single pass
+void writeOBJ(std::ostream& os, const MeshBufferView& view, unsigned numThreads=1);
+
+/// Reads positions (with optional vertex colors), normals, UVs and faces of
+/// a Wavefront OBJ file into mb as triangles, polygons are triangulated as
+/// fans. The file is memory-mapped and parsed in line-aligned chunks on
+/// numThreads threads (0 for one per hardware thread). Normals and UVs are
+/// attached to the positions they are referenced with; where a position is
+/// referenced with different ones, one of them is kept. The vertex layout of
+/// mb is kept.
+bool readOBJ(const std::filesystem::path& filename, MeshBuffer& mb, unsigned numThreads=0);
+
+// Binary formats, streams have to be opened with std::ios::binary.
+
+/// Binary little-endian PLY with float positions, normals and UVs (s,t) and
+/// uchar RGBA colors (clamped to [0,1]) as present in all parts.
+bool writePLY(std::ostream& os, const MeshBufferView& view);
+
+/// Reads binary little-endian PLY with a uniform face size (triangles or
+/// quads) into mb, replacing its attributes. The vertex layout of mb is kept.
+bool readPLY(std::istream& is, MeshBuffer& mb);
+
+/// Binary STL, triangles only, facet normals are computed from the vertices
+bool writeSTL(std::ostream& os, const MeshBufferView& view);
+
+/// Reads binary STL into mb as unconnected triangles with facet normals.
+/// The vertex layout of mb is kept.
+bool readSTL(std::istream& is, MeshBuffer& mb);
+
+/// Binary glTF 2.0 with one mesh and node per part of the view. Parts keep
+/// their own vertices, including a shared tail. Attribute arrays are
+/// streamed as tightly packed float bufferViews, indices as uint32. Quads
+/// are not supported.
+bool writeGLB(std::ostream& os, const MeshBufferView& view);
+
+/// Writes binary PLY or STL (by extension) incrementally, one MeshBuffer
+/// part at a time, e.g. each slice as soon as it is computed, so that the
+/// full mesh never has to be held in memory. Parts are joined like
+/// MeshBuffer::merge(): a shared tail is dropped in favor of the head of the
+/// next part and indices get running offsets.
+///
+/// PLY faces are spooled to a temporary file next to the output and
+/// appended on close(), the element counts in the header are patched then.
+/// The output is written to a temporary name and renamed by close(), an
+/// unclosed writer removes its files.
+class MeshStreamWriter
+{
+public:
+    MeshStreamWriter() = default;
+    MeshStreamWriter(const MeshStreamWriter&) = delete;
+    MeshStreamWriter& operator=(const MeshStreamWriter&) = delete;
+    ~MeshStreamWriter();
+
+    /// Parts need at least the given attributes, others are not written
+    bool open(const std::filesystem::path& filename, MeshVertexAttribute attributes,
+              MeshPrimitiveType type=MeshPrimitiveType::Triangles);
+
+    /// Thread-safe, parts are written in the order of partIndex: a call
+    /// waits until all parts before it have been appended. Every index from
+    /// 0 on has to be appended once, or the writer has to fail.
+    bool append(size_t partIndex, const MeshBuffer& part);
+
+    bool close();
+
+    bool isOpen() const { return m_file.is_open(); }
+    size_t numVertices() const { return m_numVertices; }
+    size_t numPrimitives() const { return m_numPrimitives; }
+
+private:
+    enum class Format { PLY, STL };
+
+    bool appendPart(const MeshBuffer& part);
+    void discard();
+
+    Format m_format = Format::PLY;
+    MeshVertexAttribute m_attributes = MeshVertexAttribute(0);
+    MeshPrimitiveType m_type = MeshPrimitiveType::Triangles;
+    std::filesystem::path m_filename;
+    std::filesystem::path m_tmpFilename;
+    std::filesystem::path m_facesFilename; ///< PLY faces until close()
+    std::fstream m_file;
+    std::fstream m_faces;
+    std::streamoff m_headerSize = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_turn;
+    size_t m_nextPart = 0;
+    bool m_failed = false;
+
+    size_t m_numVertices = 0;    ///< written, without the pending tail
+    size_t m_numPrimitives = 0;
+    std::vector<uint8_t> m_tail; ///< vertex records of the last shared tail
+    size_t m_numTailVertices = 0;
+    std::vector<uint8_t> m_buf;
+};
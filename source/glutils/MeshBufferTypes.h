@@ -5,7 +5,7 @@
 enum class MeshVertexAttribute : unsigned {
     Normal = 0x01,
     Color  = 0x04,
-    UV     = 0x07
+    UV     = 0x02
 };
 
 enum class MeshPrimitiveType : unsigned {
@@ -15,6 +15,54 @@ enum class MeshPrimitiveType : unsigned {
     Quads     = 0x07  // == GL_QUADS
 };
 
+enum class MeshVertexLayout : unsigned {
+    Separate    = 0x00, // one array per attribute
+    Interleaved = 0x01  // position, normal, color, uv (as present) per vertex in a single array
+};
+
+// Compact attribute encodings, see MeshBufferEncoding.h
+
+enum class MeshPositionFormat : unsigned {
+    Float,
+    Half,    // 16-bit float
+    UNorm16  // 16-bit normalized relative to the bounding box
+};
+
+enum class MeshNormalFormat : unsigned {
+    Float,
+    Int2101010, // 10:10:10:2 signed normalized (GL_INT_2_10_10_10_REV)
+    Octahedral  // 2x16-bit signed normalized octahedral mapping, decoded in shader
+};
+
+enum class MeshColorFormat : unsigned {
+    Float,
+    RGBA8
+};
+
+enum class MeshIndexFormat : unsigned {
+    UInt32,
+    Smallest // 16-bit if the mesh has less than 65536 vertices
+};
+
+struct MeshVertexFormat
+{
+    MeshPositionFormat position = MeshPositionFormat::Float;
+    MeshNormalFormat   normal   = MeshNormalFormat::Float;
+    MeshColorFormat    color    = MeshColorFormat::Float;
+    MeshIndexFormat    index    = MeshIndexFormat::UInt32;
+
+    bool isFloat() const
+    {
+        return position == MeshPositionFormat::Float && normal == MeshNormalFormat::Float && color == MeshColorFormat::Float;
+    }
+
+    /// Compact encoding that does not require shader support besides position dequantization
+    static MeshVertexFormat compact()
+    {
+        return { MeshPositionFormat::UNorm16, MeshNormalFormat::Int2101010, MeshColorFormat::RGBA8, MeshIndexFormat::Smallest };
+    }
+};
+
 // https://softwareengineering.stackexchange.com/questions/194412/using-scoped-enums-for-bit-flags-in-c
 
 inline MeshVertexAttribute operator | (MeshVertexAttribute lhs, MeshVertexAttribute rhs)
@@ -0,0 +1,49 @@
+#include "MeshBufferView.h"
+#include "MeshBuffer.h"
+#include <stdexcept>
+
+MeshBufferView::MeshBufferView(const MeshBuffer& mb)
+: MeshBufferView(std::vector<const MeshBuffer*>{ &mb })
+{}
+
+MeshBufferView::MeshBufferView(const std::vector<const MeshBuffer*>& parts)
+{
+    using T = std::underlying_type_t<MeshVertexAttribute>;
+    bool first = true;
+    for (const MeshBuffer* mb : parts)
+    {
+        if (!mb) continue;
+        if (first)
+        {
+            m_type = mb->getPrimitiveType();
+            m_numVertsPerPrimitive = mb->getNumVertsPerPrimitive();
+            m_attributes = mb->getAttributes();
+            first = false;
+        }
+        else if (mb->getPrimitiveType() != m_type)
+        {
+            throw std::runtime_error("MeshBufferView parts differ in MeshPrimitiveType");
+        }
+        m_attributes = static_cast<MeshVertexAttribute>(static_cast<T>(m_attributes) & static_cast<T>(mb->getAttributes()));
+
+        // The shared tail of the previous part duplicates the head of this one, as in MeshBuffer::merge()
+        if (!m_parts.empty())
+        {
+            Part& prev = m_parts.back();
+            const size_t shared = prev.mesh->numSharedVertices();
+            prev.numVertices -= shared;
+            m_numVertices -= shared;
+        }
+
+        Part part;
+        part.mesh = mb;
+        part.numVertices = mb->numVertices();
+        part.numIndices  = mb->numIndices();
+        part.baseVertex  = m_numVertices;
+        part.baseIndex   = m_numIndices;
+        m_parts.push_back(part);
+
+        m_numVertices += part.numVertices;
+        m_numIndices  += part.numIndices;
+    }
+}
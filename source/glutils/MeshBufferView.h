@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "MeshBufferTypes.h"
+
+class MeshBuffer;
+
+/// Read-only view of one or more MeshBuffers as a single mesh, as if they
+/// were merged via MeshBuffer::merge() in the given order, but without
+/// copying. Exporters iterate over the parts and add baseVertex to the
+/// indices of a part on the fly. The parts must outlive the view.
+class MeshBufferView
+{
+public:
+    struct Part
+    {
+        const MeshBuffer* mesh = nullptr;
+        size_t numVertices = 0; ///< without a shared tail that the next part repeats
+        size_t numIndices  = 0;
+        size_t baseVertex  = 0; ///< added to the indices of this part
+        size_t baseIndex   = 0; ///< first index of this part in the view
+    };
+
+    MeshBufferView() = default;
+    MeshBufferView(const MeshBuffer& mb);
+    /// Null parts are skipped, all parts must have the same primitive type
+    MeshBufferView(const std::vector<const MeshBuffer*>& parts);
+
+    template<class T>
+    MeshBufferView(const std::vector<std::shared_ptr<T>>& parts)
+    : MeshBufferView(rawPointers(parts))
+    {}
+
+    size_t numParts() const { return m_parts.size(); }
+    const Part& part(size_t i) const { return m_parts[i]; }
+    const std::vector<Part>& parts() const { return m_parts; }
+
+    size_t numVertices() const { return m_numVertices; }
+    size_t numIndices () const { return m_numIndices; }
+
+    MeshPrimitiveType getPrimitiveType() const { return m_type; }
+    size_t getNumVertsPerPrimitive() const { return m_numVertsPerPrimitive; }
+
+    /// True if all parts have the attribute
+    bool hasAttribute(MeshVertexAttribute a) const { return has(m_attributes, a); }
+    bool hasNormals() const { return hasAttribute(MeshVertexAttribute::Normal); }
+    bool hasColors()  const { return hasAttribute(MeshVertexAttribute::Color);  }
+    bool hasUVs()     const { return hasAttribute(MeshVertexAttribute::UV); }
+
+private:
+    template<class T>
+    static std::vector<const MeshBuffer*> rawPointers(const std::vector<std::shared_ptr<T>>& parts)
+    {
+        std::vector<const MeshBuffer*> ptrs;
+        ptrs.reserve(parts.size());
+        for (const auto& p : parts)
+            ptrs.push_back(p.get());
+        return ptrs;
+    }
+
+    std::vector<Part> m_parts;
+    size_t m_numVertices = 0;
+    size_t m_numIndices  = 0;
+    MeshPrimitiveType m_type = MeshPrimitiveType::Triangles;
+    MeshVertexAttribute m_attributes = MeshVertexAttribute(0);
+    size_t m_numVertsPerPrimitive = 3;
+};
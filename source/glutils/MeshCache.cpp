@@ -0,0 +1,232 @@
+#include "MeshCache.h"
+#include "MeshBuffer.h"
+#include "MeshCompression.h"
+#include <utils/MappedFile.h>
+#include <cstring> // memcmp
+#include <fstream>
+#include <memory>
+#include <system_error>
+
+namespace {
+
+constexpr uint32_t MeshCacheVersion = 2;
+constexpr uint32_t ByteOrderTag = 0x01020304;
+constexpr size_t PageSize = 4096;
+
+struct MeshCacheHeader
+{
+    char     magic[4] = { 'G','T','M','C' };
+    uint32_t version = MeshCacheVersion;
+    uint32_t byteOrder = ByteOrderTag;
+    uint32_t numParts = 0;
+    uint64_t key = 0;
+    uint32_t primitiveType = 0;
+    uint32_t attributes = 0;
+    uint32_t layout = 0;
+    uint32_t stride = 0; ///< interleaved vertex size in floats
+    uint64_t flags = 0;
+    uint64_t reserved[2] = {};
+};
+
+struct MeshCachePart
+{
+    uint64_t numVertices = 0;
+    uint64_t numIndices = 0;
+    uint64_t numSharedVertices = 0;
+    uint64_t vertexOffset = 0; ///< bytes from start of file, page-aligned
+    uint64_t indexOffset = 0;  ///< bytes from start of file, page-aligned
+    uint64_t compressedSize = 0; ///< bytes of compressMesh() data at vertexOffset if compressed
+};
+
+enum MeshCacheFlags : uint64_t
+{
+    Compressed = 1
+};
+
+static_assert(sizeof(MeshCacheHeader) == 64, "unexpected MeshCacheHeader size");
+static_assert(sizeof(MeshCachePart) == 48, "unexpected MeshCachePart size");
+
+size_t alignToPage(size_t n)
+{
+    return (n + PageSize - 1) / PageSize * PageSize;
+}
+
+void fillHeader(MeshCacheHeader& header, const MeshBuffer& mb)
+{
+    header.primitiveType = static_cast<uint32_t>(mb.getPrimitiveType());
+    header.attributes    = static_cast<uint32_t>(mb.getAttributes());
+    header.layout        = static_cast<uint32_t>(mb.getLayout());
+    header.stride        = static_cast<uint32_t>(mb.getVertexStride());
+}
+
+/// Streams of arena up to count items, in MeshArena layout for capacity count
+template<class T>
+void writeArena(std::ostream& os, const MeshArena<T>& arena, size_t count)
+{
+    const std::vector<size_t> offsets = MeshArena<T>::streamOffsets(arena.channels(), count);
+    const std::vector<char> zeros(MeshArena<T>::Alignment, 0);
+    for (size_t i = 0; i < arena.numStreams(); ++i)
+    {
+        const size_t n = count * arena.channels(i);
+        if (n > 0)
+            os.write(reinterpret_cast<const char*>(arena.stream(i)), static_cast<std::streamsize>(n * sizeof(T)));
+        os.write(zeros.data(), static_cast<std::streamsize>((offsets[i + 1] - offsets[i] - n) * sizeof(T)));
+    }
+}
+
+void pad(std::ostream& os, size_t pos)
+{
+    static const std::vector<char> zeros(PageSize, 0);
+    os.write(zeros.data(), static_cast<std::streamsize>(alignToPage(pos) - pos));
+}
+
+} // namespace
+
+bool writeMeshCache(const std::filesystem::path& filename, const std::vector<const MeshBuffer*>& parts, uint64_t key, bool compress)
+{
+    if (parts.empty())
+        return false;
+    for (const MeshBuffer* mb : parts)
+    {
+        if (!mb || mb->getPrimitiveType() != parts[0]->getPrimitiveType() || mb->getAttributes() != parts[0]->getAttributes()
+            || mb->getLayout() != parts[0]->getLayout() || mb->getVertexStride() != parts[0]->getVertexStride())
+            return false;
+    }
+
+    MeshCacheHeader header;
+    fillHeader(header, *parts[0]);
+    header.numParts = static_cast<uint32_t>(parts.size());
+    header.key = key;
+    header.flags = compress ? uint32_t(Compressed) : 0u;
+
+    std::vector<std::vector<uint8_t>> compressed(compress ? parts.size() : 0);
+    for (size_t i = 0; i < compressed.size(); ++i)
+        compressed[i] = compressMesh(*parts[i]);
+
+    // File layout
+    std::vector<MeshCachePart> table(parts.size());
+    size_t pos = alignToPage(sizeof(MeshCacheHeader) + table.size() * sizeof(MeshCachePart));
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        const MeshBuffer& mb = *parts[i];
+        MeshCachePart& part = table[i];
+        part.numVertices = mb.numVertices();
+        part.numIndices = mb.numIndices();
+        part.numSharedVertices = mb.numSharedVertices();
+
+        part.vertexOffset = pos;
+        if (compress)
+        {
+            part.compressedSize = compressed[i].size();
+            pos = alignToPage(pos + part.compressedSize);
+            continue;
+        }
+        pos = alignToPage(pos + MeshArena<float>::streamOffsets(mb.getVertexArena().channels(), mb.numVertices()).back() * sizeof(float));
+        part.indexOffset = pos;
+        pos = alignToPage(pos + MeshArena<unsigned>::streamOffsets(mb.getIndexArena().channels(), mb.numIndices()).back() * sizeof(unsigned));
+    }
+
+    std::filesystem::path tmp = filename;
+    tmp += ".tmp";
+    {
+        std::ofstream os(tmp, std::ios::binary);
+        if (!os.is_open())
+            return false;
+
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(table.size() * sizeof(MeshCachePart)));
+        pad(os, sizeof(MeshCacheHeader) + table.size() * sizeof(MeshCachePart));
+
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            if (compress)
+            {
+                os.write(reinterpret_cast<const char*>(compressed[i].data()), static_cast<std::streamsize>(compressed[i].size()));
+                pad(os, static_cast<size_t>(os.tellp()));
+                continue;
+            }
+            writeArena(os, parts[i]->getVertexArena(), table[i].numVertices);
+            pad(os, static_cast<size_t>(os.tellp()));
+            writeArena(os, parts[i]->getIndexArena(), table[i].numIndices);
+            pad(os, static_cast<size_t>(os.tellp()));
+        }
+
+        if (!os.good() || static_cast<size_t>(os.tellp()) != pos)
+            return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, filename, ec);
+    return !ec;
+}
+
+bool readMeshCache(const std::filesystem::path& filename, const std::vector<MeshBuffer*>& parts, uint64_t key)
+{
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(filename) || file->size() < sizeof(MeshCacheHeader))
+        return false;
+
+    const MeshCacheHeader& header = *reinterpret_cast<const MeshCacheHeader*>(file->data());
+    const MeshCacheHeader expected;
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != MeshCacheVersion
+        || header.byteOrder != ByteOrderTag || header.key != key || header.numParts != parts.size())
+        return false;
+    if (file->size() < sizeof(MeshCacheHeader) + parts.size() * sizeof(MeshCachePart))
+        return false;
+
+    const MeshCachePart* table = reinterpret_cast<const MeshCachePart*>(file->data() + sizeof(MeshCacheHeader));
+    const bool compressed = (header.flags & Compressed) != 0;
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        MeshCacheHeader h;
+        if (!parts[i])
+            return false;
+        fillHeader(h, *parts[i]);
+        if (h.primitiveType != header.primitiveType || h.attributes != header.attributes || h.layout != header.layout || h.stride != header.stride)
+            return false;
+
+        if (compressed)
+        {
+            if (table[i].vertexOffset + table[i].compressedSize > file->size())
+                return false;
+            continue;
+        }
+        const size_t vertexBytes = MeshArena<float>::streamOffsets(parts[i]->getVertexArena().channels(), table[i].numVertices).back() * sizeof(float);
+        const size_t indexBytes = MeshArena<unsigned>::streamOffsets(parts[i]->getIndexArena().channels(), table[i].numIndices).back() * sizeof(unsigned);
+        if (table[i].vertexOffset % PageSize != 0 || table[i].indexOffset % PageSize != 0
+            || table[i].vertexOffset + vertexBytes > file->size() || table[i].indexOffset + indexBytes > file->size())
+            return false;
+    }
+
+    if (compressed)
+    {
+        // Decode into scratch buffers so that parts stay unchanged on failure
+        std::vector<MeshBuffer> decoded;
+        decoded.reserve(parts.size());
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            decoded.emplace_back(parts[i]->getPrimitiveType(), parts[i]->getAttributes(), parts[i]->getLayout(), parts[i]->getVertexStride());
+            if (!decompressMesh(file->data() + table[i].vertexOffset, table[i].compressedSize, decoded.back()))
+                return false;
+        }
+        for (size_t i = 0; i < parts.size(); ++i)
+            *parts[i] = std::move(decoded[i]);
+        return true;
+    }
+
+    // Pointer setup, the arenas share ownership of the mapping
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        MeshBuffer& mb = *parts[i];
+        const MeshCachePart& part = table[i];
+        float* vertices = part.numVertices > 0 ? reinterpret_cast<float*>(file->data() + part.vertexOffset) : nullptr;
+        unsigned* indices = part.numIndices > 0 ? reinterpret_cast<unsigned*>(file->data() + part.indexOffset) : nullptr;
+
+        mb.setStorage(MeshArena<float>(mb.getVertexArena().channels(), part.numVertices, vertices, file),
+                      MeshArena<unsigned>(mb.getIndexArena().channels(), part.numIndices, indices, file));
+        mb.setNumVertices(part.numVertices);
+        mb.setNumIndices(part.numIndices);
+        mb.setNumSharedVertices(part.numSharedVertices);
+    }
+    return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+class MeshBuffer;
+
+/// Native binary container for one or more MeshBuffers with the same
+/// primitive type, attributes and vertex layout. A header page is followed by
+/// the vertex and index storage of each part, page-aligned and in MeshArena
+/// layout, so that loading is a memory mapping plus pointer setup.
+///
+/// The format is versioned and in native byte order, it is meant as a cache
+/// of generated meshes, not for exchange. key is an arbitrary user value,
+/// e.g. a hash of the parameters the mesh was generated with.
+
+/// Written to a temporary file first which is then renamed, so readers never
+/// see partial files. With compress the parts are stored with compressMesh(),
+/// which is lossy (quantized attributes) but several times smaller.
+bool writeMeshCache(const std::filesystem::path& filename, const std::vector<const MeshBuffer*>& parts, uint64_t key=0, bool compress=false);
+
+/// Fails unless the file matches key, the number of parts and their
+/// primitive type, attributes and layout. On success the parts use the
+/// mapped file as storage (copy-on-write) until they grow, compressed parts
+/// are decoded into own storage.
+bool readMeshCache(const std::filesystem::path& filename, const std::vector<MeshBuffer*>& parts, uint64_t key=0);
@@ -0,0 +1,235 @@
+#include "MeshClusters.h"
+#include "MeshBuffer.h"
+#include "Frustum.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/// Smallest dot product of a triangle normal with the mean normal below which
+/// the cone is too wide to cull anything
+constexpr float MinConeDot = .1f;
+
+void computeBounds(const MeshBuffer& mb, const std::vector<unsigned>& indices, MeshCluster& c)
+{
+    const unsigned* f = &indices[c.firstIndex];
+    float lo[3], hi[3];
+    for (int k = 0; k < 3; ++k)
+        lo[k] = hi[k] = mb.getVertexData(f[0])[k];
+    for (size_t i = 1; i < c.numIndices; ++i)
+    {
+        const float* p = mb.getVertexData(f[i]);
+        for (int k = 0; k < 3; ++k)
+        {
+            lo[k] = std::min(lo[k], p[k]);
+            hi[k] = std::max(hi[k], p[k]);
+        }
+    }
+    for (int k = 0; k < 3; ++k)
+        c.center[k] = .5f * (lo[k] + hi[k]);
+    float r2 = 0.f;
+    for (size_t i = 0; i < c.numIndices; ++i)
+    {
+        const float* p = mb.getVertexData(f[i]);
+        const float dx = p[0] - c.center[0], dy = p[1] - c.center[1], dz = p[2] - c.center[2];
+        r2 = std::max(r2, dx*dx + dy*dy + dz*dz);
+    }
+    c.radius = std::sqrt(r2);
+
+    // Normal cone from the unit face normals
+    std::vector<float> normals;
+    float axis[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < c.numIndices; i += 3)
+    {
+        const float* a = mb.getVertexData(f[i]);
+        const float* b = mb.getVertexData(f[i+1]);
+        const float* d = mb.getVertexData(f[i+2]);
+        const float e1[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+        const float e2[3] = { d[0]-a[0], d[1]-a[1], d[2]-a[2] };
+        float n[3] = { e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0] };
+        const float length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (length == 0.f)
+            continue;
+        for (int k = 0; k < 3; ++k)
+        {
+            n[k] /= length;
+            axis[k] += n[k];
+            normals.push_back(n[k]);
+        }
+    }
+    const float length = std::sqrt(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+    if (length == 0.f)
+        return;
+    for (int k = 0; k < 3; ++k)
+        c.coneAxis[k] = axis[k] / length;
+    float minDot = 1.f;
+    for (size_t i = 0; i < normals.size(); i += 3)
+        minDot = std::min(minDot, normals[i]*c.coneAxis[0] + normals[i+1]*c.coneAxis[1] + normals[i+2]*c.coneAxis[2]);
+    // Facing away from d if the angle between d and the axis is below 90 degrees minus the cone angle
+    c.coneCutoff = minDot > MinConeDot ? std::sqrt(1.f - minDot * minDot) : 1.f;
+}
+
+} // namespace
+
+std::vector<MeshCluster> buildClusters(MeshBuffer& mb, size_t maxVertices, size_t maxTriangles)
+{
+    std::vector<MeshCluster> clusters;
+    const size_t n = mb.numVertices();
+    const size_t nt = mb.numIndices() / 3;
+    if (mb.getPrimitiveType() != MeshPrimitiveType::Triangles || nt == 0 || maxVertices < 3 || maxTriangles == 0)
+        return clusters;
+
+    const std::vector<unsigned> indices(mb.getIndexData(), mb.getIndexData() + 3 * nt);
+
+    // Triangles per vertex
+    std::vector<unsigned> offsets(n + 1, 0);
+    for (unsigned v : indices)
+        ++offsets[v + 1];
+    for (size_t v = 0; v < n; ++v)
+        offsets[v + 1] += offsets[v];
+    std::vector<unsigned> adjacency(indices.size());
+    {
+        std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = static_cast<unsigned>(i / 3);
+    }
+
+    std::vector<char> emitted(nt, 0);
+    std::vector<size_t> owner(n, ~size_t(0)); ///< last cluster using the vertex
+    std::vector<unsigned> candidates;
+    std::vector<unsigned> order;
+    order.reserve(nt);
+    size_t seed = 0;
+
+    while (order.size() < nt)
+    {
+        const size_t id = clusters.size();
+        size_t numVertices = 0, numTriangles = 0;
+        candidates.clear();
+
+        auto newVertices = [&](unsigned t)
+        {
+            const unsigned* f = &indices[3 * t];
+            size_t count = 0;
+            for (int j = 0; j < 3; ++j)
+                if (owner[f[j]] != id && (j == 0 || f[j] != f[0]) && (j < 2 || f[j] != f[1]))
+                    ++count;
+            return count;
+        };
+        auto add = [&](unsigned t)
+        {
+            emitted[t] = 1;
+            order.push_back(t);
+            ++numTriangles;
+            for (int j = 0; j < 3; ++j)
+            {
+                const unsigned v = indices[3 * t + j];
+                if (owner[v] == id)
+                    continue;
+                owner[v] = id;
+                ++numVertices;
+                for (unsigned i = offsets[v]; i < offsets[v + 1]; ++i)
+                    if (!emitted[adjacency[i]])
+                        candidates.push_back(adjacency[i]);
+            }
+        };
+
+        while (numTriangles < maxTriangles)
+        {
+            // Neighbor adding the fewest vertices, else the next triangle in order
+            candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](unsigned t) { return emitted[t] != 0; }), candidates.end());
+            unsigned best = 0;
+            size_t bestNew = 4;
+            for (unsigned t : candidates)
+            {
+                const size_t k = newVertices(t);
+                if (k < bestNew)
+                {
+                    best = t;
+                    bestNew = k;
+                    if (k == 0)
+                        break;
+                }
+            }
+            if (bestNew == 4)
+            {
+                // A finished patch ends a cluster unless it is mostly empty
+                while (seed < nt && emitted[seed])
+                    ++seed;
+                if (seed == nt || numTriangles >= maxTriangles / 4)
+                    break;
+                best = static_cast<unsigned>(seed);
+                bestNew = newVertices(best);
+            }
+            if (numVertices + bestNew > maxVertices)
+                break;
+            add(best);
+        }
+
+        MeshCluster c;
+        c.firstIndex = 3 * (order.size() - numTriangles);
+        c.numIndices = 3 * numTriangles;
+        clusters.push_back(c);
+    }
+
+    unsigned* dst = mb.getIndexData();
+    for (size_t i = 0; i < nt; ++i)
+        std::copy(&indices[3 * order[i]], &indices[3 * order[i]] + 3, dst + 3 * i);
+
+    const std::vector<unsigned> reordered(dst, dst + 3 * nt);
+    for (MeshCluster& c : clusters)
+        computeBounds(mb, reordered, c);
+    return clusters;
+}
+
+size_t cullClusters(const std::vector<MeshCluster>& clusters, const Frustum& frustum, const float* eye, std::vector<MeshIndexRange>& ranges)
+{
+    ranges.clear();
+    size_t numVisible = 0;
+    for (const MeshCluster& c : clusters)
+    {
+        if (frustum.clip_sphere(c.center, c.radius) < 0)
+            continue;
+        if (eye)
+        {
+            const float d[3] = { c.center[0] - eye[0], c.center[1] - eye[1], c.center[2] - eye[2] };
+            const float distance = std::sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+            if (d[0]*c.coneAxis[0] + d[1]*c.coneAxis[1] + d[2]*c.coneAxis[2] >= c.coneCutoff * distance + c.radius)
+                continue;
+        }
+        if (!ranges.empty() && ranges.back().firstIndex + ranges.back().numIndices == c.firstIndex)
+            ranges.back().numIndices += c.numIndices;
+        else
+            ranges.push_back({ c.firstIndex, c.numIndices });
+        numVisible += c.numIndices;
+    }
+    return numVisible;
+}
+
+void eyePosition(const float modelview[16], float eye[3])
+{
+    // Solve A eye = -t for modelview = [A t] by Cramer's rule on the columns of A
+    const float* a0 = modelview;
+    const float* a1 = modelview + 4;
+    const float* a2 = modelview + 8;
+    auto cross = [](const float* u, const float* v, float* w)
+    {
+        w[0] = u[1]*v[2] - u[2]*v[1];
+        w[1] = u[2]*v[0] - u[0]*v[2];
+        w[2] = u[0]*v[1] - u[1]*v[0];
+    };
+    float c12[3], c20[3], c01[3];
+    cross(a1, a2, c12);
+    cross(a2, a0, c20);
+    cross(a0, a1, c01);
+    const float det = a0[0]*c12[0] + a0[1]*c12[1] + a0[2]*c12[2];
+    const float* t = modelview + 12;
+    if (det == 0.f)
+    {
+        eye[0] = eye[1] = eye[2] = 0.f;
+        return;
+    }
+    eye[0] = -(t[0]*c12[0] + t[1]*c12[1] + t[2]*c12[2]) / det;
+    eye[1] = -(t[0]*c20[0] + t[1]*c20[1] + t[2]*c20[2]) / det;
+    eye[2] = -(t[0]*c01[0] + t[1]*c01[1] + t[2]*c01[2]) / det;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+class MeshBuffer;
+class Frustum;
+
+/// Run of consecutive triangles with bounds for culling
+struct MeshCluster
+{
+    size_t firstIndex = 0;
+    size_t numIndices = 0;
+
+    float center[3] = { 0, 0, 0 }; ///< bounding sphere
+    float radius = 0.f;
+
+    /// All triangles face away from eyes inside the cone
+    ///   dot(center - eye, coneAxis) >= coneCutoff * |center - eye| + radius
+    /// coneCutoff 1 disables backface culling.
+    float coneAxis[3] = { 0, 0, 1 };
+    float coneCutoff = 1.f;
+};
+
+constexpr size_t DefaultClusterVertices = 64;
+constexpr size_t DefaultClusterTriangles = 124;
+
+/// Splits the triangles into clusters of at most maxVertices distinct
+/// vertices and maxTriangles triangles. Clusters grow over triangles which
+/// add the fewest new vertices, so they are compact patches. Reorders the
+/// triangles of mb so that each cluster is contiguous, vertices and the
+/// winding stay. Empty for other primitives than triangles.
+std::vector<MeshCluster> buildClusters(MeshBuffer& mb, size_t maxVertices=DefaultClusterVertices, size_t maxTriangles=DefaultClusterTriangles);
+
+/// Index range for glMultiDrawElements()
+struct MeshIndexRange
+{
+    size_t firstIndex;
+    size_t numIndices;
+};
+
+/// Ranges of the clusters inside the frustum and, with an eye position,
+/// not facing away from it. Frustum and eye are in mesh coordinates.
+/// Adjacent visible clusters give one range. Returns the number of visible
+/// indices.
+size_t cullClusters(const std::vector<MeshCluster>& clusters, const Frustum& frustum, const float* eye, std::vector<MeshIndexRange>& ranges);
+
+/// Eye position in the coordinates the modelview matrix (column major) maps
+/// from, i.e. the inverse transformed origin
+void eyePosition(const float modelview[16], float eye[3]);
@@ -0,0 +1,359 @@
+#include "MeshCompression.h"
+#include "MeshBuffer.h"
+#include "MeshBufferEncoding.h"
+#include <utils/ParallelFor.h>
+#include <utils/RansCodec.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring> // memcpy
+
+namespace {
+
+constexpr uint32_t MeshCompressionVersion = 1;
+
+struct MeshCompressionHeader
+{
+    char     magic[4] = { 'G','T','M','Z' };
+    uint32_t version = MeshCompressionVersion;
+    uint32_t primitiveType = 0;
+    uint32_t attributes = 0;
+    uint64_t numVertices = 0;
+    uint64_t numIndices = 0;
+    uint64_t numSharedVertices = 0;
+    float    positionOffset[3] = {};
+    float    positionScale[3] = {};
+    float    uvOffset[2] = {};
+    float    uvScale[2] = {};
+    uint32_t numStreams = 0; ///< followed by the encoded size of each stream as uint64
+};
+
+/// Value = offset + scale * u / 65535
+struct Quantizer
+{
+    float offset = 0.f;
+    float scale = 1.f;
+
+    uint16_t encode(float v) const
+    {
+        const float t = std::min(std::max((v - offset) / scale, 0.f), 1.f);
+        return static_cast<uint16_t>(std::lround(t * 65535.f));
+    }
+    float decode(uint16_t u) const { return offset + scale * (u / 65535.f); }
+};
+
+Quantizer boundingQuantizer(const MeshBuffer& mb, const float* (MeshBuffer::*data)(size_t) const, size_t n, size_t channel)
+{
+    Quantizer q;
+    if (n == 0)
+        return q;
+    float lo = (mb.*data)(0)[channel], hi = lo;
+    for (size_t i = 1; i < n; ++i)
+    {
+        const float v = (mb.*data)(i)[channel];
+        lo = std::min(lo, v);
+        hi = std::max(hi, v);
+    }
+    q.offset = lo;
+    q.scale = hi > lo ? hi - lo : 1.f;
+    return q;
+}
+
+// Zigzag mapping of wrapped differences to small unsigned values
+
+inline uint16_t zigzag16(uint16_t value, uint16_t prev)
+{
+    const int16_t d = static_cast<int16_t>(static_cast<uint16_t>(value - prev));
+    return static_cast<uint16_t>((static_cast<uint16_t>(d) << 1) ^ static_cast<uint16_t>(d >> 15));
+}
+
+inline uint16_t unzigzag16(uint16_t z, uint16_t prev)
+{
+    const uint16_t d = static_cast<uint16_t>((z >> 1) ^ (0u - (z & 1u)));
+    return static_cast<uint16_t>(prev + d);
+}
+
+inline uint8_t zigzag8(uint8_t value, uint8_t prev)
+{
+    const int8_t d = static_cast<int8_t>(static_cast<uint8_t>(value - prev));
+    return static_cast<uint8_t>((static_cast<uint8_t>(d) << 1) ^ static_cast<uint8_t>(d >> 7));
+}
+
+inline uint8_t unzigzag8(uint8_t z, uint8_t prev)
+{
+    const uint8_t d = static_cast<uint8_t>((z >> 1) ^ (0u - (z & 1u)));
+    return static_cast<uint8_t>(prev + d);
+}
+
+inline uint32_t zigzag32(int64_t d)
+{
+    const int32_t v = static_cast<int32_t>(d);
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+inline int64_t unzigzag32(uint32_t z)
+{
+    return static_cast<int32_t>((z >> 1) ^ (0u - (z & 1u)));
+}
+
+typedef std::vector<uint8_t> Plane;
+
+/// Delta coded 16-bit channel as low and high byte planes
+void addChannel16(const std::vector<uint16_t>& values, std::vector<Plane>& planes)
+{
+    Plane lo(values.size()), hi(values.size());
+    uint16_t prev = 0;
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        const uint16_t z = zigzag16(values[i], prev);
+        prev = values[i];
+        lo[i] = static_cast<uint8_t>(z & 0xff);
+        hi[i] = static_cast<uint8_t>(z >> 8);
+    }
+    planes.push_back(std::move(lo));
+    planes.push_back(std::move(hi));
+}
+
+std::vector<uint16_t> channel16(const Plane& lo, const Plane& hi)
+{
+    std::vector<uint16_t> values(lo.size());
+    uint16_t prev = 0;
+    for (size_t i = 0; i < values.size(); ++i)
+        prev = values[i] = unzigzag16(static_cast<uint16_t>(lo[i] | (hi[i] << 8)), prev);
+    return values;
+}
+
+} // namespace
+
+std::vector<uint8_t> compressMesh(const MeshBuffer& mb, unsigned numThreads)
+{
+    const size_t n = mb.numVertices();
+    const size_t numIndices = mb.numIndices();
+
+    MeshCompressionHeader header;
+    header.primitiveType = static_cast<uint32_t>(mb.getPrimitiveType());
+    header.attributes = static_cast<uint32_t>(mb.getAttributes());
+    header.numVertices = n;
+    header.numIndices = numIndices;
+    header.numSharedVertices = mb.numSharedVertices();
+
+    // Byte planes of all channels, see decompressMesh() for the order
+    std::vector<Plane> planes;
+    std::vector<uint16_t> values(n);
+    for (size_t c = 0; c < 3; ++c)
+    {
+        const Quantizer q = boundingQuantizer(mb, &MeshBuffer::getVertexData, n, c);
+        header.positionOffset[c] = q.offset;
+        header.positionScale[c] = q.scale;
+        for (size_t i = 0; i < n; ++i)
+            values[i] = q.encode(mb.getVertexData(i)[c]);
+        addChannel16(values, planes);
+    }
+
+    if (mb.hasNormals())
+    {
+        std::vector<uint16_t> octX(n), octY(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            int16_t oct[2];
+            packNormalOctahedral(mb.getNormalData(i), oct);
+            octX[i] = static_cast<uint16_t>(oct[0]);
+            octY[i] = static_cast<uint16_t>(oct[1]);
+        }
+        addChannel16(octX, planes);
+        addChannel16(octY, planes);
+    }
+
+    if (mb.hasColors())
+    {
+        std::vector<Plane> rgba(4, Plane(n));
+        uint32_t prev = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            const uint32_t packed = packColorRGBA8(mb.getColorData(i));
+            for (int c = 0; c < 4; ++c)
+                rgba[c][i] = zigzag8(static_cast<uint8_t>(packed >> (8 * c)), static_cast<uint8_t>(prev >> (8 * c)));
+            prev = packed;
+        }
+        for (auto& plane : rgba)
+            planes.push_back(std::move(plane));
+    }
+
+    if (mb.hasUVs())
+    {
+        for (size_t c = 0; c < 2; ++c)
+        {
+            const Quantizer q = boundingQuantizer(mb, &MeshBuffer::getUVData, n, c);
+            header.uvOffset[c] = q.offset;
+            header.uvScale[c] = q.scale;
+            for (size_t i = 0; i < n; ++i)
+                values[i] = q.encode(mb.getUVData(i)[c]);
+            addChannel16(values, planes);
+        }
+    }
+
+    // Indices relative to the high-water mark, new vertices in order code as 0
+    {
+        std::vector<Plane> bytes(4, Plane(numIndices));
+        const unsigned* indices = numIndices > 0 ? mb.getIndexData() : nullptr;
+        int64_t next = 0;
+        for (size_t i = 0; i < numIndices; ++i)
+        {
+            const uint32_t z = zigzag32(next - static_cast<int64_t>(indices[i]));
+            next = std::max<int64_t>(next, static_cast<int64_t>(indices[i]) + 1);
+            for (int b = 0; b < 4; ++b)
+                bytes[b][i] = static_cast<uint8_t>(z >> (8 * b));
+        }
+        for (auto& plane : bytes)
+            planes.push_back(std::move(plane));
+    }
+
+    // Entropy coding
+    std::vector<std::vector<uint8_t>> streams(planes.size());
+    parallelFor(planes.size(), numThreads, [&](size_t i)
+    {
+        ransEncode(planes[i].data(), planes[i].size(), streams[i]);
+    });
+
+    header.numStreams = static_cast<uint32_t>(streams.size());
+    std::vector<uint8_t> out(sizeof(header));
+    std::memcpy(out.data(), &header, sizeof(header));
+    for (const auto& s : streams)
+    {
+        const uint64_t size = s.size();
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&size);
+        out.insert(out.end(), p, p + sizeof(size));
+    }
+    for (const auto& s : streams)
+        out.insert(out.end(), s.begin(), s.end());
+    return out;
+}
+
+bool decompressMesh(const uint8_t* data, size_t size, MeshBuffer& mb, unsigned numThreads)
+{
+    MeshCompressionHeader header;
+    const MeshCompressionHeader expected;
+    if (size < sizeof(header))
+        return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != MeshCompressionVersion)
+        return false;
+
+    const MeshPrimitiveType type = static_cast<MeshPrimitiveType>(header.primitiveType);
+    const MeshVertexAttribute attributes = static_cast<MeshVertexAttribute>(header.attributes);
+    const size_t n = header.numVertices;
+    const size_t numIndices = header.numIndices;
+
+    // Stream table
+    const uint8_t* p = data + sizeof(header);
+    const uint8_t* const end = data + size;
+    if (static_cast<size_t>(end - p) / sizeof(uint64_t) < header.numStreams)
+        return false;
+    std::vector<const uint8_t*> begins(header.numStreams);
+    const uint8_t* s = p + header.numStreams * sizeof(uint64_t);
+    for (uint32_t i = 0; i < header.numStreams; ++i)
+    {
+        uint64_t streamSize;
+        std::memcpy(&streamSize, p + i * sizeof(uint64_t), sizeof(streamSize));
+        if (static_cast<uint64_t>(end - s) < streamSize)
+            return false;
+        begins[i] = s;
+        s += streamSize;
+    }
+    begins.push_back(s);
+
+    std::vector<Plane> planes(header.numStreams);
+    std::vector<char> ok(header.numStreams, 0);
+    parallelFor(planes.size(), numThreads, [&](size_t i)
+    {
+        const uint8_t* in = begins[i];
+        ok[i] = ransDecode(in, begins[i + 1], planes[i]) && in == begins[i + 1];
+    });
+    if (!std::all_of(ok.begin(), ok.end(), [](char c) { return c != 0; }))
+        return false;
+
+    // Plane order as in compressMesh()
+    size_t numPlanes = 3 * 2 + 4;
+    if (has(attributes, MeshVertexAttribute::Normal)) numPlanes += 2 * 2;
+    if (has(attributes, MeshVertexAttribute::Color))  numPlanes += 4;
+    if (has(attributes, MeshVertexAttribute::UV))     numPlanes += 2 * 2;
+    if (planes.size() != numPlanes)
+        return false;
+    for (size_t i = 0; i < numPlanes; ++i)
+        if (planes[i].size() != (i + 4 < numPlanes ? n : numIndices))
+            return false;
+
+    const bool sameAttributes = attributes == mb.getAttributes();
+    MeshBuffer result(type, attributes, mb.getLayout(), mb.isInterleaved() && sameAttributes ? mb.getVertexStride() : 0);
+    result.resize(n, numIndices / result.getNumVertsPerPrimitive());
+    result.setNumVertices(n);
+    result.setNumIndices(numIndices);
+    result.setNumSharedVertices(header.numSharedVertices);
+
+    size_t plane = 0;
+    for (size_t c = 0; c < 3; ++c, plane += 2)
+    {
+        const Quantizer q { header.positionOffset[c], header.positionScale[c] };
+        const std::vector<uint16_t> values = channel16(planes[plane], planes[plane + 1]);
+        for (size_t i = 0; i < n; ++i)
+            result.getVertexData(i)[c] = q.decode(values[i]);
+    }
+
+    if (result.hasNormals())
+    {
+        const std::vector<uint16_t> octX = channel16(planes[plane], planes[plane + 1]);
+        const std::vector<uint16_t> octY = channel16(planes[plane + 2], planes[plane + 3]);
+        plane += 4;
+        for (size_t i = 0; i < n; ++i)
+        {
+            const int16_t oct[2] = { static_cast<int16_t>(octX[i]), static_cast<int16_t>(octY[i]) };
+            unpackNormalOctahedral(oct, result.getNormalData(i));
+        }
+    }
+
+    if (result.hasColors())
+    {
+        uint8_t prev[4] = { 0, 0, 0, 0 };
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint32_t packed = 0;
+            for (int c = 0; c < 4; ++c)
+            {
+                prev[c] = unzigzag8(planes[plane + c][i], prev[c]);
+                packed |= static_cast<uint32_t>(prev[c]) << (8 * c);
+            }
+            unpackColorRGBA8(packed, result.getColorData(i));
+        }
+        plane += 4;
+    }
+
+    if (result.hasUVs())
+    {
+        for (size_t c = 0; c < 2; ++c, plane += 2)
+        {
+            const Quantizer q { header.uvOffset[c], header.uvScale[c] };
+            const std::vector<uint16_t> values = channel16(planes[plane], planes[plane + 1]);
+            for (size_t i = 0; i < n; ++i)
+                result.getUVData(i)[c] = q.decode(values[i]);
+        }
+    }
+
+    if (numIndices > 0)
+    {
+        unsigned* indices = result.getIndexData();
+        int64_t next = 0;
+        for (size_t i = 0; i < numIndices; ++i)
+        {
+            uint32_t z = 0;
+            for (int b = 0; b < 4; ++b)
+                z |= static_cast<uint32_t>(planes[plane + b][i]) << (8 * b);
+            const int64_t index = next - unzigzag32(z);
+            if (index < 0 || static_cast<size_t>(index) >= n)
+                return false;
+            indices[i] = static_cast<unsigned>(index);
+            next = std::max(next, index + 1);
+        }
+    }
+
+    mb = std::move(result);
+    return true;
+}
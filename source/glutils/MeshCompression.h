@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class MeshBuffer;
+
+/// Compact, lossy encoding of a MeshBuffer for caches and exports:
+///  - positions and UVs are quantized to 16 bits over their bounding box,
+///    normals to 2x16-bit octahedral and colors to RGBA8,
+///  - each attribute channel is delta coded against the previous vertex,
+///  - indices are coded relative to the highest index referenced so far,
+///    which is small for meshes whose vertices are created in order,
+///  - all values are split into byte planes and entropy coded (rANS).
+/// Topology, vertex order and the number of shared vertices are exact.
+/// Streams are encoded and decoded on numThreads threads (0 for one per
+/// hardware thread).
+std::vector<uint8_t> compressMesh(const MeshBuffer& mb, unsigned numThreads=1);
+
+/// Replaces the content of mb, keeping its vertex layout.
+/// Returns false on malformed input.
+bool decompressMesh(const uint8_t* data, size_t size, MeshBuffer& mb, unsigned numThreads=1);
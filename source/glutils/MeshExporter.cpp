@@ -0,0 +1,186 @@
+#include "MeshExporter.h"
+#include "MeshBuffer.h"
+#include "MeshBufferIO.h"
+#include "MeshBufferView.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <system_error>
+
+namespace {
+
+enum class ExportFormat { Unknown, OBJ, PLY, STL, GLB };
+
+ExportFormat formatFromExtension(const std::filesystem::path& filename)
+{
+    std::string ext = filename.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (ext == ".obj") return ExportFormat::OBJ;
+    if (ext == ".ply") return ExportFormat::PLY;
+    if (ext == ".stl") return ExportFormat::STL;
+    if (ext == ".glb") return ExportFormat::GLB;
+    return ExportFormat::Unknown;
+}
+
+/// Forwards to a file buffer, counts bytes and fails all writes once canceled
+class ProgressBuffer : public std::streambuf
+{
+public:
+    ProgressBuffer(std::streambuf* dst, std::atomic<size_t>& bytes, const std::atomic<bool>& cancel)
+    : m_dst(dst), m_bytes(bytes), m_cancel(cancel)
+    {}
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override
+    {
+        if (m_cancel.load())
+            return 0;
+        const std::streamsize written = m_dst->sputn(s, n);
+        m_bytes += static_cast<size_t>(written);
+        return written;
+    }
+
+    int overflow(int c) override
+    {
+        if (c == traits_type::eof())
+            return traits_type::not_eof(c);
+        const char ch = traits_type::to_char_type(c);
+        return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+    }
+
+    int sync() override { return m_dst->pubsync(); }
+
+private:
+    std::streambuf* m_dst;
+    std::atomic<size_t>& m_bytes;
+    const std::atomic<bool>& m_cancel;
+};
+
+} // namespace
+
+MeshExporter::~MeshExporter()
+{
+    cancel();
+    join();
+}
+
+bool MeshExporter::start(const std::filesystem::path& filename, const std::vector<const MeshBuffer*>& parts)
+{
+    if (isRunning() || formatFromExtension(filename) == ExportFormat::Unknown)
+        return false;
+
+    std::vector<std::shared_ptr<const MeshBuffer>> snapshot;
+    snapshot.reserve(parts.size());
+    for (const MeshBuffer* mb : parts)
+    {
+        if (mb)
+            snapshot.push_back(std::make_shared<const MeshBuffer>(*mb));
+    }
+    return start(filename, std::move(snapshot));
+}
+
+bool MeshExporter::start(const std::filesystem::path& filename, std::vector<std::shared_ptr<const MeshBuffer>> parts)
+{
+    if (isRunning() || formatFromExtension(filename) == ExportFormat::Unknown)
+        return false;
+    join();
+
+    m_cancel = false;
+    m_bytesWritten = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_status = Status();
+        m_status.state = State::Running;
+        m_status.filename = filename;
+        m_startTime = std::chrono::steady_clock::now();
+    }
+    m_running = true;
+    m_thread = std::thread(&MeshExporter::run, this, filename, std::move(parts), m_numThreads);
+    return true;
+}
+
+void MeshExporter::run(std::filesystem::path filename, std::vector<std::shared_ptr<const MeshBuffer>> parts, unsigned numThreads)
+{
+    std::filesystem::path tmp = filename;
+    tmp += ".tmp";
+
+    bool ok = false;
+    {
+        std::filebuf file;
+        if (file.open(tmp, std::ios::out | std::ios::binary | std::ios::trunc))
+        {
+            ProgressBuffer progress(&file, m_bytesWritten, m_cancel);
+            std::ostream os(&progress);
+            const MeshBufferView view(parts);
+            switch (formatFromExtension(filename))
+            {
+            case ExportFormat::OBJ: writeOBJ(os, view, numThreads); ok = true; break;
+            case ExportFormat::PLY: ok = writePLY(os, view); break;
+            case ExportFormat::STL: ok = writeSTL(os, view); break;
+            case ExportFormat::GLB: ok = writeGLB(os, view); break;
+            default: break;
+            }
+            os.flush();
+            ok = ok && os.good() && !m_cancel.load();
+            ok = file.close() != nullptr && ok;
+        }
+    }
+
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(tmp, filename, ec);
+    if (!ok || ec)
+        std::filesystem::remove(tmp, ec);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_status.state = m_cancel.load() ? State::Canceled : (ok && !ec ? State::Done : State::Failed);
+        m_status.bytesWritten = m_bytesWritten.load();
+        m_status.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+    }
+    m_running = false;
+}
+
+void MeshExporter::join()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void MeshExporter::cancel()
+{
+    if (isRunning())
+        m_cancel = true;
+}
+
+MeshExporter::Status MeshExporter::status() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Status status = m_status;
+    if (status.state == State::Running)
+    {
+        status.bytesWritten = m_bytesWritten.load();
+        status.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+    }
+    return status;
+}
+
+std::string MeshExporter::statusText() const
+{
+    const Status s = status();
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1);
+    const std::string name = s.filename.filename().string();
+    const double mb = s.bytesWritten / 1e6;
+    switch (s.state)
+    {
+    case State::Idle:     break;
+    case State::Running:  text << "Saving " << name << "... " << mb << " MB"; break;
+    case State::Done:     text << "Saved " << name << " (" << mb << " MB, " << s.seconds << "s)"; break;
+    case State::Failed:   text << "Saving " << name << " failed"; break;
+    case State::Canceled: text << "Saving " << name << " canceled"; break;
+    }
+    return text.str();
+}
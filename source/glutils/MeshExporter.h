@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MeshBuffer;
+
+/// Writes meshes on a background thread so that the frame loop keeps
+/// running. start() takes a snapshot of the parts, so the caller can modify
+/// or recompute them right away. The format follows the file extension
+/// (.obj, .ply, .stl or .glb), see MeshBufferIO.h. Files are written to a
+/// temporary name first and renamed when complete.
+class MeshExporter
+{
+public:
+    enum class State { Idle, Running, Done, Failed, Canceled };
+
+    struct Status
+    {
+        State state = State::Idle;
+        std::filesystem::path filename;
+        size_t bytesWritten = 0;
+        double seconds = 0.0; ///< elapsed, or total when finished
+    };
+
+    MeshExporter() = default;
+    MeshExporter(const MeshExporter&) = delete;
+    MeshExporter& operator=(const MeshExporter&) = delete;
+    /// Cancels a running export
+    ~MeshExporter();
+
+    /// Copies the parts and starts writing them as one mesh. Fails if an
+    /// export is running or the extension is unknown.
+    bool start(const std::filesystem::path& filename, const std::vector<const MeshBuffer*>& parts);
+
+    /// Start with shared snapshots without copying, see MeshSnapshot
+    bool start(const std::filesystem::path& filename, std::vector<std::shared_ptr<const MeshBuffer>> parts);
+
+    template<class T>
+    bool start(const std::filesystem::path& filename, const std::vector<std::shared_ptr<T>>& parts)
+    {
+        std::vector<const MeshBuffer*> ptrs;
+        for (const auto& p : parts)
+            ptrs.push_back(p.get());
+        return start(filename, ptrs);
+    }
+
+    bool isRunning() const { return m_running.load(); }
+    Status status() const;
+
+    /// Formatting threads of the next export, few so that it leaves the
+    /// cores to the frame loop and e.g. compute threads. 0 for one per
+    /// hardware thread. Only .obj files are formatted in parallel.
+    void setNumThreads(unsigned n) { m_numThreads = n; }
+    unsigned getNumThreads() const { return m_numThreads; }
+
+    /// Stops a running export at the next write, the partial file is removed
+    void cancel();
+
+    /// Status as one line for the UI, empty when idle
+    std::string statusText() const;
+
+private:
+    void run(std::filesystem::path filename, std::vector<std::shared_ptr<const MeshBuffer>> parts, unsigned numThreads);
+    void join();
+
+    std::thread m_thread;
+    std::atomic<bool> m_running = false;
+    std::atomic<bool> m_cancel = false;
+    std::atomic<size_t> m_bytesWritten = 0;
+    unsigned m_numThreads = 2;
+
+    mutable std::mutex m_mutex; ///< guards m_status except bytesWritten
+    Status m_status;
+    std::chrono::steady_clock::time_point m_startTime;
+};
@@ -0,0 +1,75 @@
+#include "MeshLOD.h"
+#include "MeshBuffer.h"
+#include <algorithm>
+#include <cmath>
+
+std::vector<MeshLOD> buildLODChain(std::shared_ptr<const MeshBuffer> base, unsigned numLevels, float ratio, MeshSimplifyOptions options,
+                                   const std::function<void(MeshBuffer&, MeshLOD&)>& finishLevel)
+{
+    std::vector<MeshLOD> levels;
+    if (!base)
+        return levels;
+    levels.push_back({ base, 0.f, {} });
+
+    while (levels.size() < numLevels)
+    {
+        const MeshLOD& previous = levels.back();
+        const size_t numTriangles = previous.mesh->numIndices() / 3;
+        options.targetTriangles = std::max<size_t>(1, static_cast<size_t>(ratio * numTriangles));
+
+        auto mesh = std::make_shared<MeshBuffer>(*previous.mesh);
+        const MeshSimplifyStats stats = simplifyMesh(*mesh, options);
+        if (stats.numTrianglesAfter * 10 > numTriangles * 9)
+            break;
+        mesh->reserveExact(mesh->numVertices(), mesh->numIndices() / 3);
+        MeshLOD level{ mesh, previous.error + stats.error, {} };
+        if (finishLevel)
+            finishLevel(*mesh, level);
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
+void boundingSphere(const MeshBuffer& mb, float center[3], float& radius)
+{
+    float lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 };
+    for (size_t v = 0; v < mb.numVertices(); ++v)
+    {
+        const float* p = mb.getVertexData(v);
+        for (int c = 0; c < 3; ++c)
+        {
+            lo[c] = v == 0 ? p[c] : std::min(lo[c], p[c]);
+            hi[c] = v == 0 ? p[c] : std::max(hi[c], p[c]);
+        }
+    }
+    float r2 = 0.f;
+    for (int c = 0; c < 3; ++c)
+    {
+        center[c] = .5f * (lo[c] + hi[c]);
+        r2 += .25f * (hi[c] - lo[c]) * (hi[c] - lo[c]);
+    }
+    radius = std::sqrt(r2);
+}
+
+unsigned selectLOD(const std::vector<MeshLOD>& levels, const float center[3], float radius,
+                   const float modelview[16], const float projection[16], float viewportHeight, float maxPixelError)
+{
+    if (levels.empty())
+        return 0;
+
+    // Pixels per world unit at the nearest point, constant for orthographic projections
+    float pixelsPerUnit = .5f * viewportHeight * projection[5];
+    if (projection[11] != 0.f)
+    {
+        const float scale = std::sqrt(modelview[0]*modelview[0] + modelview[1]*modelview[1] + modelview[2]*modelview[2]);
+        const float z = modelview[2]*center[0] + modelview[6]*center[1] + modelview[10]*center[2] + modelview[14];
+        const float distance = std::max(-z - scale * radius, 1e-4f);
+        pixelsPerUnit *= scale / distance;
+    }
+
+    unsigned level = 0;
+    for (unsigned i = 1; i < levels.size(); ++i)
+        if (levels[i].error * pixelsPerUnit <= maxPixelError)
+            level = i;
+    return level;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include "MeshClusters.h"
+#include "MeshSimplify.h"
+
+class MeshBuffer;
+
+/// One level of detail, level 0 is the full mesh
+struct MeshLOD
+{
+    std::shared_ptr<const MeshBuffer> mesh;
+    float error = 0.f; ///< world space deviation from level 0
+    std::vector<MeshCluster> clusters; ///< optional, see buildClusters()
+};
+
+/// Level 0 is base itself, each further level decimates the previous one to
+/// ratio of its triangles with simplifyMesh() and adds its error. Stops early
+/// when a level would remove less than a tenth of the triangles. The options'
+/// targetTriangles is ignored, a finite maxError limits each step.
+/// finishLevel is called on each coarser level while its mesh is still
+/// mutable, e.g. to optimize it or build its clusters, before the next level
+/// is decimated from it.
+std::vector<MeshLOD> buildLODChain(std::shared_ptr<const MeshBuffer> base, unsigned numLevels, float ratio=.5f, MeshSimplifyOptions options=MeshSimplifyOptions(),
+                                   const std::function<void(MeshBuffer&, MeshLOD&)>& finishLevel=nullptr);
+
+/// Sphere around the bounding box of the vertices
+void boundingSphere(const MeshBuffer& mb, float center[3], float& radius);
+
+/// Coarsest level whose error projects to at most maxPixelError pixels at
+/// the point of the bounding sphere nearest to the eye. Matrices are column
+/// major, e.g. glm::value_ptr(), viewportHeight in pixels.
+unsigned selectLOD(const std::vector<MeshLOD>& levels, const float center[3], float radius,
+                   const float modelview[16], const float projection[16], float viewportHeight, float maxPixelError=1.f);
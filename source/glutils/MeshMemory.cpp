@@ -0,0 +1,79 @@
+#include "MeshMemory.h"
+#include "MeshBuffer.h"
+#include <algorithm>
+
+MeshMemoryStats& MeshMemoryStats::operator += (const MeshMemoryStats& other)
+{
+    positions += other.positions;
+    normals   += other.normals;
+    colors    += other.colors;
+    uvs       += other.uvs;
+    indices   += other.indices;
+    total     += other.total;
+    external  += other.external;
+    return *this;
+}
+
+MeshMemoryStats memoryStats(const MeshBuffer& mb)
+{
+    MeshMemoryStats stats;
+    const MeshArena<float>& vertices = mb.getVertexArena();
+    const MeshArena<unsigned>& indices = mb.getIndexArena();
+    const size_t vertexCapacity = vertices.capacity();
+    const size_t numVertices = mb.numVertices();
+    const size_t numIndices = mb.numIndices();
+
+    auto attribute = [&](MeshMemoryUsage& usage, size_t channels)
+    {
+        usage.allocated = vertexCapacity * channels * sizeof(float);
+        usage.used = numVertices * channels * sizeof(float);
+    };
+    attribute(stats.positions, 3);
+    attribute(stats.normals, mb.hasNormals() ? 3 : 0);
+    attribute(stats.colors, mb.hasColors() ? 4 : 0);
+    attribute(stats.uvs, mb.hasUVs() ? 2 : 0);
+    stats.indices.allocated = indices.capacity() * sizeof(unsigned);
+    stats.indices.used = numIndices * sizeof(unsigned);
+
+    // Padding of the interleaved stride is used space without an attribute
+    const size_t vertexBytes = vertices.bytes();
+    const size_t vertexUsed = numVertices * mb.getVertexStride() * sizeof(float)
+                            + (mb.isInterleaved() ? 0 : stats.normals.used + stats.colors.used + stats.uvs.used);
+    stats.total.allocated = vertexBytes + indices.bytes();
+    stats.total.used = vertexUsed + stats.indices.used;
+    if (vertices.isExternal())
+        stats.external += vertexBytes;
+    if (indices.isExternal())
+        stats.external += indices.bytes();
+    return stats;
+}
+
+size_t meshMemoryAllocated()
+{
+    return meshArenaBytes();
+}
+
+size_t enforceMemoryBudget(const std::vector<MeshBuffer*>& idle, size_t budgetBytes)
+{
+    std::vector<std::pair<size_t, MeshBuffer*>> candidates;
+    for (MeshBuffer* mb : idle)
+    {
+        const MeshMemoryStats stats = memoryStats(*mb);
+        const size_t unused = stats.total.unused();
+        if (unused > 0 && stats.external == 0)
+            candidates.emplace_back(unused, mb);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    const size_t before = meshMemoryAllocated();
+    for (const auto& candidate : candidates)
+    {
+        if (meshMemoryAllocated() <= budgetBytes)
+            break;
+        MeshBuffer& mb = *candidate.second;
+        mb.reserveExact(mb.numVertices(), mb.numIndices() / mb.getNumVertsPerPrimitive());
+    }
+    const size_t after = meshMemoryAllocated();
+    return before > after ? before - after : 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+class MeshBuffer;
+
+/// Bytes reserved for an attribute and the part holding its elements
+struct MeshMemoryUsage
+{
+    size_t allocated = 0;
+    size_t used = 0;
+
+    size_t unused() const { return allocated - used; }
+    MeshMemoryUsage& operator += (const MeshMemoryUsage& other)
+    {
+        allocated += other.allocated;
+        used += other.used;
+        return *this;
+    }
+};
+
+/// Storage of one or more MeshBuffers by attribute. Interleaved vertices are
+/// split by their share of the stride, alignment padding is only counted in
+/// total(). External memory, e.g. a memory-mapped cache, is not allocated.
+struct MeshMemoryStats
+{
+    MeshMemoryUsage positions;
+    MeshMemoryUsage normals;
+    MeshMemoryUsage colors;
+    MeshMemoryUsage uvs;
+    MeshMemoryUsage indices;
+    MeshMemoryUsage total;
+    size_t external = 0; ///< bytes of memory not owned by the buffers
+
+    MeshMemoryStats& operator += (const MeshMemoryStats& other);
+};
+
+MeshMemoryStats memoryStats(const MeshBuffer& mb);
+
+/// Bytes currently allocated by all MeshBuffers of the process, see meshArenaBytes()
+size_t meshMemoryAllocated();
+
+/// Shrinks the storage of idle buffers to their contents, those with the
+/// most unused bytes first, until meshMemoryAllocated() is within
+/// budgetBytes or all are trimmed. The buffers must not be used by other
+/// threads meanwhile. Returns the number of bytes released.
+size_t enforceMemoryBudget(const std::vector<MeshBuffer*>& idle, size_t budgetBytes);
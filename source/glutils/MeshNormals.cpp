@@ -0,0 +1,142 @@
+#include "MeshNormals.h"
+#include "MeshBuffer.h"
+#include <utils/ParallelFor.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/// Smaller meshes are not worth a thread
+constexpr size_t MinTrianglesPerThread = 1 << 14;
+/// Upper bound of all per-thread accumulators together, in floats
+constexpr size_t MaxAccumulatorFloats = size_t(1) << 26;
+/// Vertices normalized together, as separate component arrays
+constexpr size_t NormalizeBlockSize = 64;
+
+inline void sub(const float* a, const float* b, float r[3]) { r[0] = a[0]-b[0]; r[1] = a[1]-b[1]; r[2] = a[2]-b[2]; }
+inline float dot(const float a[3], const float b[3]) { return a[0]*b[0] + a[1]*b[1] + a[2]*b[2]; }
+
+/// Angle between a and b given their lengths, 0 for degenerate edges
+inline float angle(const float a[3], const float b[3], float la, float lb)
+{
+    if (la <= 0.f || lb <= 0.f)
+        return 0.f;
+    return std::acos(std::clamp(dot(a, b) / (la * lb), -1.f, 1.f));
+}
+
+} // namespace
+
+bool computeNormals(MeshBuffer& mb, MeshNormalWeighting weighting, unsigned numThreads, size_t firstVertex, size_t numVertices)
+{
+    if (!mb.hasNormals() || mb.getPrimitiveType() != MeshPrimitiveType::Triangles)
+        return false;
+    const size_t n = mb.numVertices();
+    if (firstVertex >= n)
+        return true;
+    const size_t count = std::min(numVertices, n - firstVertex);
+    const size_t numTriangles = mb.numIndices() / 3;
+
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t numBlocks = std::max<size_t>(1, std::min({ size_t(numThreads), numTriangles / MinTrianglesPerThread,
+                                                            MaxAccumulatorFloats / (3 * count) }));
+
+    // Scatter the weighted face normals into one accumulator per block
+    std::vector<std::vector<float>> sums(numBlocks);
+    const unsigned* indices = mb.getIndexData();
+    parallelFor(numBlocks, unsigned(numBlocks), [&](size_t b)
+    {
+        std::vector<float>& sum = sums[b];
+        sum.assign(3 * count, 0.f);
+        const size_t end = (b + 1) * numTriangles / numBlocks;
+        for (size_t t = b * numTriangles / numBlocks; t < end; ++t)
+        {
+            const unsigned* tri = indices + 3*t;
+            if (tri[0] >= n || tri[1] >= n || tri[2] >= n)
+                continue;
+            // Offsets into the range wrap around below firstVertex
+            const size_t r[3] = { tri[0] - firstVertex, tri[1] - firstVertex, tri[2] - firstVertex };
+            if (r[0] >= count && r[1] >= count && r[2] >= count)
+                continue;
+
+            const float* p[3] = { mb.getVertexData(tri[0]), mb.getVertexData(tri[1]), mb.getVertexData(tri[2]) };
+            float e[3][3]; // edge j runs from corner j to the next
+            sub(p[1], p[0], e[0]);
+            sub(p[2], p[1], e[1]);
+            sub(p[0], p[2], e[2]);
+            // e0 x -e2, its length is twice the area
+            const float face[3] = {
+                e[2][1]*e[0][2] - e[2][2]*e[0][1],
+                e[2][2]*e[0][0] - e[2][0]*e[0][2],
+                e[2][0]*e[0][1] - e[2][1]*e[0][0]
+            };
+            float w[3] = { 1.f, 1.f, 1.f };
+            if (weighting == MeshNormalWeighting::Angle)
+            {
+                const float length = std::sqrt(dot(face, face));
+                if (length <= 0.f)
+                    continue;
+                const float l[3] = { std::sqrt(dot(e[0], e[0])), std::sqrt(dot(e[1], e[1])), std::sqrt(dot(e[2], e[2])) };
+                const float back[3][3] = { { -e[2][0], -e[2][1], -e[2][2] },
+                                           { -e[0][0], -e[0][1], -e[0][2] },
+                                           { -e[1][0], -e[1][1], -e[1][2] } };
+                for (int j = 0; j < 3; ++j)
+                    w[j] = angle(e[j], back[j], l[j], l[(j + 2) % 3]) / length;
+            }
+            for (int j = 0; j < 3; ++j)
+            {
+                if (r[j] >= count)
+                    continue;
+                float* s = &sum[3 * r[j]];
+                s[0] += w[j] * face[0];
+                s[1] += w[j] * face[1];
+                s[2] += w[j] * face[2];
+            }
+        }
+    });
+
+    // Sum the accumulators and normalize, the components are gathered into
+    // separate arrays so the length computation vectorizes
+    const size_t numNormalizeBlocks = (count + NormalizeBlockSize - 1) / NormalizeBlockSize;
+    parallelFor(numNormalizeBlocks, unsigned(numBlocks), [&](size_t block)
+    {
+        float x[NormalizeBlockSize], y[NormalizeBlockSize], z[NormalizeBlockSize], scale[NormalizeBlockSize];
+        const size_t begin = block * NormalizeBlockSize;
+        const size_t m = std::min(NormalizeBlockSize, count - begin);
+        for (size_t i = 0; i < m; ++i)
+        {
+            const float* s = &sums[0][3 * (begin + i)];
+            x[i] = s[0];
+            y[i] = s[1];
+            z[i] = s[2];
+        }
+        for (size_t b = 1; b < numBlocks; ++b)
+        {
+            for (size_t i = 0; i < m; ++i)
+            {
+                const float* s = &sums[b][3 * (begin + i)];
+                x[i] += s[0];
+                y[i] += s[1];
+                z[i] += s[2];
+            }
+        }
+        for (size_t i = 0; i < m; ++i)
+        {
+            const float length2 = x[i]*x[i] + y[i]*y[i] + z[i]*z[i];
+            scale[i] = length2 > 0.f ? 1.f / std::sqrt(length2) : 0.f;
+        }
+        for (size_t i = 0; i < m; ++i)
+        {
+            if (scale[i] == 0.f)
+                continue;
+            float* normal = mb.getNormalData(firstVertex + begin + i);
+            normal[0] = x[i] * scale[i];
+            normal[1] = y[i] * scale[i];
+            normal[2] = z[i] * scale[i];
+        }
+    });
+    mb.touch();
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+
+class MeshBuffer;
+
+enum class MeshNormalWeighting
+{
+    Area,  ///< face normals weighted by triangle area, cheap
+    Angle  ///< by the corner angle at the vertex, independent of the tessellation
+};
+
+/// Recomputes the vertex normals of a triangle mesh as the normalized
+/// weighted sum of the normals of the adjacent triangles, following their
+/// winding. Vertices without a non-degenerate triangle keep their normal.
+///
+/// Only vertices in [firstVertex, firstVertex+numVertices) are updated, from
+/// all triangles touching them, e.g. after moving these vertices. Include the
+/// neighbors of moved vertices in the range to update them as well.
+///
+/// Triangles are split into contiguous blocks, each accumulated by its own
+/// thread into a private array, which are summed and normalized in parallel.
+/// Uses numThreads threads (0 for one per hardware thread), small meshes and
+/// large ranges fewer. Returns false without normals or for other primitive
+/// types.
+bool computeNormals(MeshBuffer& mb, MeshNormalWeighting weighting=MeshNormalWeighting::Angle, unsigned numThreads=0,
+                    size_t firstVertex=0, size_t numVertices=std::numeric_limits<size_t>::max());
@@ -0,0 +1,188 @@
+#include "MeshOptimizer.h"
+#include "MeshBuffer.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+MeshCacheStats analyzeVertexCache(const MeshBuffer& mb, unsigned cacheSize)
+{
+    MeshCacheStats stats;
+    const size_t n = mb.numVertices();
+    const size_t numIndices = mb.numIndices();
+    stats.numPrimitives = numIndices / mb.getNumVertsPerPrimitive();
+    if (numIndices == 0)
+        return stats;
+
+    // Entry time per vertex, a vertex is cached while fewer than cacheSize
+    // vertices entered after it
+    const unsigned* indices = mb.getIndexData();
+    std::vector<int64_t> entered(n, -int64_t(cacheSize) - 1);
+    std::vector<bool> seen(n, false);
+    int64_t time = 0;
+    for (size_t i = 0; i < numIndices; ++i)
+    {
+        const unsigned v = indices[i];
+        if (v >= n)
+            continue;
+        if (time - entered[v] > int64_t(cacheSize))
+        {
+            entered[v] = ++time;
+            ++stats.numTransformed;
+        }
+        if (!seen[v])
+        {
+            seen[v] = true;
+            ++stats.numVertices;
+        }
+    }
+    return stats;
+}
+
+bool optimizeVertexCache(MeshBuffer& mb, unsigned cacheSize)
+{
+    if (mb.getPrimitiveType() != MeshPrimitiveType::Triangles)
+        return false;
+
+    const size_t n = mb.numVertices();
+    const size_t numTriangles = mb.numIndices() / 3;
+    if (numTriangles == 0)
+        return true;
+    unsigned* indices = mb.getIndexData();
+
+    // Vertex to triangle adjacency
+    std::vector<unsigned> offsets(n + 1, 0);
+    for (size_t i = 0; i < numTriangles * 3; ++i)
+        ++offsets[indices[i] + 1];
+    for (size_t v = 0; v < n; ++v)
+        offsets[v + 1] += offsets[v];
+    std::vector<unsigned> adjacency(numTriangles * 3);
+    {
+        std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < numTriangles * 3; ++i)
+            adjacency[fill[indices[i]]++] = static_cast<unsigned>(i / 3);
+    }
+
+    std::vector<unsigned> live(n);
+    for (size_t v = 0; v < n; ++v)
+        live[v] = offsets[v + 1] - offsets[v];
+
+    const int64_t k = cacheSize;
+    std::vector<int64_t> cacheTime(n, -k - 1);
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<unsigned> deadEnd;
+    std::vector<unsigned> candidates;
+    std::vector<unsigned> result;
+    result.reserve(numTriangles * 3);
+
+    int64_t time = k + 1;
+    size_t cursor = 0;
+    auto nextLive = [&]() -> int64_t
+    {
+        while (!deadEnd.empty())
+        {
+            const unsigned d = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[d] > 0)
+                return d;
+        }
+        for (; cursor < n; ++cursor)
+            if (live[cursor] > 0)
+                return static_cast<int64_t>(cursor);
+        return -1;
+    };
+
+    int64_t fanning = nextLive();
+    while (fanning >= 0)
+    {
+        candidates.clear();
+        for (unsigned a = offsets[fanning]; a < offsets[fanning + 1]; ++a)
+        {
+            const unsigned t = adjacency[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = true;
+            for (int j = 0; j < 3; ++j)
+            {
+                const unsigned v = indices[3 * t + j];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cacheTime[v] > k)
+                    cacheTime[v] = time++;
+            }
+        }
+
+        // Prefer the candidate longest in cache whose remaining triangles
+        // still fit into it
+        int64_t best = -1;
+        int64_t bestPriority = -1;
+        for (unsigned v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * int64_t(live[v]) <= k)
+                priority = time - cacheTime[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+        fanning = best >= 0 ? best : nextLive();
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+    mb.touch();
+    return true;
+}
+
+void optimizeVertexFetch(MeshBuffer& mb, size_t numFixedLeading)
+{
+    const size_t n = mb.numVertices();
+    const size_t numIndices = mb.numIndices();
+    const size_t end = n - mb.numSharedVertices();
+    numFixedLeading = std::min(numFixedLeading, end);
+    if (end - numFixedLeading < 2)
+        return;
+
+    // New position of each vertex, movable ones by first use
+    constexpr unsigned Unassigned = ~0u;
+    std::vector<unsigned> remap(n, Unassigned);
+    for (size_t v = 0; v < numFixedLeading; ++v)
+        remap[v] = static_cast<unsigned>(v);
+    for (size_t v = end; v < n; ++v)
+        remap[v] = static_cast<unsigned>(v);
+
+    unsigned next = static_cast<unsigned>(numFixedLeading);
+    unsigned* indices = numIndices > 0 ? mb.getIndexData() : nullptr;
+    for (size_t i = 0; i < numIndices; ++i)
+    {
+        if (remap[indices[i]] == Unassigned)
+            remap[indices[i]] = next++;
+    }
+    for (size_t v = numFixedLeading; v < end; ++v)
+    {
+        if (remap[v] == Unassigned)
+            remap[v] = next++;
+    }
+
+    for (size_t i = 0; i < numIndices; ++i)
+        indices[i] = remap[indices[i]];
+
+    std::vector<float> tmp;
+    auto permute = [&](auto data, size_t channels)
+    {
+        tmp.resize(n * channels);
+        for (size_t v = 0; v < n; ++v)
+            std::copy(data(v), data(v) + channels, &tmp[remap[v] * channels]);
+        for (size_t v = 0; v < n; ++v)
+            std::copy(&tmp[v * channels], &tmp[v * channels] + channels, data(v));
+    };
+                       permute([&](size_t v) { return mb.getVertexData(v); }, 3);
+    if (mb.hasNormals()) permute([&](size_t v) { return mb.getNormalData(v); }, 3);
+    if (mb.hasColors())  permute([&](size_t v) { return mb.getColorData(v);  }, 4);
+    if (mb.hasUVs())     permute([&](size_t v) { return mb.getUVData(v);     }, 2);
+    mb.touch();
+}
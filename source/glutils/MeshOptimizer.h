@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+
+class MeshBuffer;
+
+/// Post-transform vertex cache statistics of an index buffer, simulated as
+/// a FIFO cache of cacheSize vertices.
+struct MeshCacheStats
+{
+    size_t numPrimitives = 0;
+    size_t numVertices = 0;    ///< distinct vertices referenced
+    size_t numTransformed = 0; ///< cache misses
+
+    /// Average cache miss ratio, transformed vertices per triangle (0.5 to 3)
+    float acmr() const { return numPrimitives ? float(numTransformed) / numPrimitives : 0.f; }
+    /// Average transform to vertex ratio (1 is optimal)
+    float atvr() const { return numVertices ? float(numTransformed) / numVertices : 0.f; }
+
+    MeshCacheStats& operator += (const MeshCacheStats& other)
+    {
+        numPrimitives += other.numPrimitives;
+        numVertices += other.numVertices;
+        numTransformed += other.numTransformed;
+        return *this;
+    }
+};
+
+constexpr unsigned DefaultVertexCacheSize = 16;
+
+MeshCacheStats analyzeVertexCache(const MeshBuffer& mb, unsigned cacheSize=DefaultVertexCacheSize);
+
+/// Reorders the triangles of mb for post-transform cache reuse (Tipsify,
+/// Sander et al. 2007), linear in the mesh size. Vertices are not moved.
+/// Returns false for other primitive types.
+bool optimizeVertexCache(MeshBuffer& mb, unsigned cacheSize=DefaultVertexCacheSize);
+
+/// Reorders the vertices of mb by first use in the index buffer, so that
+/// vertex fetches run mostly sequential. The first numFixedLeading vertices
+/// and the shared tail keep their positions, e.g. the seams of stitched
+/// slices. Unreferenced vertices are moved behind the referenced ones.
+void optimizeVertexFetch(MeshBuffer& mb, size_t numFixedLeading=0);
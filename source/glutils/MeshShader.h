@@ -11,9 +11,13 @@
 class MeshShader
 {
 public:
-    MeshShader(MeshVertexAttribute attributes, const char* glslVersionString="#version 330") // 150, 330
+    /// normalFormat must match the MeshVertexFormat of the drawn GLMeshObjects,
+    /// octahedral normals are decoded in the vertex shader.
+    MeshShader(MeshVertexAttribute attributes, const char* glslVersionString="#version 330", // 150, 330
+               MeshNormalFormat normalFormat=MeshNormalFormat::Float)
     : m_attributes(attributes),
-      m_glslVersionString(glslVersionString)
+      m_glslVersionString(glslVersionString),
+      m_normalFormat(normalFormat)
     {}
 
     bool load()
@@ -22,7 +26,8 @@ public:
         string defines = m_glslVersionString+"\n" 
             + (has(m_attributes, MeshVertexAttribute::Normal) ? "#define HAS_ATTRIBUTE_NORMAL\n" : "")
             + (has(m_attributes, MeshVertexAttribute::Color)  ? "#define HAS_ATTRIBUTE_COLOR\n"  : "")
-            + (has(m_attributes, MeshVertexAttribute::UV)     ? "#define HAS_ATTRIBUTE_UV\n"     : "");
+            + (has(m_attributes, MeshVertexAttribute::UV)     ? "#define HAS_ATTRIBUTE_UV\n"     : "")
+            + (m_normalFormat == MeshNormalFormat::Octahedral ? "#define OCTAHEDRAL_NORMAL\n"    : "");
         const string vertex_shader   = defines + c_vertex_shader;
         const string fragment_shader = defines + c_fragment_shader;
 
@@ -34,6 +39,8 @@ public:
             m_loc_color   = glGetUniformLocation(program, "uniform_color");
             m_loc_shading = glGetUniformLocation(program, "shading");
             m_loc_mvp     = glGetUniformLocation(program, "m4_mvp");
+            m_loc_position_scale  = glGetUniformLocation(program, "v3_position_scale");
+            m_loc_position_offset = glGetUniformLocation(program, "v3_position_offset");
             GL::checkGLError("MeshShader::load() - glGetUniformLocation");
         }
 
@@ -49,6 +56,14 @@ public:
         glUniform4fv(m_loc_color, 1, m_uniforms.color);
     }
 
+    /// Dequantization of positions, see GLMeshObject::getPositionScale().
+    /// Call after bind(), which resets it to identity.
+    void setPositionDecode( const float scale[3], const float offset[3] )
+    {
+        glUniform3fv(m_loc_position_scale, 1, scale);
+        glUniform3fv(m_loc_position_offset, 1, offset);
+    }
+
     void bind( float* mvp=nullptr )
     {
         m_program.bind();
@@ -71,6 +86,8 @@ public:
             glUniformMatrix4fv(m_loc_mvp, 1, GL_FALSE, mvp);
         glUniform4fv(m_loc_color, 1, m_uniforms.color);
         glUniform1i(m_loc_shading, (int)m_uniforms.shading);
+        const float one[3] = { 1.f,1.f,1.f }, zero[3] = { 0.f,0.f,0.f };
+        setPositionDecode(one, zero);
         GL::checkGLError("MeshShader::bind() - glGetUniformLocation");
     }
 
@@ -85,19 +102,33 @@ public:
 private:
     MeshVertexAttribute m_attributes;
     std::string m_glslVersionString;
+    MeshNormalFormat m_normalFormat;
     Uniforms m_uniforms;
 
     GL::GLSLProgram m_program;
     GLint m_loc_color   =-1;
     GLint m_loc_shading =-1;
     GLint m_loc_mvp     =-1;
+    GLint m_loc_position_scale  =-1;
+    GLint m_loc_position_offset =-1;
 
     // layout(location = 0) 
     const char* c_vertex_shader = R"(
 in vec3 v3_position;
 out vec3 position;
 #ifdef HAS_ATTRIBUTE_NORMAL
+#ifdef OCTAHEDRAL_NORMAL
+in vec2 v3_normal;
+vec3 decode_normal(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+#else
 in vec3 v3_normal;
+#define decode_normal(n) (n)
+#endif
 out vec3 normal;
 #endif
 #ifdef HAS_ATTRIBUTE_UV
@@ -109,11 +140,14 @@ in vec4 v4_color;
 out vec4 color;
 #endif
 uniform mat4 m4_mvp;
+uniform vec3 v3_position_scale;
+uniform vec3 v3_position_offset;
 void main() 
 {
-    gl_Position = m4_mvp*vec4(v3_position, 1.0);
+    vec3 p = v3_position*v3_position_scale + v3_position_offset;
+    gl_Position = m4_mvp*vec4(p, 1.0);
 #ifdef HAS_ATTRIBUTE_NORMAL
-    normal = v3_normal;
+    normal = decode_normal(v3_normal);
 #endif
 #ifdef HAS_ATTRIBUTE_UV
     uv = v2_texcoord;
@@ -121,7 +155,7 @@ void main()
 #ifdef HAS_ATTRIBUTE_COLOR
     color = v4_color;
 #endif
-    position = v3_position;
+    position = p;
 };
 )";
 
@@ -0,0 +1,484 @@
+#include "MeshSimplify.h"
+#include "MeshBuffer.h"
+#include <utils/ParallelFor.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr unsigned NoPartition = ~0u;
+
+/// Vertex states, vertices on a boundary collapse along it only
+constexpr char Free = 0, Locked = 1, OnBoundary = 2;
+
+/// Triangles around a vertex after a collapse, larger fans (e.g. on flat
+/// regions that collapse for free) only make slivers
+constexpr size_t MaxValence = 24;
+
+/// Symmetric 4x4 matrix of the squared distance to a set of planes,
+/// weighted by the areas of their triangles
+struct Quadric
+{
+    double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+    double weight = 0;
+
+    void addPlane(double a, double b, double c, double d, double w)
+    {
+        xx += w*a*a; xy += w*a*b; xz += w*a*c; xw += w*a*d;
+        yy += w*b*b; yz += w*b*c; yw += w*b*d;
+        zz += w*c*c; zw += w*c*d;
+        ww += w*d*d;
+        weight += w;
+    }
+
+    Quadric& operator += (const Quadric& q)
+    {
+        xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+        yy += q.yy; yz += q.yz; yw += q.yw;
+        zz += q.zz; zw += q.zw;
+        ww += q.ww;
+        weight += q.weight;
+        return *this;
+    }
+
+    /// Mean squared distance
+    double evaluate(const float* p) const
+    {
+        if (weight <= 0.0)
+            return 0.0;
+        const double x = p[0], y = p[1], z = p[2];
+        return (x*x*xx + 2*x*y*xy + 2*x*z*xz + 2*x*xw
+             + y*y*yy + 2*y*z*yz + 2*y*yw
+             + z*z*zz + 2*z*zw
+             + ww) / weight;
+    }
+};
+
+inline void triangleNormal(const float* a, const float* b, const float* c, double n[3])
+{
+    const double e1[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+    const double e2[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+    n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+struct Collapse
+{
+    double cost;
+    unsigned from, to; ///< local vertices, from is removed
+    unsigned stamp;    ///< of from, outdated once from or a neighbor changes
+
+    bool operator < (const Collapse& c) const { return cost > c.cost; } // min-heap
+};
+
+inline uint64_t edgeKey(uint64_t a, uint64_t b)
+{
+    return a < b ? (a << 32 | b) : (b << 32 | a);
+}
+
+/// Simplifies the index triples in tris in place, locked vertices stay.
+/// boundaryEdges are the sorted keys of the open edges if vertices may
+/// slide along them. Returns the largest cost of a collapse.
+double simplifyPartition(const MeshBuffer& mb, const std::vector<char>& locked, const std::vector<uint64_t>& boundaryEdges,
+                         std::vector<unsigned>& tris, size_t target, double maxCost)
+{
+    // Local vertex numbering
+    std::vector<unsigned> global(tris);
+    std::sort(global.begin(), global.end());
+    global.erase(std::unique(global.begin(), global.end()), global.end());
+    const size_t nv = global.size();
+    const size_t nt = tris.size() / 3;
+    std::vector<unsigned> local(tris.size());
+    for (size_t i = 0; i < tris.size(); ++i)
+        local[i] = static_cast<unsigned>(std::lower_bound(global.begin(), global.end(), tris[i]) - global.begin());
+
+    auto position = [&](unsigned v) { return mb.getVertexData(global[v]); };
+    auto isLocked = [&](unsigned v) { return locked[global[v]] == Locked; };
+    auto onBoundary = [&](unsigned v) { return locked[global[v]] == OnBoundary; };
+
+    std::vector<Quadric> quadrics(nv);
+    std::vector<std::vector<unsigned>> adjacency(nv);
+    for (size_t t = 0; t < nt; ++t)
+    {
+        const unsigned* f = &local[3 * t];
+        double n[3];
+        triangleNormal(position(f[0]), position(f[1]), position(f[2]), n);
+        const double length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (length > 0.0)
+        {
+            const float* p = position(f[0]);
+            const double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+            Quadric q;
+            q.addPlane(a, b, c, -(a*p[0] + b*p[1] + c*p[2]), 0.5 * length);
+            for (int j = 0; j < 3; ++j)
+                quadrics[f[j]] += q;
+
+            // Boundary edges add a plane through the edge perpendicular to
+            // the triangle, weighted by its squared length like an area
+            for (int j = 0; j < 3; ++j)
+            {
+                const unsigned v0 = f[j], v1 = f[(j + 1) % 3];
+                if ((!onBoundary(v0) && !onBoundary(v1)) || !std::binary_search(boundaryEdges.begin(), boundaryEdges.end(), edgeKey(global[v0], global[v1])))
+                    continue;
+                const float* p0 = position(v0);
+                const float* p1 = position(v1);
+                const double e[3] = { double(p1[0]) - p0[0], double(p1[1]) - p0[1], double(p1[2]) - p0[2] };
+                double m[3] = { e[1]*c - e[2]*b, e[2]*a - e[0]*c, e[0]*b - e[1]*a };
+                const double lengthM = std::sqrt(m[0]*m[0] + m[1]*m[1] + m[2]*m[2]);
+                if (lengthM <= 0.0)
+                    continue;
+                for (int i = 0; i < 3; ++i)
+                    m[i] /= lengthM;
+                Quadric qb;
+                qb.addPlane(m[0], m[1], m[2], -(m[0]*p0[0] + m[1]*p0[1] + m[2]*p0[2]), e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+                quadrics[v0] += qb;
+                quadrics[v1] += qb;
+            }
+        }
+        for (int j = 0; j < 3; ++j)
+            adjacency[f[j]].push_back(static_cast<unsigned>(t));
+    }
+
+    std::vector<unsigned> stamps(nv, 0);
+    std::vector<char> removed(nv, 0);
+    std::vector<char> deadTriangle(nt, 0);
+
+    auto contains = [&](size_t t, unsigned v) { return local[3*t] == v || local[3*t+1] == v || local[3*t+2] == v; };
+    auto dropDeadTriangles = [&](unsigned v)
+    {
+        auto& a = adjacency[v];
+        a.erase(std::remove_if(a.begin(), a.end(), [&](unsigned t) { return deadTriangle[t] != 0; }), a.end());
+    };
+    std::vector<unsigned> neighborsFrom, neighborsTo;
+    auto neighbors = [&](unsigned v, std::vector<unsigned>& out)
+    {
+        out.clear();
+        dropDeadTriangles(v);
+        for (unsigned t : adjacency[v])
+            for (int j = 0; j < 3; ++j)
+                if (local[3*t+j] != v)
+                    out.push_back(local[3*t+j]);
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    };
+
+    // Each vertex has one candidate in the heap, the cheapest collapse into
+    // a neighbor which was not rejected since the vertex last changed
+    std::priority_queue<Collapse> heap;
+    std::vector<std::vector<unsigned>> rejected(nv);
+    std::vector<unsigned> candidates;
+    auto pushCheapest = [&](unsigned from)
+    {
+        if (isLocked(from) || removed[from])
+            return;
+        neighbors(from, candidates);
+        Collapse best = { 0.0, from, from, stamps[from] };
+        for (unsigned to : candidates)
+        {
+            if (std::find(rejected[from].begin(), rejected[from].end(), to) != rejected[from].end())
+                continue;
+            Quadric q = quadrics[from];
+            q += quadrics[to];
+            const double cost = q.evaluate(position(to));
+            if (best.to == from || cost < best.cost)
+            {
+                best.cost = cost;
+                best.to = to;
+            }
+        }
+        if (best.to != from)
+            heap.push(best);
+    };
+    for (unsigned v = 0; v < nv; ++v)
+        pushCheapest(v);
+
+    std::vector<unsigned> common;
+    auto canCollapse = [&](unsigned u, unsigned v)
+    {
+        // Edge must exist and its link must be the opposite vertices of its triangles only
+        dropDeadTriangles(u);
+        dropDeadTriangles(v);
+        size_t numShared = 0;
+        for (unsigned t : adjacency[u])
+            numShared += contains(t, v) ? 1 : 0;
+        if (numShared == 0)
+            return false;
+        neighbors(u, neighborsFrom);
+        neighbors(v, neighborsTo);
+        common.clear();
+        std::set_intersection(neighborsFrom.begin(), neighborsFrom.end(), neighborsTo.begin(), neighborsTo.end(), std::back_inserter(common));
+        if (common.size() != numShared)
+            return false;
+        // Unlocked vertices have all their triangles here, so a single one
+        // means a boundary edge
+        if (onBoundary(u) && numShared != 1)
+            return false;
+        if (adjacency[u].size() + adjacency[v].size() - 2 * numShared > MaxValence)
+            return false;
+
+        // No new edges between locked vertices, e.g. across a seam, where the
+        // other side may already have that edge
+        if (isLocked(v))
+        {
+            for (unsigned w : neighborsFrom)
+                if (w != v && isLocked(w) && !std::binary_search(neighborsTo.begin(), neighborsTo.end(), w))
+                    return false;
+        }
+
+        // No flipped or degenerate triangles around u
+        for (unsigned t : adjacency[u])
+        {
+            if (contains(t, v))
+                continue;
+            const float* p[3];
+            const float* q[3];
+            for (int j = 0; j < 3; ++j)
+            {
+                p[j] = position(local[3*t+j]);
+                q[j] = local[3*t+j] == u ? position(v) : p[j];
+            }
+            double n0[3], n1[3];
+            triangleNormal(p[0], p[1], p[2], n0);
+            triangleNormal(q[0], q[1], q[2], n1);
+            const double dot = n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2];
+            const double len0 = n0[0]*n0[0] + n0[1]*n0[1] + n0[2]*n0[2];
+            const double len1 = n1[0]*n1[0] + n1[1]*n1[1] + n1[2]*n1[2];
+            if (dot <= 0.0 || dot * dot < 0.25 * len0 * len1)
+                return false;
+        }
+        return true;
+    };
+
+    size_t alive = nt;
+    double maxCollapseCost = 0.0;
+    while (alive > target && !heap.empty())
+    {
+        const Collapse c = heap.top();
+        heap.pop();
+        if (c.cost > maxCost)
+            break;
+        const unsigned u = c.from, v = c.to;
+        if (removed[u] || removed[v] || stamps[u] != c.stamp)
+            continue;
+        if (!canCollapse(u, v))
+        {
+            rejected[u].push_back(v);
+            pushCheapest(u);
+            continue;
+        }
+
+        // Collapse u into v
+        for (unsigned t : adjacency[u])
+        {
+            if (contains(t, v))
+            {
+                deadTriangle[t] = 1;
+                --alive;
+                continue;
+            }
+            for (int j = 0; j < 3; ++j)
+                if (local[3*t+j] == u)
+                    local[3*t+j] = v;
+            adjacency[v].push_back(t);
+        }
+        adjacency[u].clear();
+        removed[u] = 1;
+        quadrics[v] += quadrics[u];
+        maxCollapseCost = std::max(maxCollapseCost, c.cost);
+
+        // The candidates of v and its neighbors change
+        neighbors(v, neighborsTo);
+        neighborsTo.push_back(v);
+        for (unsigned w : neighborsTo)
+        {
+            ++stamps[w];
+            rejected[w].clear();
+            pushCheapest(w);
+        }
+    }
+
+    size_t out = 0;
+    for (size_t t = 0; t < nt; ++t)
+    {
+        if (deadTriangle[t])
+            continue;
+        for (int j = 0; j < 3; ++j)
+            tris[3*out + j] = global[local[3*t + j]];
+        ++out;
+    }
+    tris.resize(3 * out);
+    return maxCollapseCost;
+}
+
+} // namespace
+
+MeshSimplifyStats simplifyMesh(MeshBuffer& mb, const MeshSimplifyOptions& options)
+{
+    MeshSimplifyStats stats;
+    const size_t n = mb.numVertices();
+    const size_t numTriangles = mb.numIndices() / 3;
+    stats.numVerticesBefore = stats.numVerticesAfter = n;
+    stats.numTrianglesBefore = stats.numTrianglesAfter = numTriangles;
+    if (mb.getPrimitiveType() != MeshPrimitiveType::Triangles || numTriangles == 0 || numTriangles <= options.targetTriangles)
+        return stats;
+
+    const unsigned numThreads = options.numThreads ? options.numThreads : std::max(1u, std::thread::hardware_concurrency());
+    const unsigned numPartitions = std::max(1u, options.numPartitions ? options.numPartitions : numThreads);
+    const double maxCost = double(options.maxError) * double(options.maxError);
+
+    // Locked vertices: fixed ranges and open or non-manifold edges
+    const size_t end = n - mb.numSharedVertices();
+    std::vector<char> locked(n, Free);
+    std::fill(locked.begin(), locked.begin() + std::min(options.numFixedLeading, end), Locked);
+    std::fill(locked.begin() + end, locked.end(), Locked);
+    std::vector<uint64_t> boundaryEdges;
+    std::vector<unsigned> tris(mb.getIndexData(), mb.getIndexData() + 3 * numTriangles);
+    {
+        std::vector<uint64_t> edges(3 * numTriangles);
+        parallelFor(numTriangles, numThreads, [&](size_t t)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                edges[3*t + j] = edgeKey(tris[3*t + j], tris[3*t + (j + 1) % 3]);
+            }
+        });
+        std::sort(edges.begin(), edges.end());
+        std::vector<unsigned> numOpen(options.lockBoundaries ? 0 : n, 0);
+        for (size_t i = 0; i < edges.size();)
+        {
+            size_t j = i + 1;
+            while (j < edges.size() && edges[j] == edges[i])
+                ++j;
+            const size_t a = edges[i] >> 32, b = edges[i] & 0xffffffffu;
+            if (j - i == 1 && !options.lockBoundaries)
+            {
+                boundaryEdges.push_back(edges[i]);
+                ++numOpen[a];
+                ++numOpen[b];
+            }
+            else if (j - i != 2)
+            {
+                locked[a] = Locked;
+                locked[b] = Locked;
+            }
+            i = j;
+        }
+        // Vertices where several boundaries meet stay
+        for (size_t v = 0; v < numOpen.size(); ++v)
+            if (numOpen[v] > 0 && locked[v] == Free)
+                locked[v] = numOpen[v] == 2 ? OnBoundary : Locked;
+    }
+
+    // Grid over the vertex bounds
+    float lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 };
+    for (size_t v = 0; v < n; ++v)
+    {
+        const float* p = mb.getVertexData(v);
+        for (int c = 0; c < 3; ++c)
+        {
+            lo[c] = v == 0 ? p[c] : std::min(lo[c], p[c]);
+            hi[c] = v == 0 ? p[c] : std::max(hi[c], p[c]);
+        }
+    }
+    const unsigned k = static_cast<unsigned>(std::ceil(std::cbrt(double(numPartitions))));
+
+    const int numPasses = numPartitions > 1 ? 2 : 1;
+    for (int pass = 0; pass < numPasses; ++pass)
+    {
+        const size_t alive = tris.size() / 3;
+        if (options.targetTriangles > 0 && alive <= options.targetTriangles)
+            break;
+
+        // Partition by centroid, the second pass shifts the grid by half a cell
+        const double shift = pass * 0.5;
+        auto cellOf = [&](size_t t)
+        {
+            unsigned cell[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                const double centroid = (double(mb.getVertexData(tris[3*t])[c]) + mb.getVertexData(tris[3*t+1])[c] + mb.getVertexData(tris[3*t+2])[c]) / 3.0;
+                const double extent = hi[c] > lo[c] ? hi[c] - lo[c] : 1.0;
+                const double x = (centroid - lo[c]) / extent * k + shift;
+                cell[c] = std::min(static_cast<unsigned>(std::max(x, 0.0)), k);
+            }
+            return (cell[2] * (k + 1) + cell[1]) * (k + 1) + cell[0];
+        };
+        const size_t numCells = size_t(k + 1) * (k + 1) * (k + 1);
+
+        std::vector<std::vector<unsigned>> parts(numCells);
+        std::vector<unsigned> partOf(n, NoPartition);
+        std::vector<char> passLocked(locked);
+        for (size_t t = 0; t < alive; ++t)
+        {
+            const unsigned cell = cellOf(t);
+            for (int j = 0; j < 3; ++j)
+            {
+                const unsigned v = tris[3*t + j];
+                parts[cell].push_back(v);
+                if (partOf[v] == NoPartition)
+                    partOf[v] = cell;
+                else if (partOf[v] != cell)
+                    passLocked[v] = Locked;
+            }
+        }
+
+        // The first of two passes goes halfway, so that the locked borders do
+        // not force expensive collapses next to them
+        const size_t passTarget = pass + 1 < numPasses ? std::min(alive, 2 * options.targetTriangles) : options.targetTriangles;
+        std::vector<double> costs(numCells, 0.0);
+        parallelFor(numCells, numThreads, [&](size_t i)
+        {
+            const size_t count = parts[i].size() / 3;
+            if (count == 0)
+                return;
+            const size_t target = options.targetTriangles > 0 ? std::min(count, (count * passTarget + alive - 1) / alive) : 0;
+            costs[i] = simplifyPartition(mb, passLocked, boundaryEdges, parts[i], target, maxCost);
+        });
+
+        tris.clear();
+        for (size_t i = 0; i < numCells; ++i)
+        {
+            tris.insert(tris.end(), parts[i].begin(), parts[i].end());
+            stats.error = std::max(stats.error, static_cast<float>(std::sqrt(costs[i])));
+        }
+    }
+
+    // Remove unused vertices, the others keep their order
+    std::vector<char> used(locked.size(), 0);
+    std::fill(used.begin(), used.begin() + std::min(options.numFixedLeading, end), 1);
+    std::fill(used.begin() + end, used.end(), 1);
+    for (unsigned v : tris)
+        used[v] = 1;
+    std::vector<unsigned> newIndex(n);
+    unsigned numKept = 0;
+    for (size_t v = 0; v < n; ++v)
+    {
+        if (!used[v])
+            continue;
+        newIndex[v] = numKept++;
+        if (newIndex[v] == v)
+            continue;
+        auto move = [](const float* src, float* dst, size_t channels) { std::copy(src, src + channels, dst); };
+        const size_t w = newIndex[v];
+                            move(mb.getVertexData(v), mb.getVertexData(w), 3);
+        if (mb.hasNormals()) move(mb.getNormalData(v), mb.getNormalData(w), 3);
+        if (mb.hasColors())  move(mb.getColorData(v),  mb.getColorData(w),  4);
+        if (mb.hasUVs())     move(mb.getUVData(v),     mb.getUVData(w),     2);
+    }
+
+    unsigned* indices = mb.getIndexData();
+    for (size_t i = 0; i < tris.size(); ++i)
+        indices[i] = newIndex[tris[i]];
+    mb.setNumVertices(numKept);
+    mb.setNumIndices(tris.size());
+    mb.setNumSharedVertices(n - end);
+
+    stats.numVerticesAfter = numKept;
+    stats.numTrianglesAfter = tris.size() / 3;
+    return stats;
+}
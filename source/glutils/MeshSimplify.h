@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+
+class MeshBuffer;
+
+struct MeshSimplifyOptions
+{
+    size_t targetTriangles = 0; ///< stop when reached, 0 to stop by maxError only
+    float maxError = std::numeric_limits<float>::max(); ///< distance to the original surface
+    size_t numFixedLeading = 0; ///< leading vertices to keep in place, see optimizeVertexFetch()
+    unsigned numThreads = 0;    ///< 0 for one per hardware thread
+    unsigned numPartitions = 0; ///< 0 for one per thread
+    bool lockBoundaries = true; ///< false to let vertices slide along open boundaries
+};
+
+struct MeshSimplifyStats
+{
+    size_t numTrianglesBefore = 0;
+    size_t numTrianglesAfter = 0;
+    size_t numVerticesBefore = 0;
+    size_t numVerticesAfter = 0;
+    float error = 0.f; ///< largest collapse error, area weighted RMS distance to the removed planes
+};
+
+/// Quadric error metric simplification (Garland and Heckbert 1997) by
+/// half-edge collapses, so surviving vertices keep their attributes.
+/// Triangles are partitioned on a spatial grid and the partitions are
+/// simplified in parallel. Vertices on partition borders, on open mesh
+/// boundaries (e.g. the seams of stitched slices), in the shared tail and
+/// the first numFixedLeading vertices are locked. Without lockBoundaries, a
+/// vertex with two open edges only collapses along one of them, planes
+/// perpendicular to the boundary keep its shape. A second pass on a
+/// shifted grid releases the first pass' borders if the target is not
+/// reached yet. Collapses that flip triangles or break manifoldness are
+/// rejected. Unused vertices are removed, the others keep their order.
+/// Triangles only, other meshes are left unchanged.
+MeshSimplifyStats simplifyMesh(MeshBuffer& mb, const MeshSimplifyOptions& options);
@@ -0,0 +1,25 @@
+#include "MeshSnapshot.h"
+#include "MeshBuffer.h"
+#include <atomic>
+
+MeshSnapshot freeze(MeshBuffer& builder, MeshSnapshot recycle)
+{
+    auto frozen = std::make_shared<MeshBuffer>(builder.getPrimitiveType(), builder.getAttributes(), builder.getLayout(),
+                                               builder.isInterleaved() ? builder.getVertexStride() : 0);
+    frozen->swapStorage(builder);
+
+    if (recycle && recycle.use_count() == 1)
+    {
+        // use_count() is a relaxed load, the fence orders the writes below
+        // after the reads of the threads that released their references
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // Sole owner, and snapshots are created as mutable buffers above
+        MeshBuffer& old = const_cast<MeshBuffer&>(*recycle);
+        if (!old.getVertexArena().isExternal() && !old.getIndexArena().isExternal())
+            builder.swapStorage(old);
+    }
+    builder.setNumVertices(0);
+    builder.setNumIndices(0);
+    builder.setNumSharedVertices(0);
+    return frozen;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <memory>
+
+class MeshBuffer;
+
+/// Immutable, reference counted mesh. Once frozen, the mesh is not written
+/// while shared, so snapshots can be read by any number of threads at once,
+/// e.g. uploaded by the GL thread while an exporter writes it and statistics
+/// are computed. Handing it over is a reference count increment.
+using MeshSnapshot = std::shared_ptr<const MeshBuffer>;
+
+/// Moves the contents of builder into a new snapshot without copying.
+/// builder is left empty with the same format, ready for the next mesh.
+///
+/// If recycle is the last reference to an older snapshot of the same format,
+/// its storage is handed back to builder, so repeated builds of similar
+/// size do not reallocate. Otherwise it is just released.
+MeshSnapshot freeze(MeshBuffer& builder, MeshSnapshot recycle=nullptr);
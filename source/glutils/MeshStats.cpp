@@ -0,0 +1,233 @@
+#include "MeshStats.h"
+#include "MeshBuffer.h"
+#include <utils/ParallelFor.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/// Vertices or triangles per parallel block, fixed for reproducible sums
+constexpr size_t BlockSize = 1 << 14;
+/// Gathered into separate component arrays, so the inner loops vectorize
+constexpr size_t BatchSize = 64;
+
+struct Box
+{
+    float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float hi[3] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+};
+
+struct TriangleSums
+{
+    double area = 0.;
+    double volume = 0.;
+    size_t numDegenerate = 0;
+};
+
+Box vertexBounds(const MeshBuffer& mb, size_t begin, size_t end)
+{
+    Box box;
+    float c[3][BatchSize];
+    for (size_t batch = begin; batch < end; batch += BatchSize)
+    {
+        const size_t m = std::min(BatchSize, end - batch);
+        for (size_t i = 0; i < m; ++i)
+        {
+            const float* p = mb.getVertexData(batch + i);
+            c[0][i] = p[0];
+            c[1][i] = p[1];
+            c[2][i] = p[2];
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            float lo = box.lo[k], hi = box.hi[k];
+            for (size_t i = 0; i < m; ++i)
+            {
+                lo = std::min(lo, c[k][i]);
+                hi = std::max(hi, c[k][i]);
+            }
+            box.lo[k] = lo;
+            box.hi[k] = hi;
+        }
+    }
+    return box;
+}
+
+float maxDistance2(const MeshBuffer& mb, size_t begin, size_t end, const float center[3])
+{
+    float result = 0.f;
+    float d2[BatchSize];
+    for (size_t batch = begin; batch < end; batch += BatchSize)
+    {
+        const size_t m = std::min(BatchSize, end - batch);
+        for (size_t i = 0; i < m; ++i)
+        {
+            const float* p = mb.getVertexData(batch + i);
+            const float dx = p[0] - center[0], dy = p[1] - center[1], dz = p[2] - center[2];
+            d2[i] = dx*dx + dy*dy + dz*dz;
+        }
+        for (size_t i = 0; i < m; ++i)
+            result = std::max(result, d2[i]);
+    }
+    return result;
+}
+
+TriangleSums triangleSums(const MeshBuffer& mb, size_t begin, size_t end)
+{
+    TriangleSums sums;
+    const size_t n = mb.numVertices();
+    const unsigned* indices = mb.getIndexData();
+    float a[3][BatchSize], b[3][BatchSize], c[3][BatchSize];
+    float area[BatchSize], volume[BatchSize];
+    for (size_t batch = begin; batch < end; batch += BatchSize)
+    {
+        const size_t m = std::min(BatchSize, end - batch);
+        for (size_t i = 0; i < m; ++i)
+        {
+            const unsigned* tri = indices + 3 * (batch + i);
+            if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0] || tri[0] >= n || tri[1] >= n || tri[2] >= n)
+            {
+                // Zero area, counted as degenerate below
+                for (int k = 0; k < 3; ++k)
+                    a[k][i] = b[k][i] = c[k][i] = 0.f;
+                continue;
+            }
+            const float* p[3] = { mb.getVertexData(tri[0]), mb.getVertexData(tri[1]), mb.getVertexData(tri[2]) };
+            for (int k = 0; k < 3; ++k)
+            {
+                a[k][i] = p[0][k];
+                b[k][i] = p[1][k];
+                c[k][i] = p[2][k];
+            }
+        }
+        for (size_t i = 0; i < m; ++i)
+        {
+            const float ux = b[0][i] - a[0][i], uy = b[1][i] - a[1][i], uz = b[2][i] - a[2][i];
+            const float vx = c[0][i] - a[0][i], vy = c[1][i] - a[1][i], vz = c[2][i] - a[2][i];
+            const float nx = uy*vz - uz*vy, ny = uz*vx - ux*vz, nz = ux*vy - uy*vx;
+            area[i] = .5f * std::sqrt(nx*nx + ny*ny + nz*nz);
+            // a . (b x c) = a . ((b-a) x (c-a))
+            volume[i] = (a[0][i]*nx + a[1][i]*ny + a[2][i]*nz) / 6.f;
+        }
+        for (size_t i = 0; i < m; ++i)
+        {
+            sums.area += area[i];
+            sums.volume += volume[i];
+            sums.numDegenerate += area[i] == 0.f;
+        }
+    }
+    return sums;
+}
+
+} // namespace
+
+MeshStats& MeshStats::operator += (const MeshStats& other)
+{
+    if (other.empty())
+        return *this;
+    if (empty())
+        return *this = other;
+
+    numVertices += other.numVertices;
+    numTriangles += other.numTriangles;
+    numDegenerate += other.numDegenerate;
+    area += other.area;
+    volume += other.volume;
+    for (int k = 0; k < 3; ++k)
+    {
+        lo[k] = std::min(lo[k], other.lo[k]);
+        hi[k] = std::max(hi[k], other.hi[k]);
+    }
+
+    const float d[3] = { other.center[0] - center[0], other.center[1] - center[1], other.center[2] - center[2] };
+    const float distance = std::sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+    if (distance + other.radius <= radius)
+        return *this;
+    if (distance + radius <= other.radius)
+    {
+        std::copy(other.center, other.center + 3, center);
+        radius = other.radius;
+        return *this;
+    }
+    const float r = .5f * (distance + radius + other.radius);
+    const float t = (r - radius) / distance;
+    for (int k = 0; k < 3; ++k)
+        center[k] += t * d[k];
+    radius = r;
+    return *this;
+}
+
+MeshStats computeMeshStats(const MeshBuffer& mb, unsigned numThreads)
+{
+    MeshStats stats;
+    const size_t n = mb.numVertices();
+    stats.numVertices = n;
+    if (n == 0)
+        return stats;
+
+    const size_t numVertexBlocks = (n + BlockSize - 1) / BlockSize;
+    std::vector<Box> boxes(numVertexBlocks);
+    parallelFor(numVertexBlocks, numThreads, [&](size_t b)
+    {
+        boxes[b] = vertexBounds(mb, b * BlockSize, std::min(n, (b + 1) * BlockSize));
+    });
+    for (const Box& box : boxes)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            stats.lo[k] = std::min(stats.lo[k], box.lo[k]);
+            stats.hi[k] = std::max(stats.hi[k], box.hi[k]);
+        }
+    }
+    for (int k = 0; k < 3; ++k)
+        stats.center[k] = .5f * (stats.lo[k] + stats.hi[k]);
+
+    std::vector<float> distances(numVertexBlocks);
+    parallelFor(numVertexBlocks, numThreads, [&](size_t b)
+    {
+        distances[b] = maxDistance2(mb, b * BlockSize, std::min(n, (b + 1) * BlockSize), stats.center);
+    });
+    stats.radius = std::sqrt(*std::max_element(distances.begin(), distances.end()));
+
+    if (mb.getPrimitiveType() != MeshPrimitiveType::Triangles)
+        return stats;
+
+    const size_t numTriangles = mb.numIndices() / 3;
+    stats.numTriangles = numTriangles;
+    const size_t numTriangleBlocks = (numTriangles + BlockSize - 1) / BlockSize;
+    std::vector<TriangleSums> sums(numTriangleBlocks);
+    parallelFor(numTriangleBlocks, numThreads, [&](size_t b)
+    {
+        sums[b] = triangleSums(mb, b * BlockSize, std::min(numTriangles, (b + 1) * BlockSize));
+    });
+    for (const TriangleSums& s : sums)
+    {
+        stats.area += s.area;
+        stats.volume += s.volume;
+        stats.numDegenerate += s.numDegenerate;
+    }
+    return stats;
+}
+
+bool MeshStatsCache::update(const std::vector<const MeshBuffer*>& parts, unsigned numThreads)
+{
+    bool changed = parts.size() != m_parts.size();
+    m_parts.resize(parts.size());
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        Part& part = m_parts[i];
+        if (part.mesh == parts[i] && part.version == parts[i]->version())
+            continue;
+        part.mesh = parts[i];
+        part.version = parts[i]->version();
+        part.stats = computeMeshStats(*parts[i], numThreads);
+        changed = true;
+    }
+    if (changed)
+    {
+        m_total = MeshStats();
+        for (const Part& part : m_parts)
+            m_total += part.stats;
+    }
+    return changed;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+class MeshBuffer;
+
+/// Geometric statistics of a triangle mesh
+struct MeshStats
+{
+    size_t numVertices = 0;
+    size_t numTriangles = 0;
+    size_t numDegenerate = 0; ///< triangles with zero area or repeated indices
+
+    float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float hi[3] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+    /// Sphere around the center of the box through the farthest vertex
+    float center[3] = { 0, 0, 0 };
+    float radius = 0.f;
+
+    double area = 0.;
+    /// Signed volume enclosed with the origin, the volume of closed meshes
+    /// with outward facing triangles
+    double volume = 0.;
+
+    bool empty() const { return numVertices == 0; }
+
+    /// Combines the statistics of mesh parts, the sphere encloses both spheres
+    MeshStats& operator += (const MeshStats& other);
+};
+
+/// Statistics of the vertices and triangles of mb, other primitive types
+/// only contribute their vertices. Blocks of vertices and triangles are
+/// reduced on numThreads threads (0 for one per hardware thread) in a fixed
+/// order, so the result does not depend on the thread count.
+MeshStats computeMeshStats(const MeshBuffer& mb, unsigned numThreads=0);
+
+/// Per part statistics, recomputed only for parts whose MeshBuffer::version()
+/// changed since the last update()
+class MeshStatsCache
+{
+public:
+    /// Returns true if any part was recomputed
+    bool update(const std::vector<const MeshBuffer*>& parts, unsigned numThreads=0);
+
+    const MeshStats& part(size_t i) const { return m_parts[i].stats; }
+    size_t numParts() const { return m_parts.size(); }
+    /// Sum of all parts, shared vertices of stitched parts are counted twice
+    const MeshStats& total() const { return m_total; }
+
+private:
+    struct Part
+    {
+        const MeshBuffer* mesh = nullptr;
+        uint64_t version = 0;
+        MeshStats stats;
+    };
+    std::vector<Part> m_parts;
+    MeshStats m_total;
+};
@@ -0,0 +1,257 @@
+#include "MeshWeld.h"
+#include "MeshBuffer.h"
+#include <utils/ParallelFor.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring> // memcpy
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/// Contiguous blocks per thread for the radix sort
+constexpr size_t BlocksPerThread = 4;
+/// Radix sort digits, two passes cover up to 4M buckets
+constexpr unsigned RadixBits = 11;
+constexpr size_t RadixSize = size_t(1) << RadixBits;
+
+struct Cell
+{
+    int64_t x, y, z;
+    bool operator == (const Cell& c) const { return x == c.x && y == c.y && z == c.z; }
+};
+
+inline uint64_t hashCell(const Cell& c)
+{
+    uint64_t h = static_cast<uint64_t>(c.x) * 0x9E3779B97F4A7C15ull;
+    h ^= static_cast<uint64_t>(c.y) * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(c.z) * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+    return h ^ (h >> 29);
+}
+
+} // namespace
+
+MeshWeldStats weldVertices(MeshBuffer& mb, float tolerance, bool averageNormals, unsigned numThreads)
+{
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    MeshWeldStats stats;
+    const size_t n = mb.numVertices();
+    const size_t end = n - mb.numSharedVertices(); // tail is kept as is
+    stats.numVerticesBefore = stats.numVerticesAfter = n;
+    if (end < 2)
+        return stats;
+
+    // Cells of twice the tolerance, so that all positions within reach are in
+    // the own or one neighboring cell per axis
+    const double cellSize = tolerance > 0.f ? 2.0 * tolerance : 1.0;
+    auto cellOf = [&](const float* p, int dx, int dy, int dz) -> Cell
+    {
+        if (tolerance <= 0.f)
+        {
+            // exact: cell is the bit pattern
+            uint32_t b[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                const float v = p[c] == 0.f ? 0.f : p[c]; // -0 == 0
+                std::memcpy(&b[c], &v, sizeof(float));
+            }
+            return { b[0], b[1], b[2] };
+        }
+        return { static_cast<int64_t>(std::floor(p[0] / cellSize)) + dx,
+                 static_cast<int64_t>(std::floor(p[1] / cellSize)) + dy,
+                 static_cast<int64_t>(std::floor(p[2] / cellSize)) + dz };
+    };
+
+    size_t numBuckets = 1;
+    while (numBuckets < end)
+        numBuckets *= 2;
+    const uint64_t bucketMask = numBuckets - 1;
+
+    // (bucket, vertex) pairs, vertices in index order
+    std::vector<uint32_t> keys(end);
+    std::vector<unsigned> sorted(end);
+    parallelFor(end, numThreads, [&](size_t v)
+    {
+        keys[v] = static_cast<uint32_t>(hashCell(cellOf(mb.getVertexData(v), 0, 0, 0)) & bucketMask);
+        sorted[v] = static_cast<unsigned>(v);
+    });
+
+    // Stable LSD radix sort of the pairs by bucket, per block digit
+    // histograms. Blocks are limited so that the histograms never exceed
+    // the vertex count, whatever the number of threads.
+    {
+        const size_t numBlocks = std::max<size_t>(1, std::min(numThreads * BlocksPerThread, end / RadixSize));
+        std::vector<unsigned> counts(numBlocks * RadixSize);
+        std::vector<uint32_t> keysOut(end);
+        std::vector<unsigned> sortedOut(end);
+        for (unsigned shift = 0; (size_t(1) << shift) < numBuckets; shift += RadixBits)
+        {
+            parallelFor(numBlocks, numThreads, [&](size_t b)
+            {
+                unsigned* count = &counts[b * RadixSize];
+                std::fill(count, count + RadixSize, 0u);
+                for (size_t s = b * end / numBlocks; s < (b + 1) * end / numBlocks; ++s)
+                    ++count[(keys[s] >> shift) & (RadixSize - 1)];
+            });
+            unsigned sum = 0;
+            for (size_t d = 0; d < RadixSize; ++d)
+            {
+                for (size_t b = 0; b < numBlocks; ++b)
+                {
+                    const unsigned c = counts[b * RadixSize + d];
+                    counts[b * RadixSize + d] = sum;
+                    sum += c;
+                }
+            }
+            parallelFor(numBlocks, numThreads, [&](size_t b)
+            {
+                unsigned* offset = &counts[b * RadixSize];
+                for (size_t s = b * end / numBlocks; s < (b + 1) * end / numBlocks; ++s)
+                {
+                    const unsigned t = offset[(keys[s] >> shift) & (RadixSize - 1)]++;
+                    keysOut[t] = keys[s];
+                    sortedOut[t] = sorted[s];
+                }
+            });
+            keys.swap(keysOut);
+            sorted.swap(sortedOut);
+        }
+    }
+    std::vector<unsigned> bucketStart(numBuckets + 1, 0);
+    for (size_t s = 0; s < end; ++s)
+        ++bucketStart[keys[s] + 1];
+    for (size_t k = 0; k < numBuckets; ++k)
+        bucketStart[k + 1] += bucketStart[k];
+    keys = std::vector<uint32_t>();
+
+    // Lowest vertex within reach, independent per vertex
+    const float tolerance2 = tolerance * tolerance;
+    std::vector<unsigned> rep(n);
+    parallelFor(end, numThreads, [&](size_t v)
+    {
+        const float* p = mb.getVertexData(v);
+        unsigned best = static_cast<unsigned>(v);
+        const Cell own = cellOf(p, 0, 0, 0);
+        int side[3] = { 0, 0, 0 };
+        if (tolerance > 0.f)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                const double f = p[c] / cellSize - std::floor(p[c] / cellSize);
+                side[c] = f < 0.5 ? -1 : 1;
+            }
+        }
+        const int numCells = tolerance > 0.f ? 8 : 1;
+        for (int i = 0; i < numCells; ++i)
+        {
+            const Cell cell = { own.x + ((i & 1) ? side[0] : 0), own.y + ((i & 2) ? side[1] : 0), own.z + ((i & 4) ? side[2] : 0) };
+            const uint64_t k = hashCell(cell) & bucketMask;
+            for (unsigned s = bucketStart[k]; s < bucketStart[k + 1]; ++s)
+            {
+                const unsigned u = sorted[s];
+                if (u >= best)
+                    break; // sorted by index within a bucket
+                const float* q = mb.getVertexData(u);
+                if (!(cellOf(q, 0, 0, 0) == cell))
+                    continue;
+                const float d[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+                if (d[0]*d[0] + d[1]*d[1] + d[2]*d[2] <= tolerance2)
+                    best = u;
+            }
+        }
+        rep[v] = best;
+    });
+    for (size_t v = end; v < n; ++v)
+        rep[v] = static_cast<unsigned>(v);
+
+    // Follow chains, rep[v] <= v is final when v is reached
+    std::vector<unsigned> newIndex(n);
+    unsigned numKept = 0;
+    unsigned numKeptFront = 0; // without the tail
+    for (size_t v = 0; v < n; ++v)
+    {
+        rep[v] = rep[rep[v]];
+        if (rep[v] == v)
+            newIndex[v] = numKept++;
+        if (v + 1 == end)
+            numKeptFront = numKept;
+    }
+    if (numKept == n)
+        return stats;
+
+    std::vector<float> normalSums;
+    if (averageNormals && mb.hasNormals())
+    {
+        normalSums.assign(size_t(numKeptFront) * 3, 0.f);
+        for (size_t v = 0; v < end; ++v)
+        {
+            const float* nv = mb.getNormalData(v);
+            float* sum = &normalSums[size_t(newIndex[rep[v]]) * 3];
+            for (int c = 0; c < 3; ++c)
+                sum[c] += nv[c];
+        }
+    }
+
+    // Compact in place, kept vertices only move towards the front
+    auto move = [](const float* src, float* dst, size_t channels) { std::copy(src, src + channels, dst); };
+    for (size_t v = 0; v < n; ++v)
+    {
+        if (rep[v] != v || newIndex[v] == v)
+            continue;
+        const size_t w = newIndex[v];
+                            move(mb.getVertexData(v), mb.getVertexData(w), 3);
+        if (mb.hasNormals()) move(mb.getNormalData(v), mb.getNormalData(w), 3);
+        if (mb.hasColors())  move(mb.getColorData(v),  mb.getColorData(w),  4);
+        if (mb.hasUVs())     move(mb.getUVData(v),     mb.getUVData(w),     2);
+    }
+    if (!normalSums.empty())
+    {
+        parallelFor(numKeptFront, numThreads, [&](size_t w)
+        {
+            const float* sum = &normalSums[w * 3];
+            const float length = std::sqrt(sum[0]*sum[0] + sum[1]*sum[1] + sum[2]*sum[2]);
+            if (length > 0.f)
+            {
+                float* nw = mb.getNormalData(w);
+                for (int c = 0; c < 3; ++c)
+                    nw[c] = sum[c] / length;
+            }
+        });
+    }
+
+    // Remap indices and drop degenerate primitives
+    const size_t m = mb.getNumVertsPerPrimitive();
+    const size_t numPrimitives = mb.numIndices() / m;
+    unsigned* indices = numPrimitives > 0 ? mb.getIndexData() : nullptr;
+    std::vector<char> degenerate(numPrimitives, 0);
+    parallelFor(numPrimitives, numThreads, [&](size_t f)
+    {
+        unsigned* idx = indices + f * m;
+        for (size_t j = 0; j < m; ++j)
+            idx[j] = newIndex[rep[idx[j]]];
+        for (size_t j = 0; j < m && !degenerate[f]; ++j)
+            for (size_t l = j + 1; l < m; ++l)
+                if (idx[j] == idx[l])
+                    degenerate[f] = 1;
+    });
+    size_t numOut = 0;
+    for (size_t f = 0; f < numPrimitives; ++f)
+    {
+        if (degenerate[f])
+            continue;
+        if (numOut != f)
+            std::copy(indices + f * m, indices + (f + 1) * m, indices + numOut * m);
+        ++numOut;
+    }
+
+    mb.setNumVertices(numKept);
+    mb.setNumIndices(numOut * m);
+    mb.setNumSharedVertices(n - end);
+    stats.numVerticesAfter = numKept;
+    stats.numPrimitivesRemoved = numPrimitives - numOut;
+    return stats;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+
+class MeshBuffer;
+
+struct MeshWeldStats
+{
+    size_t numVerticesBefore = 0;
+    size_t numVerticesAfter = 0;
+    size_t numPrimitivesRemoved = 0; ///< degenerate after welding
+};
+
+/// Merges vertices whose positions are within tolerance of each other,
+/// found via a spatial hash with cells of twice the tolerance. Each vertex
+/// is merged into the lowest-index vertex within reach, chains of merges
+/// are followed, so clusters can be wider than tolerance. Tolerance 0 welds
+/// exactly coincident positions.
+///
+/// The first vertex of a cluster keeps its attributes, with averageNormals
+/// its normal becomes the normalized sum of the cluster. Remaining vertices
+/// keep their order, the shared tail is never merged. Primitives with
+/// repeated indices are removed. Runs on numThreads threads (0 for one per
+/// hardware thread), the result does not depend on the thread count.
+MeshWeldStats weldVertices(MeshBuffer& mb, float tolerance=0.f, bool averageNormals=true, unsigned numThreads=0);
@@ -0,0 +1,72 @@
+// Benchmark for compressMesh() and decompressMesh() on an mnoise mesh
+// Usage: test-meshcodec [N=160]
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MCubesObject.h"
+#include "glutils/MeshCompression.h"
+#include "utils/ParallelFor.h"
+
+double seconds(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned N = argc > 1 ? static_cast<unsigned>(std::stoul(argv[1])) : 160;
+    const unsigned numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Stitched mesh merged into one buffer
+    MCubesSeams seams(numThreads - 1);
+    std::vector<std::shared_ptr<MCubesObject>> slices(numThreads);
+    parallelFor(numThreads, numThreads, [&](size_t i)
+    {
+        slices[i] = std::make_shared<MCubesObject>();
+        slices[i]->computeStitched(1/16.f, .5f, N, static_cast<unsigned>(i), numThreads, &seams);
+    });
+    MeshBuffer mesh;
+    for (const auto& slice : slices)
+        mesh.merge(*slice);
+    const size_t rawBytes = mesh.numVertices() * 6 * sizeof(float) + mesh.numIndices() * sizeof(unsigned);
+    std::cout << "mesh " << N << "^3: " << mesh.numVertices() << " vertices, " << mesh.numIndices() / 3 << " triangles, "
+              << rawBytes / 1e6 << " MB" << std::endl;
+
+    std::vector<unsigned> threadCounts = { 1 };
+    if (numThreads > 1)
+        threadCounts.push_back(numThreads);
+    for (unsigned threads : threadCounts)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        const std::vector<uint8_t> data = compressMesh(mesh, threads);
+        const double te = seconds(t0);
+
+        MeshBuffer decoded;
+        t0 = std::chrono::steady_clock::now();
+        const bool ok = decompressMesh(data.data(), data.size(), decoded, threads);
+        const double td = seconds(t0);
+
+        float maxError = 0.f;
+        float maxNormalError = 0.f;
+        bool sameTopology = ok && decoded.numVertices() == mesh.numVertices() && decoded.numIndices() == mesh.numIndices();
+        for (size_t i = 0; sameTopology && i < mesh.numVertices(); ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                maxError = std::max(maxError, std::abs(decoded.getVertexData(i)[c] - mesh.getVertexData(i)[c]));
+                maxNormalError = std::max(maxNormalError, std::abs(decoded.getNormalData(i)[c] - mesh.getNormalData(i)[c]));
+            }
+        }
+        for (size_t i = 0; sameTopology && i < mesh.numIndices(); ++i)
+            sameTopology = decoded.getIndexData()[i] == mesh.getIndexData()[i];
+
+        std::cout << threads << " thread(s): " << data.size() / 1e6 << " MB, ratio " << double(rawBytes) / data.size()
+                  << ", encode " << rawBytes / 1e6 / te << " MB/s, decode " << rawBytes / 1e6 / td << " MB/s, "
+                  << (sameTopology ? "topology identical" : "TOPOLOGY MISMATCH")
+                  << ", max position error " << maxError << ", max normal error " << maxNormalError << std::endl;
+    }
+}
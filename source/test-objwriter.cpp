@@ -0,0 +1,86 @@
+// Benchmark for writeOBJ() and readOBJ() on a large mnoise mesh
+// Usage: test-objwriter [N=320] [output.obj]
+// The reader is only benchmarked when an output file is given.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MCubesObject.h"
+#include "glutils/MeshBufferHash.h"
+#include "glutils/MeshBufferIO.h"
+#include "glutils/MeshBufferView.h"
+#include "utils/ParallelFor.h"
+
+/// Discards output, counts bytes
+class NullBuffer : public std::streambuf
+{
+public:
+    size_t bytes = 0;
+protected:
+    std::streamsize xsputn(const char*, std::streamsize n) override { bytes += static_cast<size_t>(n); return n; }
+    int overflow(int c) override { ++bytes; return c; }
+};
+
+double seconds(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned N = argc > 1 ? static_cast<unsigned>(std::stoul(argv[1])) : 320; // lattice size, >10M triangles
+    const std::string filename = argc > 2 ? argv[2] : "";
+    const unsigned numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Stitched mesh, one slice per thread
+    auto t0 = std::chrono::steady_clock::now();
+    MCubesSeams seams(numThreads - 1);
+    std::vector<std::shared_ptr<MCubesObject>> slices(numThreads);
+    parallelFor(numThreads, numThreads, [&](size_t i)
+    {
+        slices[i] = std::make_shared<MCubesObject>();
+        slices[i]->computeStitched(1/16.f, .5f, N, static_cast<unsigned>(i), numThreads, &seams);
+    });
+    const MeshBufferView view(slices);
+    std::cout << "mesh " << N << "^3: " << view.numVertices() << " vertices, " << view.numIndices() / 3 << " triangles"
+              << " in " << seconds(t0) << "s" << std::endl;
+
+    std::vector<unsigned> threadCounts = { 1 };
+    if (numThreads > 1)
+        threadCounts.push_back(numThreads);
+    for (unsigned threads : threadCounts)
+    {
+        NullBuffer null;
+        std::ostream os(&null);
+        t0 = std::chrono::steady_clock::now();
+        writeOBJ(os, view, threads);
+        const double t = seconds(t0);
+        std::cout << "writeOBJ " << threads << " thread(s): " << null.bytes / 1e6 << " MB in " << t << "s, "
+                  << null.bytes / 1e6 / t << " MB/s" << std::endl;
+    }
+
+    if (!filename.empty())
+    {
+        t0 = std::chrono::steady_clock::now();
+        std::ofstream of(filename, std::ios::binary);
+        writeOBJ(of, view, numThreads);
+        of.close();
+        std::cout << "wrote " << filename << " in " << seconds(t0) << "s" << std::endl;
+
+        const size_t bytes = std::filesystem::file_size(filename);
+        for (unsigned threads : threadCounts)
+        {
+            MeshBuffer mb;
+            t0 = std::chrono::steady_clock::now();
+            const bool ok = readOBJ(filename, mb, threads);
+            const double t = seconds(t0);
+            std::cout << "readOBJ " << threads << " thread(s): " << bytes / 1e6 << " MB in " << t << "s, "
+                      << bytes / 1e6 / t << " MB/s, " << (ok && hashMeshBuffer(mb) == hashMeshBuffers(view) ? "identical" : "MISMATCH") << std::endl;
+        }
+    }
+}
@@ -6,9 +6,10 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <glutils/GLError.h>
-#include <glutils/GLMeshObject.h>
+#include <glutils/GLMeshLOD.h>
 #include <glutils/MeshShader.h>
-#include <glutils/MeshBufferIO.h> // writeOBJ()
+#include <glutils/MeshExporter.h>
+#include <glutils/MeshWeld.h>
 #include <glutils/Trackball2.h>
 
 #include <GlitchSphereGeometry.h>
@@ -21,6 +22,13 @@ struct GlitchSphereParameters
     float t = 0.f;
     float lambda = 1.f;
     int colormap = 0;
+    bool weld = false;
+    int lodLevels = 1;
+
+    bool operator == (const GlitchSphereParameters& p) const
+    {
+        return resolution == p.resolution && t == p.t && lambda == p.lambda && colormap == p.colormap && weld == p.weld && lodLevels == p.lodLevels;
+    }
 };
 
 class GlitchSphereScene
@@ -28,8 +36,9 @@ class GlitchSphereScene
 public:
     bool create()
     {
-        m_geometry = std::make_shared<GlitchSphereGeometry>(MeshVertexAttribute::Color | MeshVertexAttribute::Normal | MeshVertexAttribute::UV);
+        m_geometry = std::make_shared<GlitchSphereGeometry>(MeshVertexAttribute::Color | MeshVertexAttribute::Normal | MeshVertexAttribute::UV, MeshVertexLayout::Interleaved);
         m_glmesh.setMeshBuffer(m_geometry);
+        m_glmesh.setVertexFormat(MeshVertexFormat::compact());
         m_shader = std::make_shared<MeshShader>(m_geometry->getAttributes(), GLFWApp::getGLSLVersionString());
         
         if (!m_shader || !m_shader->load())
@@ -43,17 +52,47 @@ public:
 
     void update(const GlitchSphereParameters& params)
     {
+        if (m_valid && params == m_params)
+            return;
+        m_params = params;
+        m_valid = true;
+
         const float radius = 1.f;
         m_geometry->createSphereGeometryWithGlitch(0.f, 0.f, 0.f, radius, params.resolution, params.t, params.lambda, params.colormap);
-        m_glmesh.setDirty();
+        // Welded on a copy, the generator only rewrites the connectivity when
+        // the resolution changes and keeps its vertex layout otherwise
+        m_mesh = m_geometry;
+        m_weldStats = MeshWeldStats();
+        std::shared_ptr<const MeshBuffer> lodBase = m_geometry;
+        if (params.weld || params.lodLevels > 1)
+        {
+            auto welded = std::make_shared<MeshBuffer>(*m_geometry);
+            // Rings and the texture seam repeat their first vertex
+            m_weldStats = weldVertices(*welded, 1e-6f * radius);
+            lodBase = welded;
+            if (params.weld)
+                m_mesh = welded;
+        }
+        // Coarser levels always come from the welded mesh, as the bands of
+        // the unwelded one are all seams that would have to stay in place.
+        // The open edges left are the band borders, which may slide.
+        MeshSimplifyOptions options;
+        options.lockBoundaries = false;
+        std::vector<MeshLOD> levels = buildLODChain(lodBase, (unsigned)params.lodLevels, .5f, options);
+        levels[0].mesh = m_mesh;
+        m_glmesh.setLevels(std::move(levels));
         m_glmesh.prepare();
     }
 
     void render(const glm::mat4& modelview, const glm::mat4& projection)
     {
         glm::mat4 MVP = projection * modelview;
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        m_level = m_glmesh.selectLevel(glm::value_ptr(modelview), glm::value_ptr(projection), (float)viewport[3]);
         m_shader->bind(glm::value_ptr(MVP));
-        m_glmesh.draw();
+        m_shader->setPositionDecode(m_glmesh.level(m_level).getPositionScale(), m_glmesh.level(m_level).getPositionOffset());
+        m_glmesh.draw(m_level);
     }
 
     MeshShader::Uniforms& uniforms()
@@ -61,15 +100,30 @@ public:
         return m_shader->uniforms();
     }
 
+    /// Mesh as drawn, welded if enabled
     const MeshBuffer* meshBuffer()
     {
-        return m_geometry.get();
+        return m_mesh.get();
+    }
+
+    const MeshWeldStats& weldStats() const
+    {
+        return m_weldStats;
     }
 
+    /// Level of detail drawn last and its triangles
+    unsigned level() const { return m_level; }
+    size_t levelTriangles() const { return m_glmesh.numLevels() > 0 ? m_glmesh.getLevel(m_level).mesh->numIndices() / 3 : 0; }
+
 private:
     std::shared_ptr<GlitchSphereGeometry> m_geometry;
+    std::shared_ptr<const MeshBuffer> m_mesh; ///< m_geometry or its welded copy
     std::shared_ptr<MeshShader> m_shader;
-    GLMeshObject m_glmesh;
+    GLMeshLOD m_glmesh;
+    MeshWeldStats m_weldStats;
+    GlitchSphereParameters m_params;
+    bool m_valid = false;
+    unsigned m_level = 0;
 };
 
 int main(int argc, char* argv[])
@@ -116,6 +170,7 @@ int main(int argc, char* argv[])
     } globals;
 
     GlitchSphereParameters params;
+    MeshExporter exporter;
 
     const float tmax = 2 * 3.1415f;
 
@@ -143,19 +198,25 @@ int main(int argc, char* argv[])
             ImGui::SliderFloat("Param t", &params.t, 0.f, tmax);
             ImGui::SliderFloat("Param lambda", &params.lambda, 0.f, 10.f);
             ImGui::SliderInt("Colormap", &params.colormap, 0, 10);
-            if (ImGui::Button("Save .obj"))
+            ImGui::Checkbox("Weld vertices", &params.weld);
+            if (params.weld)
             {
-                const MeshBuffer* mb = scene.meshBuffer();
-                if (mb)
-                {
-                    std::ofstream of("glitchsphere.obj");
-                    if (of.is_open())
-                    {
-                        writeOBJ(of, *mb);
-                        of.close();
-                    }
-                }
+                ImGui::SameLine();
+                ImGui::Text("%zu -> %zu", scene.weldStats().numVerticesBefore, scene.weldStats().numVerticesAfter);
             }
+            ImGui::SliderInt("LOD levels", &params.lodLevels, 1, 8);
+            if (params.lodLevels > 1)
+            {
+                ImGui::SameLine();
+                ImGui::Text("level %u, %zu triangles", scene.level(), scene.levelTriangles());
+            }
+            if (ImGui::Button("Save .obj"))
+                exporter.start("glitchsphere.obj", { scene.meshBuffer() });
+            ImGui::SameLine();
+            if (ImGui::Button("Save .ply"))
+                exporter.start("glitchsphere.ply", { scene.meshBuffer() });
+            if (exporter.status().state != MeshExporter::State::Idle)
+                ImGui::Text("%s", exporter.statusText().c_str());
             if (ImGui::Button("Fullscreen"))
                 app.setFullscreen(!app.isFullscreen());
             ImGui::ColorEdit3("Foreground", scene.uniforms().color);
@@ -11,12 +11,14 @@
 // [ ] for pure svg cli decouple parallel compute and GL render code
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstdio>
 #include <ctime>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 #include <imgui.h>
@@ -26,8 +28,13 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <glutils/MeshShader.h> 
-#include <glutils/MeshBufferIO.h> // writeOBJ()
+#include <glutils/MeshBufferHash.h>
+#include <glutils/MeshBufferView.h>
+#include <glutils/MeshBVH.h>
+#include <glutils/MeshExporter.h>
+#include <glutils/MeshStats.h>
 
+#include <glutils/Frustum.h>
 #include <glutils/GLError.h>
 #include <glutils/GLSLProgram.h>
 #include <glutils/OffscreenRendering.h>
@@ -38,17 +45,6 @@
 #include "MCubesObjectRenderer.h"
 
 
-void writeOBJtoFile(std::string filename, const MeshBuffer& meshBuffer)
-{
-    std::ofstream of(filename);
-    if (of.is_open())
-    {
-        writeOBJ(of,meshBuffer);
-        of.close();
-    }
-}
-
-
 struct MCubesParameters
 {
     int resolution = 4;
@@ -57,16 +53,18 @@ struct MCubesParameters
     float posx = 0.f;
     float posy = 0.f;
     float posz = 0.f;
+    bool stitched = false;
 };
 
 class MCubesScene
 {
 public:
-    const unsigned numRows = 4;
+    // One slice per hardware thread, the merged mesh does not depend on this number
+    const unsigned numRows = std::clamp(std::thread::hardware_concurrency(), 1u, 32u);
 
     bool create()
     {
-        if(!m_mcubes.create(numRows))
+        if(!m_mcubes.create(numRows, MeshVertexLayout::Interleaved, MeshVertexFormat::compact()))
         {
             std::cerr << "Error creating mesh object" << std::endl;
             return false;
@@ -85,39 +83,124 @@ public:
     {
         glm::mat4 MVP = projection * modelview;
         m_shader.bind(glm::value_ptr(MVP));
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glm::mat4 mv = modelview, proj = projection;
+        Frustum frustum;
+        frustum.extract_frustum(glm::value_ptr(mv), glm::value_ptr(proj));
+        float eye[3];
+        eyePosition(glm::value_ptr(mv), eye);
+        m_numTrianglesDrawn = 0;
         int n=(int)m_mcubes.numObjects;
         for(int i=0; i < n; ++i)
         {
             if( debug )
-                m_shader.setColor(i/(float)(n-1),.5f,1.f-i/(float)(n-1),1.f);
-            m_mcubes.draw(i);
+            {
+                const float t = n > 1 ? i/(float)(n-1) : 0.f;
+                m_shader.setColor(t,.5f,1.f-t,1.f);
+            }
+            const GLMeshLOD& glmesh = m_mcubes.glmesh[i];
+            const unsigned level = glmesh.selectLevel(glm::value_ptr(modelview), glm::value_ptr(projection), (float)viewport[3]);
+            m_shader.setPositionDecode(glmesh.level(level).getPositionScale(), glmesh.level(level).getPositionOffset());
+            m_numTrianglesDrawn += glmesh.draw(level, frustum, cullBackfaces ? eye : nullptr) / 3;
         }
     }
 
     void update(MCubesParameters params)
     {
         update(params.posx+123.3456f,params.posy+732.5489f,params.posz+129.3983f,
-            1.f/(params.scale*(2<<(params.resolution-1))-.5f),params.iso,params.resolution);
+            1.f/(params.scale*(2<<(params.resolution-1))-.5f),params.iso,params.resolution,params.stitched);
     }
 
-    void update(float x, float y, float z, float scale, float iso, int pot)
+    void update(float x, float y, float z, float scale, float iso, int pot, bool stitched=false)
     {
-        m_mcubes.update(x,y,z,scale,iso,pot);
+        m_mcubes.update(x,y,z,scale,iso,pot,stitched);
         m_isComputing = m_mcubes.isComputing;
     }
 
-    std::string info()
+    /// Text lines of the debug panel, the mesh statistics are recomputed
+    /// only for slices that changed since the last call
+    void showStats()
     {
-        std::stringstream os;
         int n=(int)m_mcubes.numObjects;
         for(int i=0; i < n; ++i)
         {
-            os << "slice " << i 
-               << " #verts " << m_mcubes.objects[i]->numVertices()
-               << " #indices " << m_mcubes.objects[i]->numIndices()
-               << std::endl;
+            ImGui::Text("slice %d #verts %zu #indices %zu", i,
+                m_mcubes.snapshots[i]->numVertices(), m_mcubes.snapshots[i]->numIndices());
         }
-        return os.str();
+        std::vector<const MeshBuffer*> parts;
+        for (const MeshSnapshot& snapshot : m_mcubes.snapshots)
+            parts.push_back(snapshot.get());
+        m_stats.update(parts);
+        const MeshStats& stats = m_stats.total();
+        if (!stats.empty())
+        {
+            ImGui::Text("bounds (%.3f %.3f %.3f) - (%.3f %.3f %.3f)",
+                stats.lo[0], stats.lo[1], stats.lo[2], stats.hi[0], stats.hi[1], stats.hi[2]);
+            ImGui::Text("sphere (%.3f %.3f %.3f) r %.3f", stats.center[0], stats.center[1], stats.center[2], stats.radius);
+            ImGui::Text("area %.4g, volume %.4g, #degenerate %zu", stats.area, stats.volume, stats.numDegenerate);
+        }
+        const MeshCacheStats before = m_mcubes.cacheStats(false);
+        const MeshCacheStats after = m_mcubes.cacheStats(true);
+        if (after.numPrimitives > 0)
+        {
+            ImGui::Text("ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", before.acmr(), after.acmr(), before.atvr(), after.atvr());
+        }
+        const MeshSimplifyStats simplified = m_mcubes.simplifyStats();
+        if (simplified.numTrianglesBefore > 0)
+        {
+            ImGui::Text("#triangles %zu -> %zu, error %.2e", simplified.numTrianglesBefore, simplified.numTrianglesAfter, simplified.error);
+        }
+        if (m_mcubes.getLODLevels() > 1 || m_mcubes.hasClusters())
+            ImGui::Text("#triangles drawn %zu", m_numTrianglesDrawn);
+        if (!m_bvh.empty())
+        {
+            ImGui::Text("BVH %zu nodes, %.1f MB, %.1f ms",
+                m_bvh.numNodes(), m_bvh.bytesAllocated() / (1024.*1024.), m_bvhBuildTime * 1000.);
+        }
+        showMemory();
+    }
+
+    /// Allocated and used MB of the mesh storage by attribute
+    void showMemory()
+    {
+        const double MB = 1024. * 1024.;
+        ImGui::Text("mesh memory %.1f MB", meshMemoryAllocated() / MB);
+        auto show = [&](const char* name, const MeshMemoryStats& stats)
+        {
+            ImGui::Text("%s %.1f / %.1f MB used, external %.1f MB", name,
+                stats.total.used / MB, stats.total.allocated / MB, stats.external / MB);
+            ImGui::Text("  pos %.1f/%.1f nrm %.1f/%.1f col %.1f/%.1f idx %.1f/%.1f",
+                stats.positions.used / MB, stats.positions.allocated / MB, stats.normals.used / MB, stats.normals.allocated / MB,
+                stats.colors.used / MB, stats.colors.allocated / MB, stats.indices.used / MB, stats.indices.allocated / MB);
+        };
+        show("slices", m_mcubes.sliceMemory());
+        if (!m_isComputing)
+            show("compute", m_mcubes.computeMemory());
+    }
+
+    /// Nearest surface point along the ray, the hierarchy is rebuilt on the
+    /// first pick after the mesh changed.
+    bool pick(const glm::vec3& origin, const glm::vec3& direction, glm::vec3& point)
+    {
+        if (m_bvhGeneration != m_mcubes.generation || m_bvh.empty())
+        {
+            const auto start = std::chrono::steady_clock::now();
+            m_bvh.build(meshView());
+            m_bvhBuildTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            m_bvhGeneration = m_mcubes.generation;
+        }
+        MeshRayHit hit;
+        if (!m_bvh.raycast(glm::value_ptr(origin), glm::value_ptr(direction), hit))
+            return false;
+        point = origin + hit.t * direction;
+        return true;
+    }
+
+    /// Content hash of the merged mesh, independent of the number of slices
+    uint64_t hash() const
+    {
+        return hashMeshBuffers(meshView());
     }
 
     MeshShader::Uniforms& uniforms()
@@ -125,38 +208,72 @@ public:
         return m_shader.uniforms();
     }
 
+    /// High resolution meshes are cached on disk and reloaded on parameter changes and restarts, off by default
+    bool isCaching() const { return !m_mcubes.cacheDirectory.empty(); }
+    void setCaching(bool enable) { m_mcubes.cacheDirectory = enable ? "mnoise-cache" : ""; }
+    /// Vertex cache optimization of each slice, changes the mesh hash
+    bool isOptimizing() const { return m_mcubes.isOptimizingMeshes(); }
+    void setOptimizing(bool enable) { m_mcubes.setOptimizeMeshes(enable); }
+    /// Fraction of triangles kept by decimation of each slice, changes the mesh hash
+    float simplifyRatio() const { return m_mcubes.getSimplifyRatio(); }
+    void setSimplifyRatio(float ratio) { m_mcubes.setSimplifyRatio(ratio); }
+    /// Levels of detail per slice, picked by projected size when rendering
+    int lodLevels() const { return (int)m_mcubes.getLODLevels(); }
+    void setLODLevels(int n) { m_mcubes.setLODLevels((unsigned)n); }
+    /// Frustum culling of clusters, the winding of the isosurface is not
+    /// consistent enough for backface culling by default
+    bool hasClusters() const { return m_mcubes.hasClusters(); }
+    void setClusters(bool enable) { m_mcubes.setClusters(enable); }
+    bool cullBackfaces = false;
+
+    bool isCacheCompressed() const { return m_mcubes.cacheCompressed; }
+    void setCacheCompressed(bool enable) { m_mcubes.cacheCompressed = enable; }
+
+    /// Compute threads write the slices into persistently mapped GL buffers
+    bool streamingUploads() const { return m_mcubes.getStreamingUploads(); }
+    void setStreamingUploads(bool enable) { m_mcubes.setStreamingUploads(enable); }
+    /// False without support, or until applied after the running computation
+    bool isStreamingActive() const { return m_mcubes.isStreamingUploads(); }
+
+    /// Mesh storage budget in MB, 0 for no limit
+    int memoryBudget() const { return int(m_mcubes.getMemoryBudget() >> 20); }
+    void setMemoryBudget(int mb) { m_mcubes.setMemoryBudget(size_t(std::max(mb, 0)) << 20); }
+
     bool isComputing() const { return m_isComputing; }
 
     bool debug = false;
 
-    void saveOBJ(std::string filename)
+    /// All slices as one mesh, without merging them
+    MeshBufferView meshView() const
     {
-        if(m_mcubes.objects.size()==1)
-        {
-            writeOBJtoFile(filename, *m_mcubes.objects.at(0).get());
-        }
-        else
-        {
-            MeshBuffer meshBuffer;
-            std::filesystem::path path(filename);
-            for (size_t i = 0; i < m_mcubes.objects.size(); ++i)
-            {
-                if (const MeshBuffer* ptr = m_mcubes.objects.at(i).get())
-                {
-                    MeshBuffer tmp = *ptr;
-                    meshBuffer.merge(tmp);
-                }
-            }
-            writeOBJtoFile(path.string(), meshBuffer);
-        }
+        return MeshBufferView(m_mcubes.snapshots);
     }
 
+    /// Background export of the current mesh, format by extension (one glTF
+    /// mesh per slice). Shares the current snapshots, recomputation goes on.
+    bool save(std::string filename)
+    {
+        return m_exporter.start(filename, m_mcubes.snapshots);
+    }
+
+    MeshExporter& exporter() { return m_exporter; }
+
+    /// Recompute and write each slice as soon as it is finished
+    bool stream(std::string filename) { return m_mcubes.streamExport(filename); }
+    const std::string& streamStatus() const { return m_mcubes.streamStatus; }
+
 private:
     int m_width = 0;
     int m_height = 0;
     MCubesObjectRenderer m_mcubes;
+    MeshExporter m_exporter;
     MeshShader m_shader{MeshVertexAttribute::Normal, GLFWApp::getGLSLVersionString()};
     bool m_isComputing = false;
+    size_t m_numTrianglesDrawn = 0;
+    MeshStatsCache m_stats;
+    MeshBVH m_bvh;
+    unsigned m_bvhGeneration = 0;
+    double m_bvhBuildTime = 0.;
 };
 
 
@@ -170,7 +287,8 @@ int main(int argc, char* argv[])
     Trackball2 trackball;
     int mousex = 0;
     int mousey = 0;
-    app.setMouseFunction([&trackball, &mousex, &mousey](MouseEvent e) 
+    bool pick_requested = false;
+    app.setMouseFunction([&trackball, &mousex, &mousey, &pick_requested](MouseEvent e) 
     {
         if (e.type == MouseEvent::Type::Move)
         {
@@ -181,7 +299,11 @@ int main(int argc, char* argv[])
         else if (e.type == MouseEvent::Type::ButtonPress)
         {
             ImGuiIO& io = ImGui::GetIO();
-            if(!io.WantCaptureMouse)
+            if(io.WantCaptureMouse)
+                return;
+            if(e.button == MouseEvent::Button::Right)
+                pick_requested = true;
+            else
                 trackball.start(mousex, mousey, Trackball2::Rotate);
         }
         else if (e.type == MouseEvent::Type::ButtonRelease)
@@ -200,6 +322,7 @@ int main(int argc, char* argv[])
         float clear_color[4] = { 0.45f, 0.55f, 0.60f, 1.00f };
         bool wireframe = false;
         float zoom = 2.f;
+        glm::vec3 pivot = glm::vec3(0.f); ///< center of rotation, set by picking
         bool animate = true;
     } 
     globals;
@@ -227,6 +350,17 @@ int main(int argc, char* argv[])
         }
     };
 
+    auto modelview = [&]()
+    {
+        return glm::translate( glm::mat4(1.0), glm::vec3(0.f,0.f,-globals.zoom) )
+            * glm::mat4(trackball.getRotationMatrix())
+            * glm::translate( glm::mat4(1.0), -globals.pivot );
+    };
+    auto projection = [](int width, int height)
+    {
+        return glm::perspective(glm::radians(45.f), width/(float)height, .1f, 100.f);
+    };
+
     auto renderFrame = [&](int width, int height)
     {
         glViewport(0, 0, width, height);
@@ -241,10 +375,22 @@ int main(int argc, char* argv[])
         GL::checkGLError("main - glPolygonMode()");
 
         scene.update(params);
-        float aspect = width/(float)height;
-        scene.render(glm::translate( glm::mat4(1.0), glm::vec3(0.f,0.f,-globals.zoom) )
-                        * glm::mat4(trackball.getRotationMatrix()),
-                        glm::perspective(glm::radians(45.f), aspect, .1f, 100.f));
+        scene.render(modelview(), projection(width, height));
+    };
+
+    // Rotate around the picked surface point and zoom towards it
+    auto pickPivot = [&](int x, int y, int width, int height)
+    {
+        const glm::vec4 viewport(0.f, 0.f, (float)width, (float)height);
+        const glm::mat4 mv = modelview(), proj = projection(width, height);
+        const glm::vec3 wnear = glm::unProject(glm::vec3((float)x, (float)(height - y), 0.f), mv, proj, viewport);
+        const glm::vec3 wfar  = glm::unProject(glm::vec3((float)x, (float)(height - y), 1.f), mv, proj, viewport);
+        glm::vec3 point;
+        if (!scene.pick(wnear, wfar - wnear, point))
+            return;
+        const glm::vec3 eye = glm::vec3(glm::inverse(mv)[3]);
+        globals.zoom = std::max(.1f, .5f * glm::length(point - eye));
+        globals.pivot = point;
     };
 
     bool ui_disabled = true;
@@ -267,6 +413,7 @@ int main(int argc, char* argv[])
                 ImGui::BulletText("Play around with the overdraw parameter.");
                 ImGui::BulletText("Be careful when increasing resolution!");
                 ImGui::BulletText("Rotate via left mouse button.");
+                ImGui::BulletText("Right click on the surface to rotate around it.");
             }
 
             ImGui::SeparatorText("Presets");
@@ -278,8 +425,30 @@ int main(int argc, char* argv[])
             ImGui::SliderFloat("Overdraw",&params.scale,.1f,2.f);
             ImGui::SliderInt("Resolution",&params.resolution,1,7);
             ImGui::SliderFloat("Isovalue",&params.iso,-1.f,1.f);
+            ImGui::Checkbox("Stitched (watertight)",&params.stitched);
             if (ImGui::Button("Save .obj"))
-                scene.saveOBJ("mnoise.obj");
+                scene.save("mnoise.obj");
+            ImGui::SameLine();
+            if (ImGui::Button("Save .ply"))
+                scene.save("mnoise.ply");
+            ImGui::SameLine();
+            if (ImGui::Button("Save .glb"))
+                scene.save("mnoise.glb");
+            ImGui::SameLine();
+            if (ImGui::Button("Stream .ply"))
+                scene.stream("mnoise-stream.ply");
+            if (!scene.streamStatus().empty())
+                ImGui::Text("%s", scene.streamStatus().c_str());
+            if (scene.exporter().status().state != MeshExporter::State::Idle)
+            {
+                ImGui::Text("%s", scene.exporter().statusText().c_str());
+                if (scene.exporter().isRunning())
+                {
+                    ImGui::SameLine();
+                    if (ImGui::Button("Cancel"))
+                        scene.exporter().cancel();
+                }
+            }
 
             if(ImGui::Button("Save .tga"))
                 trigger_offscreen_rendering_screenshot = true;
@@ -303,8 +472,52 @@ int main(int argc, char* argv[])
             if(ImGui::CollapsingHeader("Stats & debug"))
             {
                 ImGui::Checkbox("Debug colors",&scene.debug);
+                bool optimizing = scene.isOptimizing();
+                if (ImGui::Checkbox("Optimize vertex cache", &optimizing))
+                    scene.setOptimizing(optimizing);
+                float keep = scene.simplifyRatio();
+                if (ImGui::SliderFloat("Keep triangles", &keep, 0.05f, 1.f, "%.2f"))
+                    scene.setSimplifyRatio(keep);
+                int levels = scene.lodLevels();
+                if (ImGui::SliderInt("LOD levels", &levels, 1, 6))
+                    scene.setLODLevels(levels);
+                if (!params.stitched && (keep < 1.f || levels > 1))
+                {
+                    // Unstitched slices are always welded, also when cached,
+                    // their borders stay so the chains end sooner
+                    ImGui::SameLine();
+                    ImGui::Text("welded, borders fixed");
+                }
+                bool clusters = scene.hasClusters();
+                if (ImGui::Checkbox("Cull clusters", &clusters))
+                    scene.setClusters(clusters);
+                if (clusters)
+                {
+                    ImGui::SameLine();
+                    ImGui::Checkbox("Backfaces", &scene.cullBackfaces);
+                }
                 ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
-                ImGui::Text(scene.info().c_str());
+                scene.showStats();
+                static uint64_t mesh_hash = 0;
+                if (ImGui::Button("Hash mesh"))
+                    mesh_hash = scene.hash();
+                ImGui::SameLine();
+                ImGui::Text("%016llx", (unsigned long long)mesh_hash);
+                bool caching = scene.isCaching();
+                if (ImGui::Checkbox("Cache meshes (resolution 6+)", &caching))
+                    scene.setCaching(caching);
+                bool compressed = scene.isCacheCompressed();
+                ImGui::SameLine();
+                if (ImGui::Checkbox("Compress", &compressed))
+                    scene.setCacheCompressed(compressed);
+                bool streaming = scene.streamingUploads();
+                if (ImGui::Checkbox("Streaming uploads", &streaming))
+                    scene.setStreamingUploads(streaming);
+                ImGui::SameLine();
+                ImGui::TextUnformatted(scene.isStreamingActive() ? "(mapped)" : "(glBufferSubData)");
+                int budget = scene.memoryBudget();
+                if (ImGui::SliderInt("Memory budget (MB)", &budget, 0, 4096, budget > 0 ? "%d" : "unlimited"))
+                    scene.setMemoryBudget(budget);
             }
 
             if (ui_disabled)
@@ -323,6 +536,12 @@ int main(int argc, char* argv[])
 
             trackball.setViewSize(width, height);
 
+            if (pick_requested)
+            {
+                pick_requested = false;
+                pickPivot(mousex, mousey, width, height);
+            }
+
             renderFrame(width, height);
 
             // Avoid flicker by disabling UI only if computation takes longer than a few frames
@@ -3,7 +3,9 @@
 #include <vector>
 #include <thread>
 #include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 
 class ComputeThreads
 {
@@ -22,12 +24,13 @@ public:
             {
                 while( !m_threadStates[slice].kill.load() )
                 {
-                    // yield until dirty
-                    while( !m_threadStates[slice].dirty.load() )
-                        if( m_threadStates[slice].kill.load() )
-                            return;
-                        else
-                            std::this_thread::yield();
+                    // sleep until dirty, idle workers must not keep the cores busy
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        m_wakeup.wait(lock, [&]() { return m_threadStates[slice].dirty.load() || m_threadStates[slice].kill.load(); });
+                    }
+                    if( m_threadStates[slice].kill.load() )
+                        return;
 
                     // do actual computation
                     computeFun(slice);
@@ -43,11 +46,14 @@ public:
 
     ~ComputeThreads()
     {
-        for(int i=0; i < m_numThreads; ++i)
         {
-            m_threadStates[i].kill.store(true);
-            m_threads.at(i).join();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(int i=0; i < m_numThreads; ++i)
+                m_threadStates[i].kill.store(true);
         }
+        m_wakeup.notify_all();
+        for(int i=0; i < m_numThreads; ++i)
+            m_threads.at(i).join();
     }
 
     bool ready() const
@@ -66,8 +72,12 @@ public:
 
     void launchAll()
     {
-        for(int i=0; i < m_numThreads; ++i)
-            m_threadStates[i].dirty.store(true);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(int i=0; i < m_numThreads; ++i)
+                m_threadStates[i].dirty.store(true);
+        }
+        m_wakeup.notify_all();
     }
 
 private:
@@ -81,4 +91,6 @@ private:
     int m_numThreads;
     std::vector<ThreadState> m_threadStates;
     std::vector<std::thread> m_threads;
+    std::mutex m_mutex; ///< pairs the dirty and kill flags with m_wakeup
+    std::condition_variable m_wakeup;
 };
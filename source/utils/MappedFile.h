@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+
+/// Private (copy-on-write) memory mapping of a whole file. Pages may be
+/// modified in memory, changes are never written back to the file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::filesystem::path& filename);
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+
+          unsigned char* data()       { return m_data; }
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;    ///< HANDLE
+    void* m_mapping = nullptr; ///< HANDLE
+#endif
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/// Calls f(i) for i in [0,count) on up to numThreads threads (0 for one per
+/// hardware thread), each thread handles a contiguous block of indices.
+/// Returns after all calls have finished.
+template<class Func>
+void parallelFor(size_t count, unsigned numThreads, Func f)
+{
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t n = std::min<size_t>(numThreads, count);
+    if (n <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            f(i);
+        return;
+    }
+
+    auto block = [&f, count, n](size_t t)
+    {
+        const size_t end = (t + 1) * count / n;
+        for (size_t i = t * count / n; i < end; ++i)
+            f(i);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n - 1);
+    for (size_t t = 1; t < n; ++t)
+        threads.emplace_back(block, t);
+    block(0);
+    for (auto& thread : threads)
+        thread.join();
+}
@@ -0,0 +1,193 @@
+#include <utils/RansCodec.h>
+#include <algorithm>
+#include <cstring> // memcpy
+
+namespace {
+
+constexpr uint32_t ScaleBits = 12;
+constexpr uint32_t ProbScale = 1u << ScaleBits;
+constexpr uint32_t RansL = 1u << 23; ///< lower bound of the normalized state
+
+enum StreamMode : uint8_t { Raw = 0, Constant = 1, Rans = 2 };
+
+template<class T>
+void append(std::vector<uint8_t>& out, T value)
+{
+    const size_t pos = out.size();
+    out.resize(pos + sizeof(T));
+    std::memcpy(out.data() + pos, &value, sizeof(T));
+}
+
+template<class T>
+bool take(const uint8_t*& in, const uint8_t* end, T& value)
+{
+    if (static_cast<size_t>(end - in) < sizeof(T))
+        return false;
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return true;
+}
+
+/// Scale symbol counts to frequencies summing to ProbScale, keeping every
+/// present symbol at a frequency of at least one
+void normalizeFrequencies(const uint64_t counts[256], uint64_t total, uint32_t freqs[256])
+{
+    uint32_t sum = 0;
+    int largest = 0;
+    for (int s = 0; s < 256; ++s)
+    {
+        freqs[s] = counts[s] ? std::max<uint32_t>(1, static_cast<uint32_t>(counts[s] * ProbScale / total)) : 0;
+        sum += freqs[s];
+        if (counts[s] > counts[largest])
+            largest = s;
+    }
+
+    // Correct the rounding error on the most frequent symbol, or steal from
+    // the others if that is not enough
+    if (sum <= ProbScale || freqs[largest] > sum - ProbScale)
+    {
+        freqs[largest] += ProbScale;
+        freqs[largest] -= sum;
+        return;
+    }
+    for (int s = 0; s < 256 && sum > ProbScale; ++s)
+    {
+        while (freqs[s] > 1 && sum > ProbScale)
+        {
+            --freqs[s];
+            --sum;
+        }
+    }
+}
+
+} // namespace
+
+void ransEncode(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+    uint64_t counts[256] = {};
+    for (size_t i = 0; i < size; ++i)
+        ++counts[data[i]];
+
+    const size_t distinct = static_cast<size_t>(std::count_if(counts, counts + 256, [](uint64_t c) { return c > 0; }));
+    if (distinct <= 1)
+    {
+        append(out, uint8_t(Constant));
+        append(out, uint64_t(size));
+        append(out, uint8_t(size > 0 ? data[0] : 0));
+        return;
+    }
+
+    uint32_t freqs[256];
+    uint32_t cums[257];
+    normalizeFrequencies(counts, size, freqs);
+    cums[0] = 0;
+    for (int s = 0; s < 256; ++s)
+        cums[s + 1] = cums[s] + freqs[s];
+
+    // Encode backwards into a scratch buffer, at most ScaleBits per symbol
+    std::vector<uint8_t> buf(size + size / 2 + 16);
+    uint8_t* const bufEnd = buf.data() + buf.size();
+    uint8_t* ptr = bufEnd;
+    uint32_t x = RansL;
+    for (size_t i = size; i-- > 0; )
+    {
+        const uint8_t s = data[i];
+        const uint32_t freq = freqs[s];
+        const uint32_t xMax = ((RansL >> ScaleBits) << 8) * freq;
+        while (x >= xMax)
+        {
+            *--ptr = static_cast<uint8_t>(x & 0xff);
+            x >>= 8;
+        }
+        x = ((x / freq) << ScaleBits) + (x % freq) + cums[s];
+    }
+
+    const size_t encodedSize = static_cast<size_t>(bufEnd - ptr) + 4;
+    const size_t tableSize = 256 * sizeof(uint16_t);
+    if (encodedSize + tableSize >= size)
+    {
+        append(out, uint8_t(Raw));
+        append(out, uint64_t(size));
+        out.insert(out.end(), data, data + size);
+        return;
+    }
+    ptr -= 4;
+    std::memcpy(ptr, &x, 4);
+
+    append(out, uint8_t(Rans));
+    append(out, uint64_t(size));
+    for (int s = 0; s < 256; ++s)
+        append(out, static_cast<uint16_t>(freqs[s]));
+    append(out, uint64_t(encodedSize));
+    out.insert(out.end(), ptr, bufEnd);
+}
+
+bool ransDecode(const uint8_t*& in, const uint8_t* end, std::vector<uint8_t>& out)
+{
+    uint8_t mode;
+    uint64_t size;
+    if (!take(in, end, mode) || !take(in, end, size))
+        return false;
+
+    if (mode == Constant)
+    {
+        uint8_t value;
+        if (!take(in, end, value))
+            return false;
+        out.assign(size, value);
+        return true;
+    }
+    if (mode == Raw)
+    {
+        if (static_cast<uint64_t>(end - in) < size)
+            return false;
+        out.assign(in, in + size);
+        in += size;
+        return true;
+    }
+    if (mode != Rans)
+        return false;
+
+    uint32_t freqs[256];
+    uint32_t cums[257];
+    cums[0] = 0;
+    for (int s = 0; s < 256; ++s)
+    {
+        uint16_t f;
+        if (!take(in, end, f))
+            return false;
+        freqs[s] = f;
+        cums[s + 1] = cums[s] + f;
+    }
+    uint64_t encodedSize;
+    if (cums[256] != ProbScale || !take(in, end, encodedSize) || encodedSize < 4 || static_cast<uint64_t>(end - in) < encodedSize)
+        return false;
+
+    uint8_t symbols[ProbScale];
+    for (int s = 0; s < 256; ++s)
+        std::fill(symbols + cums[s], symbols + cums[s + 1], static_cast<uint8_t>(s));
+
+    const uint8_t* ptr = in;
+    const uint8_t* const ptrEnd = in + encodedSize;
+    in = ptrEnd;
+
+    uint32_t x;
+    std::memcpy(&x, ptr, 4);
+    ptr += 4;
+
+    out.resize(size);
+    constexpr uint32_t mask = ProbScale - 1;
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        const uint8_t s = symbols[x & mask];
+        out[i] = s;
+        x = freqs[s] * (x >> ScaleBits) + (x & mask) - cums[s];
+        while (x < RansL)
+        {
+            if (ptr == ptrEnd)
+                return i + 1 == size;
+            x = (x << 8) | *ptr++;
+        }
+    }
+    return true;
+}
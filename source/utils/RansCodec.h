@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Order-0 entropy coding of byte streams with a static range asymmetric
+/// numeral system (rANS), frequency table stored in the stream. Streams that
+/// do not compress are stored raw, constant streams as a single byte.
+
+/// Appends the encoded stream to out
+void ransEncode(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+/// Decodes one stream starting at in, advances in past it.
+/// Returns false on malformed input.
+bool ransDecode(const uint8_t*& in, const uint8_t* end, std::vector<uint8_t>& out);